@@ -1,404 +1,9825 @@
-/*
- * Copyright (c) 2011, 2012, 2013, 2014, 2015 Nicira, Inc.
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at:
- *
- *     http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-#include <config.h>
-#undef NDEBUG
-#include <arpa/inet.h>
-#include <errno.h>
-#include <getopt.h>
-#include <signal.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <setjmp.h>
-#include "command-line.h"
-#include "daemon.h"
-#include "dynamic-string.h"
-#include "ofpbuf.h"
-#include "ovstest.h"
-#include "packets.h"
-#include "poll-loop.h"
-#include "socket-util.h"
-#include "unixctl.h"
-#include "util.h"
-#include "openvswitch/vlog.h"
-#include "openvswitch/types.h"
-#include "openvswitch/compiler.h"
-
-static unixctl_cb_func test_ipfix_exit;
-static void parse_options(int argc, char *argv[]);
-OVS_NO_RETURN static void usage(void);
-
-#ifdef __CHECKER__
-#define OVS_BITWISE __attribute__((bitwise))
-#define OVS_FORCE __attribute__((force))
-#else
-#define OVS_BITWISE
-#define OVS_FORCE
-#endif
-
-typedef uint8_t OVS_BITWISE ovs_be8;
-typedef uint64_t OVS_BITWISE ovs_be64;
-
-
-/*IPFIX message header*/
-struct ipfix_message_header{
-    ovs_be16 version;
-    ovs_be16 length;
-    ovs_be32 export_time;
-    ovs_be32 seq_number;
-    ovs_be32 obs_dmID;
-};
-
-/*IPFIX set header*/
-struct ipfix_set_header{
-    ovs_be16 set_id;
-    ovs_be16 length;
-};
-
-/*IPFIX data record for ethernet*/
-#pragma pack(push)
-#pragma pack(1)
-struct ipfix_data_record_ethernet{
-    ovs_be32 obs_point_id;
-    ovs_be8 direction_ingress;
-    ovs_be8 src_mac[6];
-    ovs_be8 dst_mac[6];
-    ovs_be16 eth_type;
-    ovs_be8 eth_hdlen;
-    ovs_be32 start_time;
-    ovs_be32 end_time;
-    ovs_be64 packets;
-    ovs_be64 l2_octor_delta_count;
-    ovs_be8 flow_end_reason;
-};
-#pragma pack(pop)
-
-#pragma pack(push)
-#pragma pack(1)
-/*IPFIX data record for icmp*/
-struct ipfix_data_record_icmp{
-    ovs_be32 obs_point_id;
-    ovs_be8 direction_ingress;
-    ovs_be8 src_mac[6];
-    ovs_be8 dst_mac[6];
-    ovs_be16 eth_type;
-    ovs_be8 eth_hdlen;
-    ovs_be8 ip_ver;
-    ovs_be8 ip_ttl;
-    ovs_be8 ip_pro;
-    ovs_be8 dscp;
-    ovs_be8 ip_pre;
-    ovs_be8 ip_tos;
-    ovs_be8 src_ip[4];
-    ovs_be8 dst_ip[4];
-    ovs_be8 icmp_type;
-    ovs_be8 icmp_code;
-    ovs_be32 start_time;
-    ovs_be32 end_time;
-    ovs_be64 packets;
-    ovs_be64 l2_octor_delta_count;
-    ovs_be8 flow_end_reason;
-    ovs_be64 octets;
-    ovs_be64 delta_oc_sq;
-    ovs_be64 min_len;
-    ovs_be64 max_len;
-
-};
-#pragma pack(pop)
-
-
-#define IPFIX_MES_HEADER_LEN sizeof(struct ipfix_message_header)
-#define IPFIX_SET_HEADER_LEN sizeof(struct ipfix_set_header)
-#define IPFIX_DATA_RECORD_ETH_LEN 45
-#define IPFIX_DATA_RECORD_ICMP_LEN 93
-
-#define ADDRESS_MAC 0
-#define ADDRESS_IPV4 4
-#define ADDRESS_IPV6 6
-
-
-static void
-print_address(void *rec, ovs_be8 add_type){
-    ovs_be8 *p;
-    p = &*rec;
-
-    switch (add_type){
-        case 0:{
-            printf("src mac ");
-            for (int i=0; i<6; ++i)
-                printf("%x",*p++);
-            printf(", ");
-
-            printf("dst mac ");
-            for (int j=0; j<6; ++j)
-                printf("%x",*p++);
-            printf(", ");
-
-            break;
-        }
-
-        case 4:{
-            printf("src ip %"PRIu8,*p++);
-            for (int i=0; i<3;i++)
-                printf(".%"PRIu8,*p++);
-            printf(", ");
-
-            printf("dst ip %"PRIu8,*p++);
-            for (int i=0; i<3;i++)
-                printf(".%"PRIu8,*p++);
-
-            break;
-        }
-
-        default:
-            break;
-    }
-}
-
-
-static void
-print_record(void *rec, ovs_be16 dp){
-    if(!rec)return;
-
-    switch (ntohs(dp)){
-        case 256:{
-            struct ipfix_data_record_ethernet *p;
-            p = (struct ipfix_data_record_ethernet *) rec;
-            printf("set record: observation_point_id %"PRIu32", "
-                    "packets %"PRIu64", ",
-                    ntohl(p->obs_point_id),
-                    ntohll(p->packets)
-            );
-
-            print_address(p->src_mac,ADDRESS_MAC);
-
-            printf("\n");
-            break;
-        }
-
-        case 266:{
-            struct ipfix_data_record_icmp *p;
-            p = (struct ipfix_data_record_icmp *) rec;
-            printf("set record: observation_point_id %"PRIu32", "
-                    "packets %"PRIu64", ",
-                    ntohl(p->obs_point_id),
-                    ntohll(p->packets)
-            );
-
-            print_address(p->src_mac,ADDRESS_MAC);
-
-            printf("IPVersion %"PRIu8", "
-                    "Protocol %"PRIu8", ",
-                    p->ip_ver,
-                    p->ip_pro
-            );
-
-            print_address(p->src_ip,ADDRESS_IPV4);
-
-            printf("\n");
-            break;
-        }
-        default:
-            return;
-    }
-}
-
-static void
-print_ipfix(struct ofpbuf *buf){
-
-    const struct ipfix_message_header *msg_hd;
-    const struct ipfix_set_header *set_hd;
-
-    msg_hd = ofpbuf_try_pull(buf, IPFIX_MES_HEADER_LEN);
-    set_hd = ofpbuf_try_pull(buf, IPFIX_SET_HEADER_LEN);
-
-    if(!msg_hd ){
-        printf("failed to get IPFIX packet header\n");
-        return;
-    }
-    if(!set_hd){
-        printf("failed to get IPFIX set header\n");
-        return;
-    }
-
-    //for so far  just print ethernet and icmp
-    if(ntohs(set_hd->set_id)!=256 && ntohs(set_hd->set_id)!=266)
-        return;
-
-    //print ipfix header
-    printf("header: v%"PRIu16", "
-            "length %"PRIu16", "
-            "seq %"PRIu32", "
-            "ovservation domain %"PRIu32,
-            ntohs(msg_hd->version),
-            ntohs(msg_hd->length),
-            ntohl(msg_hd->seq_number),
-            ntohl(msg_hd->obs_dmID));
-    printf("\n");
-
-    //print ipfix set header
-    printf("set header: setId %"PRIu16", "
-            "set length %"PRIu16,
-            ntohs(set_hd->set_id),
-            ntohs(set_hd->length));
-    printf("\n");
-
-    //print ipfix record
-    switch (ntohs(set_hd->set_id)){
-        case 256: {
-            struct ipfix_data_record_ethernet *rec;
-            rec = ofpbuf_try_pull(buf, IPFIX_DATA_RECORD_ETH_LEN);
-            if (!rec) {
-                printf("failed to get IPFIX ethernet data record\n");
-                return;
-            }
-            print_record((void*)rec, set_hd->set_id);
-            break;
-        }
-        case 266:{
-            struct ipfix_data_record_icmp *rec;
-            rec = ofpbuf_try_pull(buf, IPFIX_DATA_RECORD_ICMP_LEN);
-            if(!rec){
-                printf("failed to get IPFIX icmp data record\n");
-                return;
-            }
-            print_record((void*)rec,set_hd->set_id);
-            break;
-        }
-        default:
-            return;
-    }
-
-
-}
-
-static void
-parse_options(int argc, char *argv[]){
-    enum {
-        DAEMON_OPTION_ENUMS,
-        VLOG_OPTION_ENUMS
-    };
-    static const struct option long_options[] = {
-            {"help", no_argument, NULL, 'h'},
-            DAEMON_LONG_OPTIONS,
-            VLOG_LONG_OPTIONS,
-            {NULL, 0, NULL, 0},
-    };
-    char *short_options = ovs_cmdl_long_options_to_short_options(long_options);
-    for (;;) {
-        int c = getopt_long(argc, argv, short_options, long_options, NULL);
-        if (c == -1) {
-            break;
-        }
-        switch (c) {
-            case 'h':
-                usage();
-                DAEMON_OPTION_HANDLERS
-                VLOG_OPTION_HANDLERS
-            case '?':
-                exit(EXIT_FAILURE);
-            default:
-                abort();
-        }
-    }
-    free(short_options);
-}
-
-static void
-usage(void){
-    printf("%s: ipfix collector test utility\n"
-                   "usage: %s [OPTIONS] PORT[:IP]\n"
-                   "where PORT is the UDP port to listen on and IP is optionally\n"
-                   "the IP address to listen on.\n",
-           program_name, program_name);
-    daemon_usage();
-    vlog_usage();
-    printf("\nOther options:\n"
-           "  -h, --help                  display this help message\n");
-    exit(EXIT_SUCCESS);
-}
-
-static void
-test_ipfix_exit(struct unixctl_conn *conn,
-                int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
-                void *exiting_)
-{
-    bool *exiting = exiting_;
-    *exiting = true;
-    unixctl_command_reply(conn, NULL);
-}
-
-static void
-test_ipfix_main(int argc, char *argv[])
-{
-    struct unixctl_server *server;
-    enum { MAX_RECV = 1500 };
-    const char *target;
-    struct ofpbuf buf;
-    bool exiting = false;
-    int error;
-    int sock;
-    ovs_cmdl_proctitle_init(argc, argv);
-    set_program_name(argv[0]);
-    service_start(&argc, &argv);
-    parse_options(argc, argv);
-    if (argc - optind != 1) {
-        ovs_fatal(0, "exactly one non-option argument required "
-                "(use --help for help)");
-    }
-    target = argv[optind];
-    sock = inet_open_passive(SOCK_DGRAM, target, 0, NULL, 0, true);
-    if (sock < 0) {
-	printf("sock<0\n");
-        ovs_fatal(0, "%s: failed to open (%s)", argv[1], ovs_strerror(-sock));
-    }
-    daemon_save_fd(STDOUT_FILENO);
-    daemonize_start(false);
-
-    error = unixctl_server_create(NULL, &server);
-    if (error) {
-        ovs_fatal(error, "failed to create unixctl server");
-    }
-    unixctl_command_register("exit", "", 0, 0, test_ipfix_exit, &exiting);
-    daemonize_complete();
-
-    ofpbuf_init(&buf, MAX_RECV);
-    for (;;) {
-        int retval;
-        unixctl_server_run(server);
-        ofpbuf_clear(&buf);
-        do {
-            retval = recv(sock, buf.data, buf.allocated, 0);
-        } while (retval < 0 && errno == EINTR);
-        if (retval > 0) {
-            ofpbuf_put_uninit(&buf, retval);
-            print_ipfix(&buf);
-            fflush(stdout);
-        }
-        if (exiting) {
-            break;
-        }
-        poll_fd_wait(sock, POLLIN);
-        unixctl_server_wait(server);
-        poll_block();
-    }
-    ofpbuf_uninit(&buf);
-    unixctl_server_destroy(server);
-}
-OVSTEST_REGISTER("test-ipfix", test_ipfix_main);
-
-
+/*
+ * Copyright (c) 2011, 2012, 2013, 2014, 2015 Nicira, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <config.h>
+#undef NDEBUG
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <setjmp.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define IPFIX_HAVE_X86_SIMD 1
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define IPFIX_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+#include "command-line.h"
+#include "daemon.h"
+#include "dirs.h"
+#include "dynamic-string.h"
+#include "hash.h"
+#include "hmap.h"
+#include "jsonrpc.h"
+#include "latch.h"
+#include "ofpbuf.h"
+#include "ovs-atomic.h"
+#include "ovs-thread.h"
+#include "ovstest.h"
+#include "packets.h"
+#include "poll-loop.h"
+#include "seq.h"
+#include "socket-util.h"
+#include "timeval.h"
+#include "unixctl.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+#include "openvswitch/types.h"
+#include "openvswitch/compiler.h"
+
+VLOG_DEFINE_THIS_MODULE(test_ipfix);
+
+static unixctl_cb_func test_ipfix_exit;
+static unixctl_cb_func test_ipfix_batch_stats;
+static unixctl_cb_func test_ipfix_stats;
+static unixctl_cb_func test_ipfix_flows;
+static unixctl_cb_func test_ipfix_top;
+static void parse_options(int argc, char *argv[]);
+OVS_NO_RETURN static void usage(void);
+
+/* --batch: maximum number of datagrams received per wakeup. */
+static int batch_size = 32;
+
+/* --seq-per-message: whether sequence numbers count messages, as older
+ * Open vSwitch exporters do, instead of data records as in RFC 7011.  In
+ * the latter case, the records of a data set whose template is unknown
+ * cannot be counted, so loss is not accounted for across such a set. */
+static bool seq_per_message = false;
+
+/* --threads: number of receive/decode threads. */
+static int n_threads = 1;
+
+/* --capture: binary capture writer, or NULL.  --no-text: whether to print
+ * decoded records to stdout. */
+static const char *capture_file;
+static struct ipfix_capture *capture;
+static bool print_records = true;
+
+/* --aggregate: maximum number of flows in each worker's flow table, 0 to
+ * disable aggregation.  --dump-interval: how often to print the flow
+ * table, in ms, 0 for only on request. */
+static int agg_max_flows = 0;
+static int agg_dump_interval = 0;
+
+/* --top-k: number of heavy hitters to report per observation domain,
+ * dimension and metric, 0 to disable.  --hh-domains: number of
+ * observation domains tracked per thread. */
+static int hh_top_k = 10;
+static int hh_max_domains = 8;
+
+/* --flush-bytes, --flush-ms: output is written out after every batch unless
+ * 'flush_bytes' is nonzero, in which case it accumulates until it reaches
+ * 'flush_bytes' bytes or has been pending for 'flush_ms' milliseconds. */
+static int flush_bytes = 0;
+static int flush_ms = 100;
+
+/* --writer-queue: number of output buffers that each thread may queue for
+ * the writer thread, 0 to write output from the thread that produced it.
+ * --writer-full: whether a thread whose queue is full drops its output
+ * ("drop") or waits for the writer thread ("block"). */
+static int writer_queue = 0;
+static bool writer_drop = false;
+
+/* --output: file to write to instead of stdout.  --rotate-bytes: size past
+ * which the output file is rotated, 0 for never.  --rotate-keep: number of
+ * rotated files kept. */
+static const char *output_file;
+static long long int rotate_bytes = 0;
+static int rotate_keep = 1;
+
+/* --columns: instruction set that sets of fixed-layout records are bulk
+ * decoded with ("auto", "scalar", "sse4", "avx2"), or "off" to decode
+ * record by record. */
+static const char *columns_isa = "auto";
+
+/* --tcp: whether to accept exporter connections over TCP instead of
+ * receiving datagrams. */
+static bool tcp_mode = false;
+
+/* --filter: records that do not match it are dropped before any decoding,
+ * or NULL to keep every record. */
+static struct ipfix_filter *filter;
+
+/* --io-uring: whether to receive datagrams through an io_uring multishot
+ * recvmsg into provided buffers instead of calling recvmmsg() after each
+ * wakeup.  Falls back to recvmmsg() if io_uring is unavailable. */
+static bool use_io_uring = false;
+
+/* --biflow: window, in ms, within which records of opposite directions are
+ * stitched into biflows, 0 to disable.  --biflow-max: maximum number of
+ * biflows that each thread holds. */
+static int biflow_window = 0;
+static int biflow_max = 16384;
+
+/* --sampling: the N of the 1-in-N packet sampling assumed for observation
+ * domains whose exporter announces no sampling parameters, 1 for none. */
+static int default_sampling = 1;
+
+/* --forward: downstream collectors, each "udp:IP:PORT" or "tcp:IP:PORT",
+ * that every worker re-exports the messages it receives to, unchanged.
+ * --forward-filtered: whether to re-export only the messages that carry a
+ * template set or a data record that passes --filter. */
+static const char **forward_targets;
+static size_t n_forward_targets, allocated_forward_targets;
+static bool forward_filtered = false;
+
+/* Size of each receive buffer: the largest IPFIX message, whose length
+ * field has 16 bits.  Buffers are touched only as far as datagrams fill
+ * them, so small messages do not pay for the large ones. */
+enum { MAX_RECV = 65535 };
+
+#ifdef __CHECKER__
+#define OVS_BITWISE __attribute__((bitwise))
+#define OVS_FORCE __attribute__((force))
+#else
+#define OVS_BITWISE
+#define OVS_FORCE
+#endif
+
+typedef uint8_t OVS_BITWISE ovs_be8;
+typedef uint64_t OVS_BITWISE ovs_be64;
+
+
+/*IPFIX message header*/
+struct ipfix_message_header{
+    ovs_be16 version;
+    ovs_be16 length;
+    ovs_be32 export_time;
+    ovs_be32 seq_number;
+    ovs_be32 obs_dmID;
+};
+
+/*IPFIX set header*/
+struct ipfix_set_header{
+    ovs_be16 set_id;
+    ovs_be16 length;
+};
+
+/*IPFIX data record for ethernet*/
+#pragma pack(push)
+#pragma pack(1)
+struct ipfix_data_record_ethernet{
+    ovs_be32 obs_point_id;
+    ovs_be8 direction_ingress;
+    ovs_be8 src_mac[6];
+    ovs_be8 dst_mac[6];
+    ovs_be16 eth_type;
+    ovs_be8 eth_hdlen;
+    ovs_be32 start_time;
+    ovs_be32 end_time;
+    ovs_be64 packets;
+    ovs_be64 l2_octor_delta_count;
+    ovs_be8 flow_end_reason;
+};
+#pragma pack(pop)
+
+#pragma pack(push)
+#pragma pack(1)
+/*IPFIX data record for icmp*/
+struct ipfix_data_record_icmp{
+    ovs_be32 obs_point_id;
+    ovs_be8 direction_ingress;
+    ovs_be8 src_mac[6];
+    ovs_be8 dst_mac[6];
+    ovs_be16 eth_type;
+    ovs_be8 eth_hdlen;
+    ovs_be8 ip_ver;
+    ovs_be8 ip_ttl;
+    ovs_be8 ip_pro;
+    ovs_be8 dscp;
+    ovs_be8 ip_pre;
+    ovs_be8 ip_tos;
+    ovs_be8 src_ip[4];
+    ovs_be8 dst_ip[4];
+    ovs_be8 icmp_type;
+    ovs_be8 icmp_code;
+    ovs_be32 start_time;
+    ovs_be32 end_time;
+    ovs_be64 packets;
+    ovs_be64 l2_octor_delta_count;
+    ovs_be8 flow_end_reason;
+    ovs_be64 octets;
+    ovs_be64 delta_oc_sq;
+    ovs_be64 min_len;
+    ovs_be64 max_len;
+
+};
+#pragma pack(pop)
+
+
+/*IPFIX template record header, followed by 'field_count' field specifiers*/
+struct ipfix_template_record_header{
+    ovs_be16 template_id;
+    ovs_be16 field_count;
+};
+
+/*IPFIX field specifier, followed by an enterprise number if the
+ * high bit of 'ie_id' is set*/
+struct ipfix_field_specifier{
+    ovs_be16 ie_id;
+    ovs_be16 length;
+};
+
+
+#define IPFIX_MES_HEADER_LEN sizeof(struct ipfix_message_header)
+#define IPFIX_SET_HEADER_LEN sizeof(struct ipfix_set_header)
+#define IPFIX_MAX_MESSAGE_LEN 65535     /* 16-bit message length field. */
+#define IPFIX_DATA_RECORD_ETH_LEN 45
+#define IPFIX_DATA_RECORD_ICMP_LEN 93
+
+#define IPFIX_SET_ID_TEMPLATE 2
+#define IPFIX_SET_ID_OPTIONS_TEMPLATE 3
+#define IPFIX_SET_ID_DATA_MIN 256
+
+#define IPFIX_TEMPLATE_ID_ETH 256
+#define IPFIX_TEMPLATE_ID_IPV4 262
+#define IPFIX_TEMPLATE_ID_ICMP 266
+
+#define IPFIX_ENTERPRISE_BIT 0x8000
+#define IPFIX_ENTERPRISE_VMWARE 6876
+#define IPFIX_VARLEN 65535
+
+/*Classification from which OVS derives the ID of the data template that
+ * a flow is exported with (ofproto-dpif-ipfix.c):
+ *
+ *     256 + ((l2 * NUM_IPFIX_PROTO_L3 + l3) * NUM_IPFIX_PROTO_L4 + l4)
+ *           * NUM_IPFIX_PROTO_TUNNEL + tunnel
+ *
+ * e.g. 256 Ethernet, 262 IPv4, 264 IPv4 TCP/UDP/SCTP, 266 IPv4 ICMP, 268
+ * IPv6, 270 IPv6 TCP/UDP/SCTP, 272 IPv6 ICMP, plus 1 if tunneled and 18
+ * if VLAN tagged.  OVS only classifies L4 of IP flows, so 28 of the 36
+ * IDs are used*/
+enum ipfix_proto_l2 {
+    IPFIX_PROTO_L2_ETH,
+    IPFIX_PROTO_L2_VLAN,
+    NUM_IPFIX_PROTO_L2
+};
+
+enum ipfix_proto_l3 {
+    IPFIX_PROTO_L3_UNKNOWN,
+    IPFIX_PROTO_L3_IPV4,
+    IPFIX_PROTO_L3_IPV6,
+    NUM_IPFIX_PROTO_L3
+};
+
+enum ipfix_proto_l4 {
+    IPFIX_PROTO_L4_UNKNOWN,
+    IPFIX_PROTO_L4_TCP_UDP_SCTP,
+    IPFIX_PROTO_L4_ICMP,
+    NUM_IPFIX_PROTO_L4
+};
+
+enum ipfix_proto_tunnel {
+    IPFIX_PROTO_NOT_TUNNELED,
+    IPFIX_PROTO_TUNNELED,
+    NUM_IPFIX_PROTO_TUNNEL
+};
+
+#define IPFIX_N_OVS_TEMPLATE_IDS (NUM_IPFIX_PROTO_L2 * NUM_IPFIX_PROTO_L3 \
+                                  * NUM_IPFIX_PROTO_L4                  \
+                                  * NUM_IPFIX_PROTO_TUNNEL)
+
+#define ADDRESS_MAC 0
+#define ADDRESS_IPV4 4
+#define ADDRESS_IPV6 6
+
+/*IPFIX information element identifiers that OVS exports (RFC 7012), and
+ * the VMware enterprise-specific ones it uses for tunnels*/
+enum ipfix_ie_id {
+    IPFIX_IE_OCTET_DELTA_COUNT = 1,
+    IPFIX_IE_PACKET_DELTA_COUNT = 2,
+    IPFIX_IE_PROTOCOL_IDENTIFIER = 4,
+    IPFIX_IE_IP_CLASS_OF_SERVICE = 5,
+    IPFIX_IE_SOURCE_TRANSPORT_PORT = 7,
+    IPFIX_IE_SOURCE_IPV4_ADDRESS = 8,
+    IPFIX_IE_DESTINATION_TRANSPORT_PORT = 11,
+    IPFIX_IE_DESTINATION_IPV4_ADDRESS = 12,
+    IPFIX_IE_MINIMUM_IP_TOTAL_LENGTH = 25,
+    IPFIX_IE_MAXIMUM_IP_TOTAL_LENGTH = 26,
+    IPFIX_IE_SOURCE_IPV6_ADDRESS = 27,
+    IPFIX_IE_DESTINATION_IPV6_ADDRESS = 28,
+    IPFIX_IE_FLOW_LABEL_IPV6 = 31,
+    IPFIX_IE_SOURCE_MAC_ADDRESS = 56,
+    IPFIX_IE_VLAN_ID = 58,
+    IPFIX_IE_IP_VERSION = 60,
+    IPFIX_IE_FLOW_DIRECTION = 61,
+    IPFIX_IE_DESTINATION_MAC_ADDRESS = 80,
+    IPFIX_IE_FLOW_END_REASON = 136,
+    IPFIX_IE_OBSERVATION_POINT_ID = 138,
+    IPFIX_IE_FLOW_START_DELTA_MICROSECONDS = 158,
+    IPFIX_IE_FLOW_END_DELTA_MICROSECONDS = 159,
+    IPFIX_IE_ICMP_TYPE_IPV4 = 176,
+    IPFIX_IE_ICMP_CODE_IPV4 = 177,
+    IPFIX_IE_ICMP_TYPE_IPV6 = 178,
+    IPFIX_IE_ICMP_CODE_IPV6 = 179,
+    IPFIX_IE_IP_TTL = 192,
+    IPFIX_IE_IP_DIFF_SERV_CODE_POINT = 195,
+    IPFIX_IE_IP_PRECEDENCE = 196,
+    IPFIX_IE_OCTET_DELTA_SUM_OF_SQUARES = 198,
+    IPFIX_IE_ETHERNET_HEADER_LENGTH = 240,
+    IPFIX_IE_DOT1Q_VLAN_ID = 243,
+    IPFIX_IE_DOT1Q_PRIORITY = 244,
+    IPFIX_IE_ETHERNET_TYPE = 256,
+    IPFIX_IE_LAYER2_OCTET_DELTA_COUNT = 352,
+
+    /* IPFIX_ENTERPRISE_VMWARE. */
+    IPFIX_IE_TUNNEL_TYPE = 891,
+    IPFIX_IE_TUNNEL_KEY = 892,              /* Variable-length. */
+    IPFIX_IE_TUNNEL_SOURCE_IPV4_ADDRESS = 893,
+    IPFIX_IE_TUNNEL_DESTINATION_IPV4_ADDRESS = 894,
+    IPFIX_IE_TUNNEL_PROTOCOL_IDENTIFIER = 895,
+    IPFIX_IE_TUNNEL_SOURCE_TRANSPORT_PORT = 896,
+    IPFIX_IE_TUNNEL_DESTINATION_TRANSPORT_PORT = 897,
+};
+
+/*Fields of a decoded record, one bit each in ipfix_flow's 'present'*/
+enum ipfix_flow_field {
+    IPFIX_F_OBS_POINT_ID,
+    IPFIX_F_DIRECTION,
+    IPFIX_F_SRC_MAC,
+    IPFIX_F_DST_MAC,
+    IPFIX_F_ETH_TYPE,
+    IPFIX_F_ETH_HDLEN,
+    IPFIX_F_IP_VER,
+    IPFIX_F_IP_TTL,
+    IPFIX_F_IP_PRO,
+    IPFIX_F_DSCP,
+    IPFIX_F_IP_PRE,
+    IPFIX_F_IP_TOS,
+    IPFIX_F_SRC_IP,
+    IPFIX_F_DST_IP,
+    IPFIX_F_ICMP_TYPE,
+    IPFIX_F_ICMP_CODE,
+    IPFIX_F_START_TIME,
+    IPFIX_F_END_TIME,
+    IPFIX_F_PACKETS,
+    IPFIX_F_L2_OCTETS,
+    IPFIX_F_FLOW_END_REASON,
+    IPFIX_F_OCTETS,
+    IPFIX_F_DELTA_OC_SQ,
+    IPFIX_F_MIN_LEN,
+    IPFIX_F_MAX_LEN,
+    IPFIX_F_VLAN_ID,
+    IPFIX_F_DOT1Q_VLAN_ID,
+    IPFIX_F_DOT1Q_PRIORITY,
+    IPFIX_F_SRC_IPV6,
+    IPFIX_F_DST_IPV6,
+    IPFIX_F_FLOW_LABEL,
+    IPFIX_F_SRC_PORT,
+    IPFIX_F_DST_PORT,
+    IPFIX_F_TUN_SRC_IP,
+    IPFIX_F_TUN_DST_IP,
+    IPFIX_F_TUN_PROTO,
+    IPFIX_F_TUN_SRC_PORT,
+    IPFIX_F_TUN_DST_PORT,
+    IPFIX_F_TUN_TYPE,
+    IPFIX_F_TUN_KEY,
+};
+
+#define IPFIX_F_BIT(FIELD) (UINT64_C(1) << (FIELD))
+
+/*A data record decoded into host byte order.  Addresses stay as byte
+ * arrays so that print_address() can walk them; each source address must
+ * stay adjacent to its destination address for the same reason.  ICMPv6
+ * type and code share the ICMP members*/
+struct ipfix_flow{
+    uint64_t present;           /* Bitmap of IPFIX_F_BIT(IPFIX_F_*). */
+    uint32_t obs_point_id;
+    uint8_t direction_ingress;
+    uint8_t src_mac[6];
+    uint8_t dst_mac[6];
+    uint16_t eth_type;
+    uint8_t eth_hdlen;
+    uint8_t ip_ver;
+    uint8_t ip_ttl;
+    uint8_t ip_pro;
+    uint8_t dscp;
+    uint8_t ip_pre;
+    uint8_t ip_tos;
+    uint8_t src_ip[4];
+    uint8_t dst_ip[4];
+    uint8_t icmp_type;
+    uint8_t icmp_code;
+    uint32_t start_time;
+    uint32_t end_time;
+    uint64_t packets;
+    uint64_t l2_octor_delta_count;
+    uint8_t flow_end_reason;
+    uint64_t octets;
+    uint64_t delta_oc_sq;
+    uint64_t min_len;
+    uint64_t max_len;
+    uint16_t vlan_id;
+    uint16_t dot1q_vlan_id;
+    uint8_t dot1q_priority;
+    uint8_t src_ipv6[16];
+    uint8_t dst_ipv6[16];
+    uint32_t flow_label;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t tun_src_ip[4];
+    uint8_t tun_dst_ip[4];
+    uint8_t tun_proto;
+    uint16_t tun_src_port;
+    uint16_t tun_dst_port;
+    uint8_t tun_type;
+    uint64_t tun_key;
+};
+
+/*How an information element lands in struct ipfix_flow*/
+enum ipfix_ie_kind {
+    IPFIX_KIND_UINT,            /* Unsigned integer, reduced size allowed. */
+    IPFIX_KIND_BYTES,           /* Address or other octet array. */
+};
+
+struct ipfix_ie_map{
+    uint32_t enterprise;
+    uint16_t ie_id;
+    enum ipfix_flow_field field;
+    enum ipfix_ie_kind kind;
+    uint16_t dst_ofs;
+    uint8_t dst_len;
+};
+
+/* IE and FIELD are pasted before they can be expanded, since names such
+ * as IP_TTL are also <netinet/in.h> macros. */
+#define IPFIX_ENTERPRISE_IE_MAP(ENTERPRISE, IE_ID, FIELD_ID, KIND, MEMBER) \
+    { ENTERPRISE, IE_ID, FIELD_ID, IPFIX_KIND_##KIND,                   \
+      offsetof(struct ipfix_flow, MEMBER),                              \
+      sizeof(((struct ipfix_flow *) NULL)->MEMBER) }
+#define IPFIX_IE_MAP(IE, FIELD, KIND, MEMBER)                           \
+    IPFIX_ENTERPRISE_IE_MAP(0, IPFIX_IE_##IE, IPFIX_F_##FIELD, KIND, MEMBER)
+#define IPFIX_VMWARE_IE_MAP(IE, FIELD, KIND, MEMBER)                    \
+    IPFIX_ENTERPRISE_IE_MAP(IPFIX_ENTERPRISE_VMWARE, IPFIX_IE_##IE,     \
+                            IPFIX_F_##FIELD, KIND, MEMBER)
+
+static const struct ipfix_ie_map ipfix_ie_maps[] = {
+    IPFIX_IE_MAP(OBSERVATION_POINT_ID, OBS_POINT_ID, UINT, obs_point_id),
+    IPFIX_IE_MAP(FLOW_DIRECTION, DIRECTION, UINT, direction_ingress),
+    IPFIX_IE_MAP(SOURCE_MAC_ADDRESS, SRC_MAC, BYTES, src_mac),
+    IPFIX_IE_MAP(DESTINATION_MAC_ADDRESS, DST_MAC, BYTES, dst_mac),
+    IPFIX_IE_MAP(ETHERNET_TYPE, ETH_TYPE, UINT, eth_type),
+    IPFIX_IE_MAP(ETHERNET_HEADER_LENGTH, ETH_HDLEN, UINT, eth_hdlen),
+    IPFIX_IE_MAP(IP_VERSION, IP_VER, UINT, ip_ver),
+    IPFIX_IE_MAP(IP_TTL, IP_TTL, UINT, ip_ttl),
+    IPFIX_IE_MAP(PROTOCOL_IDENTIFIER, IP_PRO, UINT, ip_pro),
+    IPFIX_IE_MAP(IP_DIFF_SERV_CODE_POINT, DSCP, UINT, dscp),
+    IPFIX_IE_MAP(IP_PRECEDENCE, IP_PRE, UINT, ip_pre),
+    IPFIX_IE_MAP(IP_CLASS_OF_SERVICE, IP_TOS, UINT, ip_tos),
+    IPFIX_IE_MAP(SOURCE_IPV4_ADDRESS, SRC_IP, BYTES, src_ip),
+    IPFIX_IE_MAP(DESTINATION_IPV4_ADDRESS, DST_IP, BYTES, dst_ip),
+    IPFIX_IE_MAP(ICMP_TYPE_IPV4, ICMP_TYPE, UINT, icmp_type),
+    IPFIX_IE_MAP(ICMP_CODE_IPV4, ICMP_CODE, UINT, icmp_code),
+    IPFIX_IE_MAP(FLOW_START_DELTA_MICROSECONDS, START_TIME, UINT, start_time),
+    IPFIX_IE_MAP(FLOW_END_DELTA_MICROSECONDS, END_TIME, UINT, end_time),
+    IPFIX_IE_MAP(PACKET_DELTA_COUNT, PACKETS, UINT, packets),
+    IPFIX_IE_MAP(LAYER2_OCTET_DELTA_COUNT, L2_OCTETS, UINT,
+                 l2_octor_delta_count),
+    IPFIX_IE_MAP(FLOW_END_REASON, FLOW_END_REASON, UINT, flow_end_reason),
+    IPFIX_IE_MAP(OCTET_DELTA_COUNT, OCTETS, UINT, octets),
+    IPFIX_IE_MAP(OCTET_DELTA_SUM_OF_SQUARES, DELTA_OC_SQ, UINT, delta_oc_sq),
+    IPFIX_IE_MAP(MINIMUM_IP_TOTAL_LENGTH, MIN_LEN, UINT, min_len),
+    IPFIX_IE_MAP(MAXIMUM_IP_TOTAL_LENGTH, MAX_LEN, UINT, max_len),
+    IPFIX_IE_MAP(VLAN_ID, VLAN_ID, UINT, vlan_id),
+    IPFIX_IE_MAP(DOT1Q_VLAN_ID, DOT1Q_VLAN_ID, UINT, dot1q_vlan_id),
+    IPFIX_IE_MAP(DOT1Q_PRIORITY, DOT1Q_PRIORITY, UINT, dot1q_priority),
+    IPFIX_IE_MAP(SOURCE_IPV6_ADDRESS, SRC_IPV6, BYTES, src_ipv6),
+    IPFIX_IE_MAP(DESTINATION_IPV6_ADDRESS, DST_IPV6, BYTES, dst_ipv6),
+    IPFIX_IE_MAP(FLOW_LABEL_IPV6, FLOW_LABEL, UINT, flow_label),
+    IPFIX_IE_MAP(SOURCE_TRANSPORT_PORT, SRC_PORT, UINT, src_port),
+    IPFIX_IE_MAP(DESTINATION_TRANSPORT_PORT, DST_PORT, UINT, dst_port),
+    IPFIX_IE_MAP(ICMP_TYPE_IPV6, ICMP_TYPE, UINT, icmp_type),
+    IPFIX_IE_MAP(ICMP_CODE_IPV6, ICMP_CODE, UINT, icmp_code),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_SOURCE_IPV4_ADDRESS, TUN_SRC_IP, BYTES,
+                        tun_src_ip),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_DESTINATION_IPV4_ADDRESS, TUN_DST_IP, BYTES,
+                        tun_dst_ip),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_PROTOCOL_IDENTIFIER, TUN_PROTO, UINT,
+                        tun_proto),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_SOURCE_TRANSPORT_PORT, TUN_SRC_PORT, UINT,
+                        tun_src_port),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_DESTINATION_TRANSPORT_PORT, TUN_DST_PORT,
+                        UINT, tun_dst_port),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_TYPE, TUN_TYPE, UINT, tun_type),
+    IPFIX_VMWARE_IE_MAP(TUNNEL_KEY, TUN_KEY, UINT, tun_key),
+};
+
+/*One field of a template as it appeared on the wire*/
+struct ipfix_field{
+    uint32_t enterprise;        /* 0 for IANA elements. */
+    uint16_t ie_id;             /* Without IPFIX_ENTERPRISE_BIT. */
+    uint16_t length;            /* IPFIX_VARLEN if variable-length. */
+};
+
+/*Decode plan step.  Unsigned integers of the exact wire width get a
+ * dedicated byte-swap op; reduced-size encodings go through
+ * IPFIX_OP_UINT*/
+enum ipfix_op_type {
+    IPFIX_OP_SKIP,
+    IPFIX_OP_COPY,
+    IPFIX_OP_U8,
+    IPFIX_OP_BE16,
+    IPFIX_OP_BE32,
+    IPFIX_OP_BE64,
+    IPFIX_OP_UINT,
+};
+
+struct ipfix_decode_op{
+    uint16_t src_ofs;           /* Offset in the record, fixed layouts only. */
+    uint16_t src_len;           /* Wire length or IPFIX_VARLEN. */
+    uint16_t dst_ofs;           /* Offset in struct ipfix_flow. */
+    uint8_t dst_len;
+    uint8_t type;               /* enum ipfix_op_type. */
+    uint8_t field;              /* enum ipfix_flow_field, if IPFIX_VARLEN. */
+};
+
+/* Decodes a record of one fixed layout into 'flow', which the caller has
+ * cleared, and returns the record's length. */
+typedef size_t ipfix_fast_decode_func(const uint8_t *p,
+                                      struct ipfix_flow *flow);
+
+/* Invokes FIELD(ENTERPRISE, IE, LENGTH, KIND, MEMBER) for each field of
+ * the data template that OVS exports for the given classification, in
+ * the order of ipfix_define_template_fields() in ofproto-dpif-ipfix.c.
+ * KIND and MEMBER say where the field lands in struct ipfix_flow. */
+#define IPFIX_OVS_TEMPLATE_FIELDS(L2, L3, L4, TUNNEL, FIELD)              \
+    do {                                                                \
+        FIELD(0, OBSERVATION_POINT_ID, 4, UINT, obs_point_id);          \
+        FIELD(0, FLOW_DIRECTION, 1, UINT, direction_ingress);           \
+        FIELD(0, SOURCE_MAC_ADDRESS, 6, BYTES, src_mac);                \
+        FIELD(0, DESTINATION_MAC_ADDRESS, 6, BYTES, dst_mac);           \
+        FIELD(0, ETHERNET_TYPE, 2, UINT, eth_type);                     \
+        FIELD(0, ETHERNET_HEADER_LENGTH, 1, UINT, eth_hdlen);           \
+        if ((L2) == IPFIX_PROTO_L2_VLAN) {                              \
+            FIELD(0, VLAN_ID, 2, UINT, vlan_id);                        \
+            FIELD(0, DOT1Q_VLAN_ID, 2, UINT, dot1q_vlan_id);            \
+            FIELD(0, DOT1Q_PRIORITY, 1, UINT, dot1q_priority);          \
+        }                                                               \
+        if ((L3) != IPFIX_PROTO_L3_UNKNOWN) {                           \
+            FIELD(0, IP_VERSION, 1, UINT, ip_ver);                      \
+            FIELD(0, IP_TTL, 1, UINT, ip_ttl);                          \
+            FIELD(0, PROTOCOL_IDENTIFIER, 1, UINT, ip_pro);             \
+            FIELD(0, IP_DIFF_SERV_CODE_POINT, 1, UINT, dscp);           \
+            FIELD(0, IP_PRECEDENCE, 1, UINT, ip_pre);                   \
+            FIELD(0, IP_CLASS_OF_SERVICE, 1, UINT, ip_tos);             \
+        }                                                               \
+        if ((L3) == IPFIX_PROTO_L3_IPV4) {                              \
+            FIELD(0, SOURCE_IPV4_ADDRESS, 4, BYTES, src_ip);            \
+            FIELD(0, DESTINATION_IPV4_ADDRESS, 4, BYTES, dst_ip);       \
+            if ((L4) == IPFIX_PROTO_L4_TCP_UDP_SCTP) {                  \
+                FIELD(0, SOURCE_TRANSPORT_PORT, 2, UINT, src_port);     \
+                FIELD(0, DESTINATION_TRANSPORT_PORT, 2, UINT, dst_port); \
+            } else if ((L4) == IPFIX_PROTO_L4_ICMP) {                   \
+                FIELD(0, ICMP_TYPE_IPV4, 1, UINT, icmp_type);           \
+                FIELD(0, ICMP_CODE_IPV4, 1, UINT, icmp_code);           \
+            }                                                           \
+        } else if ((L3) == IPFIX_PROTO_L3_IPV6) {                       \
+            FIELD(0, SOURCE_IPV6_ADDRESS, 16, BYTES, src_ipv6);         \
+            FIELD(0, DESTINATION_IPV6_ADDRESS, 16, BYTES, dst_ipv6);    \
+            FIELD(0, FLOW_LABEL_IPV6, 4, UINT, flow_label);             \
+            if ((L4) == IPFIX_PROTO_L4_TCP_UDP_SCTP) {                  \
+                FIELD(0, SOURCE_TRANSPORT_PORT, 2, UINT, src_port);     \
+                FIELD(0, DESTINATION_TRANSPORT_PORT, 2, UINT, dst_port); \
+            } else if ((L4) == IPFIX_PROTO_L4_ICMP) {                   \
+                FIELD(0, ICMP_TYPE_IPV6, 1, UINT, icmp_type);           \
+                FIELD(0, ICMP_CODE_IPV6, 1, UINT, icmp_code);           \
+            }                                                           \
+        }                                                               \
+        if ((TUNNEL) == IPFIX_PROTO_TUNNELED) {                         \
+            FIELD(IPFIX_ENTERPRISE_VMWARE, TUNNEL_SOURCE_IPV4_ADDRESS, 4, \
+                  BYTES, tun_src_ip);                                   \
+            FIELD(IPFIX_ENTERPRISE_VMWARE, TUNNEL_DESTINATION_IPV4_ADDRESS, \
+                  4, BYTES, tun_dst_ip);                                \
+            FIELD(IPFIX_ENTERPRISE_VMWARE, TUNNEL_PROTOCOL_IDENTIFIER, 1, \
+                  UINT, tun_proto);                                     \
+            FIELD(IPFIX_ENTERPRISE_VMWARE, TUNNEL_SOURCE_TRANSPORT_PORT, 2, \
+                  UINT, tun_src_port);                                  \
+            FIELD(IPFIX_ENTERPRISE_VMWARE,                              \
+                  TUNNEL_DESTINATION_TRANSPORT_PORT, 2, UINT,           \
+                  tun_dst_port);                                        \
+            FIELD(IPFIX_ENTERPRISE_VMWARE, TUNNEL_TYPE, 1, UINT, tun_type); \
+            FIELD(IPFIX_ENTERPRISE_VMWARE, TUNNEL_KEY, IPFIX_VARLEN, UINT, \
+                  tun_key);                                             \
+        }                                                               \
+        FIELD(0, FLOW_START_DELTA_MICROSECONDS, 4, UINT, start_time);   \
+        FIELD(0, FLOW_END_DELTA_MICROSECONDS, 4, UINT, end_time);       \
+        FIELD(0, PACKET_DELTA_COUNT, 8, UINT, packets);                 \
+        FIELD(0, LAYER2_OCTET_DELTA_COUNT, 8, UINT,                     \
+              l2_octor_delta_count);                                    \
+        FIELD(0, FLOW_END_REASON, 1, UINT, flow_end_reason);            \
+        if ((L3) != IPFIX_PROTO_L3_UNKNOWN) {                           \
+            FIELD(0, OCTET_DELTA_COUNT, 8, UINT, octets);               \
+            FIELD(0, OCTET_DELTA_SUM_OF_SQUARES, 8, UINT, delta_oc_sq); \
+            FIELD(0, MINIMUM_IP_TOTAL_LENGTH, 8, UINT, min_len);        \
+            FIELD(0, MAXIMUM_IP_TOTAL_LENGTH, 8, UINT, max_len);        \
+        }                                                               \
+    } while (0)
+
+/* Upper bound on the number of fields in an OVS data template. */
+#define IPFIX_OVS_MAX_FIELDS 40
+
+/*Layout of one of the data templates that OVS exports*/
+struct ipfix_ovs_layout{
+    struct ipfix_field fields[IPFIX_OVS_MAX_FIELDS];
+    size_t n_fields;            /* 0 if OVS does not use the template ID. */
+    ipfix_fast_decode_func *fast_decode;    /* NULL if variable-length. */
+};
+
+/*Columns that the records of a data set are bulk decoded into, one array
+ * per field, so that later stages can work on whole columns.  Only the
+ * fields that those stages use have a column*/
+enum ipfix_column {
+    IPFIX_COL_OBS_POINT_ID,     /* uint32_t. */
+    IPFIX_COL_START_TIME,       /* uint32_t. */
+    IPFIX_COL_END_TIME,         /* uint32_t. */
+    IPFIX_COL_PACKETS,          /* uint64_t. */
+    IPFIX_COL_L2_OCTETS,        /* uint64_t. */
+    IPFIX_COL_OCTETS,           /* uint64_t. */
+    IPFIX_COL_DELTA_OC_SQ,      /* uint64_t. */
+    IPFIX_COL_SRC_IP,           /* ovs_be32. */
+    IPFIX_COL_DST_IP,           /* ovs_be32. */
+    IPFIX_COL_SRC_MAC,          /* uint8_t[6]. */
+    IPFIX_COL_DST_MAC,          /* uint8_t[6]. */
+    IPFIX_N_COLUMNS
+};
+
+struct ipfix_columns{
+    void *data[IPFIX_N_COLUMNS];
+    size_t n;                   /* Number of rows. */
+    size_t allocated;           /* Capacity of each column, in rows. */
+};
+
+/*How a column is filled from its field*/
+enum ipfix_column_kind {
+    IPFIX_COL_SWAP32,           /* Byte swapped to host order. */
+    IPFIX_COL_SWAP64,
+    IPFIX_COL_COPY32,           /* Kept in network order. */
+    IPFIX_COL_COPY48,
+};
+
+struct ipfix_column_def{
+    enum ipfix_flow_field field;
+    uint8_t width;              /* Bytes per row, on the wire and here. */
+    enum ipfix_column_kind kind;
+};
+
+static const struct ipfix_column_def ipfix_column_defs[IPFIX_N_COLUMNS] = {
+    [IPFIX_COL_OBS_POINT_ID] = { IPFIX_F_OBS_POINT_ID, 4, IPFIX_COL_SWAP32 },
+    [IPFIX_COL_START_TIME] = { IPFIX_F_START_TIME, 4, IPFIX_COL_SWAP32 },
+    [IPFIX_COL_END_TIME] = { IPFIX_F_END_TIME, 4, IPFIX_COL_SWAP32 },
+    [IPFIX_COL_PACKETS] = { IPFIX_F_PACKETS, 8, IPFIX_COL_SWAP64 },
+    [IPFIX_COL_L2_OCTETS] = { IPFIX_F_L2_OCTETS, 8, IPFIX_COL_SWAP64 },
+    [IPFIX_COL_OCTETS] = { IPFIX_F_OCTETS, 8, IPFIX_COL_SWAP64 },
+    [IPFIX_COL_DELTA_OC_SQ] = { IPFIX_F_DELTA_OC_SQ, 8, IPFIX_COL_SWAP64 },
+    [IPFIX_COL_SRC_IP] = { IPFIX_F_SRC_IP, 4, IPFIX_COL_COPY32 },
+    [IPFIX_COL_DST_IP] = { IPFIX_F_DST_IP, 4, IPFIX_COL_COPY32 },
+    [IPFIX_COL_SRC_MAC] = { IPFIX_F_SRC_MAC, 6, IPFIX_COL_COPY48 },
+    [IPFIX_COL_DST_MAC] = { IPFIX_F_DST_MAC, 6, IPFIX_COL_COPY48 },
+};
+
+/*Record filter (--filter).
+ *
+ * A filter matches a record if any of its conjunctions does, and a
+ * conjunction if all of its terms do, each of which tests one field
+ * against a value, a range or a prefix, e.g. "ip_pro=17 and
+ * dst_port=1-1023 or src_ip=10.0.0.0/8".  It is parsed once, then compiled
+ * against each template into a flat program of struct ipfix_filter_op
+ * that tests the record's raw bytes, so that a dropped record is never
+ * decoded*/
+enum ipfix_filter_type {
+    IPFIX_FILTER_UINT,          /* Integer, or range "MIN-MAX". */
+    IPFIX_FILTER_IP,            /* IPv4 or IPv6 address, or CIDR prefix. */
+    IPFIX_FILTER_MAC,           /* Ethernet address. */
+};
+
+struct ipfix_filter_field{
+    const char *name;
+    enum ipfix_filter_type type;
+    enum ipfix_flow_field field;
+    enum ipfix_flow_field field6;   /* For IPv6 addresses. */
+};
+
+static const struct ipfix_filter_field ipfix_filter_fields[] = {
+    { "obs_point_id", IPFIX_FILTER_UINT, IPFIX_F_OBS_POINT_ID, 0 },
+    { "eth_type", IPFIX_FILTER_UINT, IPFIX_F_ETH_TYPE, 0 },
+    { "vlan_id", IPFIX_FILTER_UINT, IPFIX_F_VLAN_ID, 0 },
+    { "ip_pro", IPFIX_FILTER_UINT, IPFIX_F_IP_PRO, 0 },
+    { "src_port", IPFIX_FILTER_UINT, IPFIX_F_SRC_PORT, 0 },
+    { "dst_port", IPFIX_FILTER_UINT, IPFIX_F_DST_PORT, 0 },
+    { "src_ip", IPFIX_FILTER_IP, IPFIX_F_SRC_IP, IPFIX_F_SRC_IPV6 },
+    { "dst_ip", IPFIX_FILTER_IP, IPFIX_F_DST_IP, IPFIX_F_DST_IPV6 },
+    { "src_mac", IPFIX_FILTER_MAC, IPFIX_F_SRC_MAC, 0 },
+    { "dst_mac", IPFIX_FILTER_MAC, IPFIX_F_DST_MAC, 0 },
+};
+
+/*One term of a filter, as parsed*/
+struct ipfix_filter_term{
+    enum ipfix_flow_field field;
+    bool negate;                /* "!=" instead of "=". */
+    bool last;                  /* Last term of its conjunction. */
+    uint8_t len;                /* Address length, 0 for an integer. */
+    uint8_t value[16];          /* Address, with host bits cleared. */
+    uint8_t mask[16];
+    uint64_t min, max;          /* Integer range. */
+};
+
+struct ipfix_filter{
+    struct ipfix_filter_term *terms;
+    size_t n_terms;
+};
+
+/*A filter term compiled against a template.  The ops of a conjunction run
+ * in order until one fails, which skips to the next conjunction, or the
+ * last one passes, which matches the record*/
+struct ipfix_filter_op{
+    uint16_t ofs;               /* Record offset, UINT16_MAX if variable. */
+    uint16_t field_idx;         /* Template field, if 'ofs' is variable. */
+    uint16_t next;              /* First op of the next conjunction. */
+    uint8_t len;                /* Wire length. */
+    bool addr;                  /* Masked compare instead of a range. */
+    bool negate;
+    bool last;
+    uint8_t value[16];
+    uint8_t mask[16];
+    uint64_t min, max;
+};
+
+/*Template scope: one observation domain of one exporter*/
+struct ipfix_template_key{
+    struct in6_addr exporter;   /* IPv4 exporters are IPv4-mapped. */
+    uint32_t obs_domain;
+    ovs_be16 exporter_port;
+    uint16_t template_id;
+};
+
+/*A template compiled into a decode plan*/
+struct ipfix_template{
+    struct hmap_node hmap_node; /* In ipfix_collector's 'templates'. */
+    struct ipfix_template_key key;
+    struct ipfix_field *fields;
+    size_t n_fields;
+    uint16_t record_len;        /* Record length, 0 if variable-length. */
+    uint16_t min_record_len;    /* Counting each variable field as 1. */
+    uint64_t present;           /* Fields that every record provides. */
+    struct ipfix_decode_op *ops;
+    size_t n_ops;
+    ipfix_fast_decode_func *fast_decode;    /* Replaces 'ops' if nonnull. */
+    bool columnar;              /* Fixed, with full-width column fields. */
+    uint16_t col_ofs[IPFIX_N_COLUMNS];  /* Record offset or UINT16_MAX. */
+    struct ipfix_filter_op *filter_ops; /* --filter, compiled. */
+    size_t n_filter_ops;        /* 0 if no record can match. */
+    uint16_t n_scope_fields;    /* Options templates only, otherwise 0. */
+};
+
+/*Information elements of options data records that the collector uses
+ * (RFC 7011 section 4, RFC 5477 section 8, RFC 7012), in the order of
+ * 'ipfix_option_ies'*/
+enum ipfix_option {
+    IPFIX_OPT_OBS_DOMAIN,               /* observationDomainId. */
+    IPFIX_OPT_SAMPLING_INTERVAL,        /* samplingInterval. */
+    IPFIX_OPT_SAMPLER_RANDOM_INTERVAL,  /* samplerRandomInterval. */
+    IPFIX_OPT_PACKET_INTERVAL,          /* samplingPacketInterval. */
+    IPFIX_OPT_PACKET_SPACE,             /* samplingPacketSpace. */
+    IPFIX_OPT_SAMPLING_SIZE,            /* samplingSize. */
+    IPFIX_OPT_SAMPLING_POPULATION,      /* samplingPopulation. */
+    IPFIX_OPT_SAMPLING_PROBABILITY,     /* samplingProbability, float64. */
+    IPFIX_OPT_EXPORTED_OCTETS,          /* exportedOctetTotalCount. */
+    IPFIX_OPT_EXPORTED_MESSAGES,        /* exportedMessageTotalCount. */
+    IPFIX_OPT_EXPORTED_RECORDS,         /* exportedFlowRecordTotalCount. */
+    IPFIX_OPT_IGNORED_PACKETS,          /* ignoredPacketTotalCount. */
+    IPFIX_OPT_IGNORED_OCTETS,           /* ignoredOctetTotalCount. */
+    IPFIX_OPT_NOT_SENT_RECORDS,         /* notSentFlowTotalCount. */
+    IPFIX_OPT_NOT_SENT_PACKETS,         /* notSentPacketTotalCount. */
+    IPFIX_OPT_NOT_SENT_OCTETS,          /* notSentOctetTotalCount. */
+    IPFIX_N_OPTS
+};
+
+static const uint16_t ipfix_option_ies[IPFIX_N_OPTS] = {
+    149, 34, 50, 305, 306, 309, 310, 311, 40, 41, 42, 164, 165, 166, 167, 168
+};
+
+#define IPFIX_OPT_BIT(OPT) (1u << (OPT))
+#define IPFIX_OPT_EXPORTER_STATS                                        \
+    (IPFIX_OPT_BIT(IPFIX_OPT_EXPORTED_OCTETS)                           \
+     | IPFIX_OPT_BIT(IPFIX_OPT_EXPORTED_MESSAGES)                       \
+     | IPFIX_OPT_BIT(IPFIX_OPT_EXPORTED_RECORDS)                        \
+     | IPFIX_OPT_BIT(IPFIX_OPT_IGNORED_PACKETS)                         \
+     | IPFIX_OPT_BIT(IPFIX_OPT_IGNORED_OCTETS)                          \
+     | IPFIX_OPT_BIT(IPFIX_OPT_NOT_SENT_RECORDS)                        \
+     | IPFIX_OPT_BIT(IPFIX_OPT_NOT_SENT_PACKETS)                        \
+     | IPFIX_OPT_BIT(IPFIX_OPT_NOT_SENT_OCTETS))
+
+/*The values of one options data record*/
+struct ipfix_options_rec{
+    uint32_t present;           /* IPFIX_OPT_BIT()s of the values below. */
+    uint64_t values[IPFIX_N_OPTS];  /* Unsigned values. */
+    double probability;         /* IPFIX_OPT_SAMPLING_PROBABILITY. */
+};
+
+/*Binary capture file format (--capture).
+ *
+ * A capture is a pair of files.  FILE holds a header followed by
+ * fixed-width struct ipfix_capture_rec entries, one per data record, in
+ * the writer's byte order.  FILE.idx holds a header followed by one
+ * struct ipfix_capture_block per block of consecutive records, so that a
+ * reader can skip blocks outside a time range or from other exporters.
+ * Records that no block covers are simply scanned.  These are the records
+ * past the last block, and after a crash the records of the block that
+ * was never written, which precede the first block of the next run*/
+#define IPFIX_CAPTURE_MAGIC "OVSIPFXC"
+#define IPFIX_CAPTURE_INDEX_MAGIC "OVSIPFXI"
+#define IPFIX_CAPTURE_VERSION 1
+#define IPFIX_CAPTURE_BYTE_ORDER 0x01020304
+#define IPFIX_CAPTURE_BLOCK_RECORDS 1024
+
+struct ipfix_capture_header{
+    char magic[8];              /* IPFIX_CAPTURE_[INDEX_]MAGIC. */
+    uint32_t version;           /* IPFIX_CAPTURE_VERSION. */
+    uint32_t byte_order;        /* IPFIX_CAPTURE_BYTE_ORDER. */
+    uint32_t entry_size;        /* Size of each record or index entry. */
+    uint8_t pad[44];
+};
+BUILD_ASSERT_DECL(sizeof(struct ipfix_capture_header) == 64);
+
+struct ipfix_capture_rec{
+    struct in6_addr exporter;   /* IPv4 addresses are IPv4-mapped. */
+    struct in6_addr src_ip;     /* All-zeros if not an IP flow. */
+    struct in6_addr dst_ip;
+    uint64_t packets;
+    uint64_t l2_octets;
+    uint64_t octets;
+    uint32_t export_time;       /* Message export time, in seconds. */
+    uint32_t obs_domain;
+    uint32_t seq;               /* Message sequence number. */
+    uint32_t obs_point_id;
+    uint32_t start_time;
+    uint32_t end_time;
+    uint16_t template_id;
+    uint16_t eth_type;
+    uint8_t src_mac[6];
+    uint8_t dst_mac[6];
+    uint8_t ip_ver;
+    uint8_t ip_pro;
+    uint8_t icmp_type;
+    uint8_t icmp_code;
+    uint8_t direction_ingress;
+    uint8_t flow_end_reason;
+    uint8_t pad[2];
+};
+BUILD_ASSERT_DECL(sizeof(struct ipfix_capture_rec) == 120);
+
+struct ipfix_capture_block{
+    uint64_t first;             /* Index of the block's first record. */
+    uint32_t n;                 /* Number of records in the block. */
+    uint32_t min_time;          /* Range of 'export_time' in the block. */
+    uint32_t max_time;
+    uint32_t pad;
+    uint64_t exporters;         /* Bloom filter of 'exporter' values. */
+};
+BUILD_ASSERT_DECL(sizeof(struct ipfix_capture_block) == 32);
+
+/*Capture writer, shared by all workers*/
+struct ipfix_capture{
+    struct ovs_mutex mutex;
+    char *file_name;
+    int fd;
+    int index_fd;
+    uint64_t n_records OVS_GUARDED;
+    struct ipfix_capture_block block OVS_GUARDED;  /* Current block. */
+};
+
+/*HDR-style log-bucketed histogram of latencies or durations.  Values
+ * below IPFIX_HIST_SUB are counted exactly.  Above, each power of 2 is
+ * split into IPFIX_HIST_HALF buckets of equal width, so that a bucket is
+ * never wider than 1/16th of the values it holds and every percentile is
+ * reported within about 6% of the true value.  Adding a value touches one
+ * counter and costs a count-leading-zeros; values of
+ * 2**IPFIX_HIST_MAX_BITS or more land in the last bucket*/
+#define IPFIX_HIST_SUB_BITS 5
+#define IPFIX_HIST_SUB (1 << IPFIX_HIST_SUB_BITS)
+#define IPFIX_HIST_HALF (IPFIX_HIST_SUB / 2)
+#define IPFIX_HIST_MAX_BITS 40
+#define IPFIX_HIST_N_BUCKETS \
+    ((IPFIX_HIST_MAX_BITS - IPFIX_HIST_SUB_BITS + 2) * IPFIX_HIST_HALF)
+
+struct ipfix_hist{
+    uint64_t n;                 /* Number of values. */
+    uint64_t sum;
+    uint64_t min, max;          /* Meaningful only if 'n' is nonzero. */
+    uint64_t counts[IPFIX_HIST_N_BUCKETS];
+};
+
+/*Where the sampling probability of an observation domain comes from*/
+enum ipfix_sampling_source {
+    IPFIX_SAMPLING_NONE,        /* No sampling announced, no --sampling. */
+    IPFIX_SAMPLING_OPTION,      /* --sampling. */
+    IPFIX_SAMPLING_EXPORTER,    /* Options data from the exporter. */
+};
+
+/*Exporting process statistics from the last options data record that
+ * carried any, with what the collector had received from the same scope
+ * by the end of the message that carried it*/
+struct ipfix_exporter_stats{
+    struct ipfix_options_rec rec;   /* Only IPFIX_OPT_EXPORTER_STATS. */
+    bool process_scope;         /* Scope is the exporting process rather
+                                 * than the observation domain. */
+    bool pending;               /* 'rx_*' not yet taken. */
+    unsigned long long int rx_messages;
+    unsigned long long int rx_records;
+    unsigned long long int rx_bytes;
+};
+
+/*Sequence number state of one observation domain of one exporter.
+ *
+ * RFC 7011 section 3.1 defines a message's sequence number as the number
+ * of data records that the domain sent before it, modulo 2**32, so a
+ * message whose number is ahead of 'next_seq' follows a loss, and one
+ * that is behind is a duplicate, a late (reordered) arrival, or the
+ * first message after the exporter restarted.
+ *
+ * The stream also holds the domain's sampling probability and exporter
+ * statistics, which options data records (RFC 7011 section 3.4.2.2)
+ * announce, and the totals estimated from them*/
+struct ipfix_seq_stream{
+    struct hmap_node hmap_node; /* In ipfix_collector's 'streams'. */
+    struct ipfix_template_key key;  /* 'template_id' is always 0. */
+    uint32_t next_seq;          /* Expected sequence number. */
+    uint32_t last_seq;          /* Sequence number of the last message. */
+    bool next_seq_unsure;       /* 'next_seq' misses uncounted records. */
+
+    unsigned long long int n_messages;
+    unsigned long long int n_records;
+    unsigned long long int n_gaps;      /* Messages that followed a loss. */
+    unsigned long long int n_lost;      /* Records missing, net of late. */
+    unsigned long long int n_duplicates;
+    unsigned long long int n_reorders;
+    unsigned long long int n_resets;
+
+    /* Latency, in microseconds, from the message's export time and from
+     * each record's flow end time to the start of the batch that received
+     * the message (see ipfix_latency_export()). */
+    struct ipfix_hist export_latency;
+    struct ipfix_hist record_latency;
+    unsigned long long int n_future;    /* Exported "after" receipt. */
+
+    /* Sampling (see ipfix_sampling_add()).  Records of a sampled domain
+     * add the packets and octets that sampling skipped, by their counts
+     * times 'sampling_skip', to the sampled ones, and variances that
+     * 'sampling_var' scales; unsampled domains only count. */
+    enum ipfix_sampling_source sampling_source;
+    double sampling_p;          /* Probability that a packet was sampled. */
+    double sampling_skip;       /* 1 / sampling_p - 1. */
+    double sampling_var;        /* (1 - sampling_p) / sampling_p**2. */
+    unsigned long long int sampled_packets;
+    unsigned long long int sampled_octets;
+    double unsampled_packets, var_packets;
+    double unsampled_octets, var_octets;
+
+    unsigned long long int n_bytes;     /* Message bytes. */
+    struct ipfix_exporter_stats exporter_stats;
+};
+
+/*Flow aggregation key (--aggregate).  IPv4 addresses are IPv4-mapped;
+ * fields that a record does not carry are zero*/
+struct ipfix_agg_key{
+    struct in6_addr src_ip;
+    struct in6_addr dst_ip;
+    uint8_t src_mac[6];
+    uint8_t dst_mac[6];
+    uint16_t eth_type;
+    uint8_t ip_pro;
+    uint8_t icmp_type;
+    uint8_t icmp_code;
+    uint8_t pad;
+    uint16_t src_port;          /* TCP, UDP or SCTP. */
+    uint16_t dst_port;
+    uint8_t pad2[2];
+};
+BUILD_ASSERT_DECL(sizeof(struct ipfix_agg_key) == 56);
+
+/*Totals for one aggregated flow*/
+struct ipfix_agg_flow{
+    struct ipfix_agg_key key;
+    unsigned long long int n_records;
+    unsigned long long int packets;
+    unsigned long long int l2_octets;
+    unsigned long long int octets;
+    long long int first;        /* Earliest flow start, in ms. */
+    long long int last;         /* Latest flow end, in ms. */
+
+    /* Packets and octets that sampling skipped, estimated from the
+     * sampling probability of each record's observation domain, with the
+     * variances of 'packets' and 'octets' plus them. */
+    unsigned long long int n_sampled;   /* Records sampled with p < 1. */
+    double unsampled_packets, var_packets;
+    double unsampled_octets, var_octets;
+};
+
+/*Open-addressing flow table with linear probing.  Probes scan 'slots',
+ * a dense array with 8 slots per cache line, and touch 'flows' only on a
+ * hash match.  'flows' is filled in insertion order, so the load factor
+ * costs 8 bytes per spare slot rather than a whole flow.  The table never
+ * grows: once it holds 'max' flows, records of new flows are counted in
+ * 'n_dropped' instead*/
+struct ipfix_agg_slot{
+    uint32_t hash;              /* 0 means that the slot is empty. */
+    uint32_t idx;               /* Index in 'flows'. */
+};
+
+struct ipfix_agg_table{
+    struct ipfix_agg_slot *slots;
+    size_t mask;                /* Number of slots minus 1. */
+    struct ipfix_agg_flow *flows;
+    size_t n;                   /* Number of flows. */
+    size_t max;                 /* Maximum number of flows. */
+    unsigned long long int n_dropped;
+};
+
+/*Heavy hitters (--top-k).
+ *
+ * Each observation domain gets, per dimension (source IP, destination IP
+ * and MAC pair), a count-min sketch whose cells count packets and L2
+ * octets, and per metric a space-saving summary of the heaviest keys.
+ * The sketch turns the summary's eviction rule into "replace the lightest
+ * tracked key only if the sketch says the new key is heavier", which
+ * keeps one-off keys from churning the summary, and it gives a newly
+ * tracked key its estimated history instead of the evicted count.  All
+ * memory is allocated at startup*/
+#define IPFIX_HH_DEPTH 4
+#define IPFIX_HH_WIDTH 1024     /* Must be a power of 2. */
+
+enum ipfix_hh_dim {
+    IPFIX_HH_SRC_IP,
+    IPFIX_HH_DST_IP,
+    IPFIX_HH_MAC_PAIR,
+    IPFIX_HH_N_DIMS
+};
+
+enum ipfix_hh_metric {
+    IPFIX_HH_PACKETS,
+    IPFIX_HH_OCTETS,            /* L2 octets. */
+    IPFIX_HH_N_METRICS
+};
+
+/*An IPv4-mapped or IPv6 address, or source and destination MACs*/
+struct ipfix_hh_key{
+    uint8_t b[16];
+};
+
+/*A key tracked by a space-saving summary.  Its true count is between
+ * 'count - error' and 'count'*/
+struct ipfix_hh_entry{
+    struct hmap_node hmap_node; /* In ipfix_hh_topk's 'index'. */
+    struct ipfix_hh_key key;
+    uint64_t count;
+    uint64_t error;
+    uint32_t heap_idx;          /* Position in ipfix_hh_topk's 'heap'. */
+};
+
+/*Space-saving summary of one metric*/
+struct ipfix_hh_topk{
+    struct ipfix_hh_entry *entries;     /* 'capacity' entries. */
+    struct ipfix_hh_entry **heap;       /* Min-heap on 'count'. */
+    struct hmap index;          /* Contains the used 'entries'. */
+    size_t n, capacity;
+};
+
+/*Heavy hitter state of one observation domain*/
+struct ipfix_hh_domain{
+    uint32_t obs_domain;
+    uint64_t (*sketch)[IPFIX_HH_DEPTH][IPFIX_HH_WIDTH][IPFIX_HH_N_METRICS];
+    struct ipfix_hh_topk topk[IPFIX_HH_N_DIMS][IPFIX_HH_N_METRICS];
+};
+
+/*Heavy hitter state of a collector*/
+struct ipfix_hh{
+    struct ipfix_hh_domain *domains;
+    size_t n_domains, max_domains;
+    struct ipfix_hh_domain *last_domain;    /* Last lookup hit, or NULL. */
+    unsigned long long int n_untracked;     /* Records of other domains. */
+};
+
+/*Biflow stitching (--biflow, RFC 5103).
+ *
+ * Records of the two directions of a conversation share a key whose
+ * endpoints are in a canonical order, lower address (then port) first, so
+ * that both land in one entry, each on the side of its direction.  ICMP
+ * queries key on the request type, so that an echo reply joins its
+ * request.  An entry lives for the stitching window from its first record
+ * and is then printed as one biflow record.  Entries are allocated in a
+ * ring in creation order, which with a fixed window is also expiration
+ * order, so expiring is popping the oldest entries and the table never
+ * needs a sweep; a full table makes room by expiring its oldest entry
+ * early*/
+struct ipfix_biflow_key{
+    struct in6_addr ip[2];      /* IPv4-mapped.  ip[0] is the lower. */
+    uint16_t port[2];           /* TCP, UDP or SCTP. */
+    uint8_t ip_pro;
+    uint8_t icmp_type;          /* Request type of an ICMP query. */
+    uint8_t pad[2];
+};
+BUILD_ASSERT_DECL(sizeof(struct ipfix_biflow_key) == 40);
+
+/*One direction of a biflow, from ip[N] to ip[1 - N]*/
+struct ipfix_biflow_side{
+    struct ipfix_template_key exporter; /* Of the first record. */
+    unsigned long long int n_records;   /* 0 if not seen. */
+    unsigned long long int packets;
+    unsigned long long int octets;
+    long long int first;        /* Earliest flow start, in ms. */
+    long long int last;         /* Latest flow end, in ms. */
+    bool request;               /* Carried an ICMP query request. */
+};
+
+struct ipfix_biflow{
+    struct hmap_node hmap_node; /* In ipfix_biflow_table's 'index'. */
+    struct ipfix_biflow_key key;
+    long long int deadline;     /* Wall clock ms at which it expires. */
+    struct ipfix_biflow_side sides[2];
+};
+
+struct ipfix_biflow_table{
+    struct ipfix_biflow *entries;   /* Ring of 'max' entries. */
+    size_t head;                /* Index of the oldest entry. */
+    size_t n, max;
+    struct hmap index;          /* Contains the 'n' entries. */
+    long long int window;       /* Stitching window, in ms. */
+
+    unsigned long long int n_records;   /* Records stitched. */
+    unsigned long long int n_skipped;   /* Records without IP addresses. */
+    unsigned long long int n_biflows;   /* Expired with both directions. */
+    unsigned long long int n_uniflows;  /* Expired with one direction. */
+    unsigned long long int n_early;     /* Expired early for room. */
+    unsigned long long int n_asymmetric;    /* Directions seen by different
+                                             * exporters or domains. */
+};
+
+/* Estimated totals are reported as +/- IPFIX_Z95 standard deviations, the
+ * bounds of a 95% confidence interval under a normal approximation. */
+#define IPFIX_Z95 1.96
+
+/* A message that is at most this many records behind 'next_seq' is taken
+ * as reordered or duplicated; further behind, as an exporter restart. */
+#define IPFIX_SEQ_REORDER_WINDOW 65536
+
+/*Hot-path counters.  COUNTER(ENUM, NAME) defines IPFIX_CTR_<ENUM>, shown
+ * by ipfix/show as NAME*/
+#define IPFIX_COUNTERS(COUNTER)                                         \
+    COUNTER(MESSAGES, "messages")                                       \
+    COUNTER(BYTES, "message bytes")                                     \
+    COUNTER(RECORDS, "data records")                                    \
+    COUNTER(OPTIONS_RECORDS, "options data records")                    \
+    COUNTER(FILTERED, "filtered data records")                          \
+    COUNTER(TEMPLATE_SETS, "template sets")                             \
+    COUNTER(TEMPLATES, "templates")                                     \
+    COUNTER(WITHDRAWALS, "template withdrawals")                        \
+    COUNTER(TRUNCATED, "truncated datagrams")                           \
+    COUNTER(SHORT_HEADER, "short message headers")                      \
+    COUNTER(BAD_LENGTH, "bad message lengths")                          \
+    COUNTER(EMPTY_MESSAGE, "empty messages")                            \
+    COUNTER(SHORT_SET_HEADER, "short set headers")                      \
+    COUNTER(BAD_SET_LENGTH, "bad set lengths")                          \
+    COUNTER(BAD_TEMPLATE_ID, "bad template IDs")                        \
+    COUNTER(BAD_TEMPLATE, "bad template records")                       \
+    COUNTER(BAD_RECORD, "bad data records")                             \
+    COUNTER(UNKNOWN_SET, "data sets without template")                  \
+    COUNTER(SKIPPED_SET, "skipped sets")
+
+enum ipfix_counter {
+#define IPFIX_COUNTER_ENUM(ENUM, NAME) IPFIX_CTR_##ENUM,
+    IPFIX_COUNTERS(IPFIX_COUNTER_ENUM)
+#undef IPFIX_COUNTER_ENUM
+    IPFIX_N_COUNTERS,
+
+    /* Data records per set ID: one counter per OVS template ID, then one
+     * for all other IDs. */
+    IPFIX_CTR_SET_RECORDS = IPFIX_N_COUNTERS,
+    IPFIX_N_COUNTER_SLOTS = (IPFIX_CTR_SET_RECORDS
+                             + IPFIX_N_OVS_TEMPLATE_IDS + 1)
+};
+
+/*One thread's counters.  Only the thread that owns them writes them, with
+ * relaxed loads and stores that compile to plain moves, and readers sum
+ * every thread's copy, so increments never contend or take a lock.  The
+ * copies are allocated and padded on cache line boundaries, so that no
+ * two threads write to the same line*/
+struct ipfix_counters{
+    PADDED_MEMBERS(CACHE_LINE_SIZE,
+        atomic_ullong values[IPFIX_N_COUNTER_SLOTS];
+    );
+};
+
+/*Collector state*/
+struct ipfix_collector{
+    struct hmap templates;      /* Contains "struct ipfix_template"s. */
+    struct ipfix_template *last_template;   /* Last lookup hit, or NULL. */
+    struct hmap streams;        /* Contains "struct ipfix_seq_stream"s. */
+    struct ipfix_seq_stream *last_stream;   /* Last lookup hit, or NULL. */
+    struct ipfix_agg_table *agg;    /* Flow table, NULL if disabled. */
+    struct ipfix_hh *hh;        /* Heavy hitters, NULL if disabled. */
+    struct ipfix_biflow_table *biflow;  /* NULL if disabled. */
+    struct ds out;              /* Output not yet written to stdout. */
+    struct ipfix_out_ring *out_ring;    /* To the writer thread, or NULL. */
+    long long int out_deadline; /* When to write 'out', 0 if empty. */
+    struct ipfix_capture_rec *capture;  /* Records not yet captured. */
+    size_t n_capture, allocated_capture;
+    struct ipfix_columns cols;  /* Last bulk decoded data set. */
+    uint8_t *filtered;          /* Records of a set that match --filter. */
+    size_t filtered_size;
+    long long int rx_usec;      /* Wall clock time the batch arrived. */
+    struct ipfix_counters *counters;    /* Written only by the owner. */
+};
+
+/* Adds 'n' to 'counter', which only the calling thread writes. */
+static inline void
+ipfix_counter_add(atomic_ullong *counter, unsigned long long int n)
+{
+    unsigned long long int value;
+
+    atomic_read_relaxed(counter, &value);
+    atomic_store_relaxed(counter, value + n);
+}
+
+/* Returns the value of 'counter', from any thread. */
+static unsigned long long int
+ipfix_counter_get(atomic_ullong *counter)
+{
+    unsigned long long int value;
+
+    atomic_read_relaxed(counter, &value);
+    return value;
+}
+
+/* Adds 'n' to counter 'idx' of 'c'.  Must be called by the thread that
+ * owns 'c'. */
+static inline void
+ipfix_count(struct ipfix_collector *c, size_t idx, unsigned long long int n)
+{
+    ipfix_counter_add(&c->counters->values[idx], n);
+}
+
+/* Returns the value of counter 'idx' of 'counters', from any thread. */
+static unsigned long long int
+ipfix_counter_read(const struct ipfix_counters *counters, size_t idx)
+{
+    unsigned long long int value;
+
+    atomic_read_relaxed(&CONST_CAST(struct ipfix_counters *, counters)
+                        ->values[idx], &value);
+    return value;
+}
+
+/*Layouts of the data templates OVS exports, indexed by template ID minus
+ * IPFIX_SET_ID_DATA_MIN, and the same compiled.  A data set with one of
+ * these IDs is decoded with the builtin template when no template has been
+ * received from the exporter yet; test-ipfix-gen exports them*/
+static struct ipfix_ovs_layout ipfix_ovs_layouts[IPFIX_N_OVS_TEMPLATE_IDS];
+static struct ipfix_template *ipfix_builtins[IPFIX_N_OVS_TEMPLATE_IDS];
+
+/* Whether templates that match a fixed OVS layout are decoded through its
+ * specialized decoder.  test-ipfix-bench turns it off to measure the
+ * generic decoder. */
+static bool ipfix_fast_path = true;
+
+
+/* Output formatting.
+ *
+ * Records are rendered straight into the collector's output buffer by the
+ * emitters below instead of through printf-style formatting.  A caller
+ * reserves room for a whole line with out_begin(), advances a cursor with
+ * the emitters, and commits the line with out_end().  Each emitter
+ * returns the new end of the output. */
+
+/* Upper bound on the length of any line printed for a record. */
+#define IPFIX_MAX_LINE 512
+
+static inline char *
+out_begin(struct ds *s)
+{
+    ds_reserve(s, s->length + IPFIX_MAX_LINE);
+    return s->string + s->length;
+}
+
+static inline void
+out_end(struct ds *s, char *p)
+{
+    s->length = p - s->string;
+    s->string[s->length] = '\0';
+}
+
+static inline char *
+emit_buf(char *p, const char *s, size_t n)
+{
+    memcpy(p, s, n);
+    return p + n;
+}
+
+#define EMIT_LITERAL(P, S) emit_buf(P, S, sizeof S - 1)
+
+/* Same as printf("%"PRIu64, x). */
+static inline char *
+emit_u64(char *p, uint64_t x)
+{
+    char tmp[20];
+    size_t n = 0;
+
+    do {
+        tmp[sizeof tmp - ++n] = '0' + x % 10;
+        x /= 10;
+    } while (x);
+    return emit_buf(p, &tmp[sizeof tmp - n], n);
+}
+
+/* Same as printf("%x", x). */
+static inline char *
+emit_hex8(char *p, uint8_t x)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    if (x >= 16) {
+        *p++ = digits[x >> 4];
+    }
+    *p++ = digits[x & 15];
+    return p;
+}
+
+static char *
+print_address(char *out, const void *rec, ovs_be8 add_type){
+    const ovs_be8 *p = rec;
+
+    switch (add_type){
+        case 0:{
+            out = EMIT_LITERAL(out, "src mac ");
+            for (int i=0; i<6; ++i)
+                out = emit_hex8(out, *p++);
+            out = EMIT_LITERAL(out, ", ");
+
+            out = EMIT_LITERAL(out, "dst mac ");
+            for (int j=0; j<6; ++j)
+                out = emit_hex8(out, *p++);
+            out = EMIT_LITERAL(out, ", ");
+
+            break;
+        }
+
+        case 4:{
+            out = EMIT_LITERAL(out, "src ip ");
+            out = emit_u64(out, *p++);
+            for (int i=0; i<3;i++) {
+                *out++ = '.';
+                out = emit_u64(out, *p++);
+            }
+            out = EMIT_LITERAL(out, ", ");
+
+            out = EMIT_LITERAL(out, "dst ip ");
+            out = emit_u64(out, *p++);
+            for (int i=0; i<3;i++) {
+                *out++ = '.';
+                out = emit_u64(out, *p++);
+            }
+
+            break;
+        }
+
+        case 6:{
+            out = EMIT_LITERAL(out, "src ip ");
+            inet_ntop(AF_INET6, p, out, INET6_ADDRSTRLEN);
+            out += strlen(out);
+            out = EMIT_LITERAL(out, ", ");
+
+            out = EMIT_LITERAL(out, "dst ip ");
+            inet_ntop(AF_INET6, p + 16, out, INET6_ADDRSTRLEN);
+            out += strlen(out);
+
+            break;
+        }
+
+        default:
+            break;
+    }
+    return out;
+}
+
+
+static void
+print_flow(struct ds *s, const struct ipfix_flow *flow){
+    uint64_t ip_bits = (IPFIX_F_BIT(IPFIX_F_SRC_IP)
+                        | IPFIX_F_BIT(IPFIX_F_SRC_IPV6));
+    char *p = out_begin(s);
+
+    p = EMIT_LITERAL(p, "set record: observation_point_id ");
+    p = emit_u64(p, flow->obs_point_id);
+    p = EMIT_LITERAL(p, ", packets ");
+    p = emit_u64(p, flow->packets);
+    p = EMIT_LITERAL(p, ", ");
+
+    if (flow->present & IPFIX_F_BIT(IPFIX_F_SRC_MAC)) {
+        p = print_address(p, flow->src_mac,ADDRESS_MAC);
+    }
+
+    if (flow->present & IPFIX_F_BIT(IPFIX_F_VLAN_ID)) {
+        p = EMIT_LITERAL(p, "vlan ");
+        p = emit_u64(p, flow->vlan_id);
+        p = EMIT_LITERAL(p, ", ");
+    }
+
+    if (flow->present & ip_bits) {
+        p = EMIT_LITERAL(p, "IPVersion ");
+        p = emit_u64(p, flow->ip_ver);
+        p = EMIT_LITERAL(p, ", Protocol ");
+        p = emit_u64(p, flow->ip_pro);
+        p = EMIT_LITERAL(p, ", ");
+
+        if (flow->present & IPFIX_F_BIT(IPFIX_F_SRC_IP)) {
+            p = print_address(p, flow->src_ip,ADDRESS_IPV4);
+        } else {
+            p = print_address(p, flow->src_ipv6,ADDRESS_IPV6);
+        }
+
+        if (flow->present & IPFIX_F_BIT(IPFIX_F_SRC_PORT)) {
+            p = EMIT_LITERAL(p, ", src port ");
+            p = emit_u64(p, flow->src_port);
+            p = EMIT_LITERAL(p, ", dst port ");
+            p = emit_u64(p, flow->dst_port);
+        }
+    }
+
+    if (flow->present & IPFIX_F_BIT(IPFIX_F_TUN_SRC_IP)) {
+        if (flow->present & ip_bits) {
+            p = EMIT_LITERAL(p, ", ");
+        }
+        p = EMIT_LITERAL(p, "tunnel ");
+        p = print_address(p, flow->tun_src_ip,ADDRESS_IPV4);
+        p = EMIT_LITERAL(p, ", tunnel type ");
+        p = emit_u64(p, flow->tun_type);
+        if (flow->present & IPFIX_F_BIT(IPFIX_F_TUN_KEY)) {
+            p = EMIT_LITERAL(p, ", tunnel key ");
+            p = emit_u64(p, flow->tun_key);
+        }
+    }
+
+    *p++ = '\n';
+    out_end(s, p);
+}
+
+static const struct ipfix_ie_map *
+ipfix_ie_map_find(uint32_t enterprise, uint16_t ie_id)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(ipfix_ie_maps); i++) {
+        const struct ipfix_ie_map *m = &ipfix_ie_maps[i];
+        if (m->enterprise == enterprise && m->ie_id == ie_id) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/* Picks the op that moves a 'len'-byte wire field into 'm'.  A
+ * variable-length integer gets IPFIX_OP_UINT, and the decoder checks each
+ * record's length against the member. */
+static enum ipfix_op_type
+ipfix_op_for(const struct ipfix_ie_map *m, uint16_t len)
+{
+    if (!m || !len) {
+        return IPFIX_OP_SKIP;
+    }
+    if (len == IPFIX_VARLEN) {
+        return m->kind == IPFIX_KIND_UINT ? IPFIX_OP_UINT : IPFIX_OP_SKIP;
+    }
+    if (m->kind == IPFIX_KIND_BYTES) {
+        return len == m->dst_len ? IPFIX_OP_COPY : IPFIX_OP_SKIP;
+    }
+    if (len > m->dst_len) {
+        return IPFIX_OP_SKIP;
+    } else if (len < m->dst_len) {
+        return IPFIX_OP_UINT;
+    }
+    switch (len) {
+    case 1: return IPFIX_OP_U8;
+    case 2: return IPFIX_OP_BE16;
+    case 4: return IPFIX_OP_BE32;
+    case 8: return IPFIX_OP_BE64;
+    default: return IPFIX_OP_UINT;
+    }
+}
+
+/* Returns the specialized decoder for the fixed layout 'fields', if it is
+ * one that OVS exports, whatever template ID it arrived under. */
+static ipfix_fast_decode_func *
+ipfix_fast_decoder_find(const struct ipfix_field *fields, size_t n_fields)
+{
+    for (size_t i = 0; i < IPFIX_N_OVS_TEMPLATE_IDS; i++) {
+        const struct ipfix_ovs_layout *l = &ipfix_ovs_layouts[i];
+
+        if (l->fast_decode && l->n_fields == n_fields
+            && !memcmp(l->fields, fields, n_fields * sizeof *fields)) {
+            return l->fast_decode;
+        }
+    }
+    return NULL;
+}
+
+/* Returns the offset of field 'idx' of 't' in the record at 'p', which has
+ * at most 'len' bytes, or SIZE_MAX if the record is truncated before it.
+ * The offset of field 't->n_fields' is the record's length.  The offset of
+ * a variable-length field is that of its value, past its length. */
+static size_t
+ipfix_field_offset(const struct ipfix_template *t, const uint8_t *p,
+                   size_t len, size_t idx)
+{
+    size_t ofs = 0;
+
+    if (t->record_len) {
+        for (size_t i = 0; i < idx; i++) {
+            ofs += t->fields[i].length;
+        }
+        return ofs <= len ? ofs : SIZE_MAX;
+    }
+    for (size_t i = 0; i <= idx; i++) {
+        size_t field_len = i < t->n_fields ? t->fields[i].length : 0;
+
+        if (field_len == IPFIX_VARLEN) {
+            if (ofs >= len) {
+                return SIZE_MAX;
+            }
+            field_len = p[ofs++];
+            if (field_len == 255) {
+                if (len - ofs < 2) {
+                    return SIZE_MAX;
+                }
+                field_len = (p[ofs] << 8) | p[ofs + 1];
+                ofs += 2;
+            }
+        }
+        if (i == idx) {
+            break;
+        } else if (len - ofs < field_len) {
+            return SIZE_MAX;
+        }
+        ofs += field_len;
+    }
+    return ofs;
+}
+
+/* Returns the length of the record of 't' at 'p', which has at most 'len'
+ * bytes, or 0 if it is truncated. */
+static size_t
+ipfix_record_length(const struct ipfix_template *t, const uint8_t *p,
+                    size_t len)
+{
+    if (t->record_len) {
+        return len >= t->record_len ? t->record_len : 0;
+    } else {
+        size_t ofs = ipfix_field_offset(t, p, len, t->n_fields);
+        return ofs != SIZE_MAX ? ofs : 0;
+    }
+}
+
+static void
+ipfix_filter_destroy(struct ipfix_filter *f)
+{
+    if (f) {
+        free(f->terms);
+        free(f);
+    }
+}
+
+static char * OVS_WARN_UNUSED_RESULT
+ipfix_filter_parse_value(const struct ipfix_filter_field *ff, char *value,
+                         struct ipfix_filter_term *term)
+{
+    const struct ipfix_ie_map *m;
+    unsigned int plen;
+    long long int min, max;
+    uint64_t limit;
+    char *dash;
+    char *error;
+    bool ok;
+
+    switch (ff->type) {
+    case IPFIX_FILTER_UINT:
+        m = NULL;
+        for (size_t i = 0; i < ARRAY_SIZE(ipfix_ie_maps) && !m; i++) {
+            if (ipfix_ie_maps[i].field == ff->field) {
+                m = &ipfix_ie_maps[i];
+            }
+        }
+        limit = UINT64_MAX >> (64 - 8 * m->dst_len);
+        dash = strchr(value, '-');
+        if (dash) {
+            *dash = '\0';
+        }
+        ok = str_to_llong(value, 0, &min);
+        max = min;
+        if (dash) {
+            ok = ok && str_to_llong(dash + 1, 0, &max);
+            *dash = '-';
+        }
+        if (!ok || min < 0 || min > max || max > limit) {
+            return xasprintf("%s: bad value or range for %s (at most "
+                             "%"PRIu64")", value, ff->name, limit);
+        }
+        term->field = ff->field;
+        term->min = min;
+        term->max = max;
+        return NULL;
+
+    case IPFIX_FILTER_IP:
+        if (strchr(value, ':')) {
+            struct in6_addr ip6;
+
+            error = ipv6_parse_cidr(value, &ip6, &plen);
+            if (error) {
+                return error;
+            }
+            term->field = ff->field6;
+            term->len = 16;
+            memcpy(term->value, &ip6, 16);
+        } else {
+            ovs_be32 ip;
+
+            error = ip_parse_cidr(value, &ip, &plen);
+            if (error) {
+                return error;
+            }
+            term->field = ff->field;
+            term->len = 4;
+            memcpy(term->value, &ip, 4);
+        }
+        for (size_t i = 0; i < term->len; i++) {
+            unsigned int bits = MIN(plen, 8);
+
+            term->mask[i] = bits ? 0xff << (8 - bits) : 0;
+            term->value[i] &= term->mask[i];
+            plen -= bits;
+        }
+        return NULL;
+
+    case IPFIX_FILTER_MAC: {
+        struct eth_addr mac;
+
+        if (!eth_addr_from_string(value, &mac)) {
+            return xasprintf("%s: bad Ethernet address", value);
+        }
+        term->field = ff->field;
+        term->len = 6;
+        memcpy(term->value, mac.ea, 6);
+        memset(term->mask, 0xff, 6);
+        return NULL;
+    }
+    }
+    OVS_NOT_REACHED();
+}
+
+/* Parses 'token', of the form FIELD=VALUE or FIELD!=VALUE, into 'term'. */
+static char * OVS_WARN_UNUSED_RESULT
+ipfix_filter_parse_term(char *token, struct ipfix_filter_term *term)
+{
+    size_t name_len = strcspn(token, "!=");
+    char *value;
+
+    memset(term, 0, sizeof *term);
+    if (token[name_len] == '=') {
+        value = &token[name_len + 1];
+    } else if (token[name_len] == '!' && token[name_len + 1] == '=') {
+        term->negate = true;
+        value = &token[name_len + 2];
+    } else {
+        return xasprintf("%s: expected FIELD=VALUE or FIELD!=VALUE", token);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(ipfix_filter_fields); i++) {
+        const struct ipfix_filter_field *ff = &ipfix_filter_fields[i];
+
+        if (strlen(ff->name) == name_len
+            && !strncmp(ff->name, token, name_len)) {
+            return ipfix_filter_parse_value(ff, value, term);
+        }
+    }
+    return xasprintf("%.*s: unknown field", (int) name_len, token);
+}
+
+/* Parses 's' as a --filter expression, terms joined by "and" and "or",
+ * where "and" binds tighter.  Returns NULL and stores the filter in
+ * '*filterp' if successful, otherwise a malloc()'d error message. */
+static char * OVS_WARN_UNUSED_RESULT
+ipfix_filter_parse(const char *s, struct ipfix_filter **filterp)
+{
+    struct ipfix_filter *f = xzalloc(sizeof *f);
+    char *copy = xstrdup(s);
+    char *save_ptr = NULL;
+    size_t allocated = 0;
+    bool need_term = true;
+    char *error = NULL;
+
+    for (char *token = strtok_r(copy, " \t", &save_ptr); token && !error;
+         token = strtok_r(NULL, " \t", &save_ptr)) {
+        bool is_and = !strcmp(token, "and");
+        bool is_or = !strcmp(token, "or");
+
+        if (need_term && (is_and || is_or)) {
+            error = xasprintf("\"%s\" must follow a term", token);
+        } else if (is_and || is_or) {
+            f->terms[f->n_terms - 1].last = is_or;
+            need_term = true;
+        } else if (!need_term) {
+            error = xasprintf("%s: \"and\" or \"or\" must separate terms",
+                              token);
+        } else {
+            if (f->n_terms >= allocated) {
+                f->terms = x2nrealloc(f->terms, &allocated,
+                                      sizeof *f->terms);
+            }
+            error = ipfix_filter_parse_term(token, &f->terms[f->n_terms++]);
+            need_term = false;
+        }
+    }
+    if (!error && need_term) {
+        error = xstrdup("expression must end with a term");
+    }
+    free(copy);
+
+    if (error) {
+        ipfix_filter_destroy(f);
+        return error;
+    }
+    f->terms[f->n_terms - 1].last = true;
+    *filterp = f;
+    return NULL;
+}
+
+/* Compiles 'term' against the template with 'n_fields' 'fields' into
+ * 'op'.  Returns false if the template has no field that 'term' can test,
+ * because it lacks the field or encodes it at another length or with a
+ * variable length. */
+static bool
+ipfix_filter_compile_term(const struct ipfix_filter_term *term,
+                          const struct ipfix_field *fields, size_t n_fields,
+                          struct ipfix_filter_op *op)
+{
+    size_t ofs = 0;
+
+    for (size_t i = 0; i < n_fields; i++) {
+        const struct ipfix_field *f = &fields[i];
+        const struct ipfix_ie_map *m = ipfix_ie_map_find(f->enterprise,
+                                                         f->ie_id);
+
+        if (m && m->field == term->field) {
+            if (f->length == IPFIX_VARLEN
+                || (term->len
+                    ? f->length != term->len
+                    : !f->length || f->length > m->dst_len)) {
+                return false;
+            }
+            memset(op, 0, sizeof *op);
+            op->ofs = MIN(ofs, UINT16_MAX);
+            op->field_idx = i;
+            op->len = f->length;
+            op->addr = term->len != 0;
+            op->negate = term->negate;
+            op->last = term->last;
+            memcpy(op->value, term->value, sizeof op->value);
+            memcpy(op->mask, term->mask, sizeof op->mask);
+            op->min = term->min;
+            op->max = term->max;
+            return true;
+        }
+        ofs = (f->length == IPFIX_VARLEN ? UINT16_MAX
+               : MIN(ofs + f->length, UINT16_MAX));
+    }
+    return false;
+}
+
+/* Returns true if one of the 'n_fields' 'fields' of a template decodes
+ * into 'field'. */
+static bool
+ipfix_fields_have(const struct ipfix_field *fields, size_t n_fields,
+                  enum ipfix_flow_field field)
+{
+    for (size_t i = 0; i < n_fields; i++) {
+        const struct ipfix_ie_map *m = ipfix_ie_map_find(fields[i].enterprise,
+                                                         fields[i].ie_id);
+
+        if (m && m->field == field) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Compiles 'f' against the template with 'n_fields' 'fields'.  Stores the
+ * program in '*opsp' and returns its number of ops.
+ *
+ * A FIELD!=VALUE term on a field that the template lacks holds for every
+ * record, so it compiles to nothing, and a conjunction of only such terms
+ * to a single op that always passes.  A conjunction with any other term
+ * that the template cannot test compiles to nothing, so that a template
+ * may end up with no ops at all, which drops every record. */
+static size_t
+ipfix_filter_compile(const struct ipfix_filter *f,
+                     const struct ipfix_field *fields, size_t n_fields,
+                     struct ipfix_filter_op **opsp)
+{
+    struct ipfix_filter_op *ops = xmalloc(f->n_terms * sizeof *ops);
+    size_t n_ops = 0, start = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i < f->n_terms; i++) {
+        const struct ipfix_filter_term *term = &f->terms[i];
+
+        if (!ok) {
+            /* The conjunction is already unsatisfiable. */
+        } else if (ipfix_filter_compile_term(term, fields, n_fields,
+                                             &ops[n_ops])) {
+            n_ops++;
+        } else if (!term->negate
+                   || ipfix_fields_have(fields, n_fields, term->field)) {
+            ok = false;
+        }
+        if (term->last) {
+            if (!ok) {
+                n_ops = start;
+            } else if (n_ops == start) {
+                /* An empty range always holds. */
+                memset(&ops[n_ops], 0, sizeof ops[n_ops]);
+                ops[n_ops++].max = UINT64_MAX;
+            }
+            if (n_ops > start) {
+                ops[n_ops - 1].last = true;
+            }
+            for (size_t j = start; j < n_ops; j++) {
+                ops[j].next = n_ops;
+            }
+            start = n_ops;
+            ok = true;
+        }
+    }
+    *opsp = ops;
+    return n_ops;
+}
+
+/* Returns true if the record of 'len' bytes at 'p', of template 't',
+ * matches --filter. */
+static bool
+ipfix_filter_match(const struct ipfix_template *t, const uint8_t *p,
+                   size_t len)
+{
+    size_t i = 0;
+
+    while (i < t->n_filter_ops) {
+        const struct ipfix_filter_op *op = &t->filter_ops[i];
+        size_t ofs = op->ofs;
+        bool pass;
+
+        if (OVS_UNLIKELY(ofs == UINT16_MAX)) {
+            ofs = ipfix_field_offset(t, p, len, op->field_idx);
+        }
+        if (OVS_UNLIKELY(ofs > len || len - ofs < op->len)) {
+            pass = false;
+        } else if (op->addr) {
+            const uint8_t *field = p + ofs;
+            size_t j = 0;
+
+            while (j < op->len && (field[j] & op->mask[j]) == op->value[j]) {
+                j++;
+            }
+            pass = (j == op->len) != op->negate;
+        } else {
+            const uint8_t *field = p + ofs;
+            uint64_t value = 0;
+
+            for (size_t j = 0; j < op->len; j++) {
+                value = (value << 8) | field[j];
+            }
+            pass = (value >= op->min && value <= op->max) != op->negate;
+        }
+
+        if (!pass) {
+            i = op->next;
+        } else if (op->last) {
+            return true;
+        } else {
+            i++;
+        }
+    }
+    return false;
+}
+
+/* Decides whether the records of 't' can be bulk decoded into columns,
+ * which takes a fixed layout whose column fields have the column's width,
+ * and where. */
+static void
+ipfix_template_plan_columns(struct ipfix_template *t)
+{
+    for (size_t i = 0; i < IPFIX_N_COLUMNS; i++) {
+        t->col_ofs[i] = UINT16_MAX;
+    }
+    t->columnar = t->record_len != 0;
+    for (size_t i = 0; t->columnar && i < t->n_ops; i++) {
+        const struct ipfix_decode_op *op = &t->ops[i];
+
+        if (op->type == IPFIX_OP_SKIP) {
+            continue;
+        }
+        for (size_t j = 0; j < IPFIX_N_COLUMNS; j++) {
+            const struct ipfix_column_def *def = &ipfix_column_defs[j];
+
+            if (def->field == op->field) {
+                if (op->src_len != def->width) {
+                    t->columnar = false;
+                }
+                t->col_ofs[j] = op->src_ofs;
+            }
+        }
+    }
+}
+
+/* Compiles 'fields' into a decode plan.  Fixed-length templates keep only
+ * the ops that store something, each with its precomputed record offset,
+ * and use a specialized decoder instead if they match an OVS layout;
+ * templates with variable-length fields keep every op so that the decoder
+ * can walk the record.  --filter is compiled along.  The first
+ * 'n_scope_fields' fields of an options template are its scope. */
+static struct ipfix_template *
+ipfix_template_compile(const struct ipfix_template_key *key,
+                       const struct ipfix_field *fields, size_t n_fields,
+                       uint16_t n_scope_fields)
+{
+    struct ipfix_template *t = xzalloc(sizeof *t);
+    bool fixed = true;
+    size_t ofs = 0;
+
+    t->key = *key;
+    t->n_scope_fields = n_scope_fields;
+    t->fields = xmemdup(fields, n_fields * sizeof *fields);
+    t->n_fields = n_fields;
+    t->ops = xmalloc(MAX(n_fields, 1) * sizeof *t->ops);
+
+    for (size_t i = 0; i < n_fields; i++) {
+        if (fields[i].length == IPFIX_VARLEN) {
+            fixed = false;
+        }
+    }
+
+    for (size_t i = 0; i < n_fields; i++) {
+        const struct ipfix_field *f = &fields[i];
+        const struct ipfix_ie_map *m = ipfix_ie_map_find(f->enterprise,
+                                                         f->ie_id);
+        enum ipfix_op_type type = ipfix_op_for(m, f->length);
+
+        if (type != IPFIX_OP_SKIP || !fixed) {
+            struct ipfix_decode_op *op = &t->ops[t->n_ops++];
+            op->src_ofs = ofs;
+            op->src_len = f->length;
+            op->dst_ofs = m ? m->dst_ofs : 0;
+            op->dst_len = m ? m->dst_len : 0;
+            op->type = type;
+            op->field = m ? m->field : 0;
+            if (type != IPFIX_OP_SKIP && f->length != IPFIX_VARLEN) {
+                t->present |= IPFIX_F_BIT(m->field);
+            }
+        }
+        ofs += f->length == IPFIX_VARLEN ? 1 : f->length;
+    }
+
+    t->min_record_len = MIN(ofs, UINT16_MAX);
+    t->record_len = fixed ? t->min_record_len : 0;
+    if (fixed && ipfix_fast_path) {
+        t->fast_decode = ipfix_fast_decoder_find(fields, n_fields);
+    }
+    ipfix_template_plan_columns(t);
+    if (filter) {
+        t->n_filter_ops = ipfix_filter_compile(filter, fields, n_fields,
+                                               &t->filter_ops);
+    }
+    return t;
+}
+
+static void
+ipfix_template_destroy(struct ipfix_template *t)
+{
+    if (t) {
+        free(t->fields);
+        free(t->ops);
+        free(t->filter_ops);
+        free(t);
+    }
+}
+
+static uint32_t
+ipfix_template_hash(const struct ipfix_template_key *key)
+{
+    return hash_bytes(key, sizeof *key, 0);
+}
+
+static struct ipfix_template *
+ipfix_template_find(struct ipfix_collector *c,
+                    const struct ipfix_template_key *key)
+{
+    struct ipfix_template *t = c->last_template;
+
+    if (t && !memcmp(&t->key, key, sizeof *key)) {
+        return t;
+    }
+    HMAP_FOR_EACH_WITH_HASH (t, hmap_node, ipfix_template_hash(key),
+                             &c->templates) {
+        if (!memcmp(&t->key, key, sizeof *key)) {
+            c->last_template = t;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void
+ipfix_template_remove(struct ipfix_collector *c, struct ipfix_template *t)
+{
+    if (c->last_template == t) {
+        c->last_template = NULL;
+    }
+    hmap_remove(&c->templates, &t->hmap_node);
+    ipfix_template_destroy(t);
+}
+
+/* Installs a template, or an options template if 'n_scope_fields' is
+ * nonzero, keeping the compiled plan if an identical template is already
+ * cached (exporters resend templates periodically). */
+static void
+ipfix_template_install(struct ipfix_collector *c,
+                       const struct ipfix_template_key *key,
+                       const struct ipfix_field *fields, size_t n_fields,
+                       uint16_t n_scope_fields)
+{
+    struct ipfix_template *t = ipfix_template_find(c, key);
+
+    if (t) {
+        if (t->n_fields == n_fields && t->n_scope_fields == n_scope_fields
+            && !memcmp(t->fields, fields, n_fields * sizeof *fields)) {
+            return;
+        }
+        ipfix_template_remove(c, t);
+    }
+
+    t = ipfix_template_compile(key, fields, n_fields, n_scope_fields);
+    hmap_insert(&c->templates, &t->hmap_node, ipfix_template_hash(key));
+}
+
+/* Removes 'key''s template or, if its template ID is the template or
+ * options template set ID, every template or options template of its
+ * observation domain (RFC 7011 section 8.1). */
+static void
+ipfix_template_withdraw(struct ipfix_collector *c,
+                        const struct ipfix_template_key *key)
+{
+    bool options = key->template_id == IPFIX_SET_ID_OPTIONS_TEMPLATE;
+    struct ipfix_template *t, *next;
+
+    if (key->template_id != IPFIX_SET_ID_TEMPLATE && !options) {
+        t = ipfix_template_find(c, key);
+        if (t) {
+            ipfix_template_remove(c, t);
+        }
+        return;
+    }
+
+    HMAP_FOR_EACH_SAFE (t, next, hmap_node, &c->templates) {
+        if (!memcmp(&t->key.exporter, &key->exporter, sizeof key->exporter)
+            && t->key.exporter_port == key->exporter_port
+            && t->key.obs_domain == key->obs_domain
+            && !t->n_scope_fields == !options) {
+            ipfix_template_remove(c, t);
+        }
+    }
+}
+
+/* Removes every template of the transport session that 'key' identifies
+ * by exporter address and port, once it has closed (RFC 7011 section 8).
+ * Sequence statistics outlive the session. */
+static void
+ipfix_template_flush_session(struct ipfix_collector *c,
+                             const struct ipfix_template_key *key)
+{
+    struct ipfix_template *t, *next;
+
+    HMAP_FOR_EACH_SAFE (t, next, hmap_node, &c->templates) {
+        if (!memcmp(&t->key.exporter, &key->exporter, sizeof key->exporter)
+            && t->key.exporter_port == key->exporter_port) {
+            ipfix_template_remove(c, t);
+        }
+    }
+}
+
+/* Parses the template records in a template set of 'len' bytes at 'p',
+ * or the options template records if 'options' is true.  'key' supplies
+ * the scope; its template ID is overwritten. */
+static void
+ipfix_parse_template_set(struct ipfix_collector *c,
+                         struct ipfix_template_key *key, bool options,
+                         const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len;
+    struct ipfix_field *fields = NULL;
+    size_t allocated = 0;
+
+    while (end - p >= sizeof(struct ipfix_template_record_header)) {
+        const struct ipfix_template_record_header *th = (const void *) p;
+        uint16_t template_id = ntohs(th->template_id);
+        uint16_t n_fields = ntohs(th->field_count);
+        uint16_t n_scope_fields = 0;
+        ovs_be16 scope_field_count;
+
+        p += sizeof *th;
+        key->template_id = template_id;
+        if (!n_fields) {
+            ipfix_template_withdraw(c, key);
+            ipfix_count(c, IPFIX_CTR_WITHDRAWALS, 1);
+            continue;
+        }
+        if (template_id < IPFIX_SET_ID_DATA_MIN) {
+            ipfix_count(c, IPFIX_CTR_BAD_TEMPLATE_ID, 1);
+            ds_put_format(&c->out, "bad IPFIX template ID %"PRIu16"\n",
+                          template_id);
+            break;
+        }
+        if (options) {
+            /* An options template record header adds the number of scope
+             * fields, which must be at least 1 (section 3.4.2.2). */
+            if (end - p < sizeof scope_field_count) {
+                ipfix_count(c, IPFIX_CTR_BAD_TEMPLATE, 1);
+                ds_put_cstr(&c->out, "failed to get IPFIX options template "
+                            "record\n");
+                break;
+            }
+            memcpy(&scope_field_count, p, sizeof scope_field_count);
+            p += sizeof scope_field_count;
+            n_scope_fields = ntohs(scope_field_count);
+            if (!n_scope_fields || n_scope_fields > n_fields) {
+                ipfix_count(c, IPFIX_CTR_BAD_TEMPLATE, 1);
+                ds_put_format(&c->out, "bad IPFIX options template scope "
+                              "field count %"PRIu16"\n", n_scope_fields);
+                break;
+            }
+        }
+
+        if (n_fields > allocated) {
+            allocated = n_fields;
+            fields = xrealloc(fields, allocated * sizeof *fields);
+        }
+        for (size_t i = 0; i < n_fields; i++) {
+            struct ipfix_field_specifier fs;
+            ovs_be32 enterprise;
+
+            if (end - p < sizeof fs) {
+                ipfix_count(c, IPFIX_CTR_BAD_TEMPLATE, 1);
+                ds_put_cstr(&c->out, "failed to get IPFIX template record\n");
+                goto out;
+            }
+            memcpy(&fs, p, sizeof fs);
+            p += sizeof fs;
+
+            fields[i].ie_id = ntohs(fs.ie_id) & ~IPFIX_ENTERPRISE_BIT;
+            fields[i].length = ntohs(fs.length);
+            fields[i].enterprise = 0;
+            if (ntohs(fs.ie_id) & IPFIX_ENTERPRISE_BIT) {
+                if (end - p < sizeof enterprise) {
+                    ipfix_count(c, IPFIX_CTR_BAD_TEMPLATE, 1);
+                    ds_put_cstr(&c->out,
+                                "failed to get IPFIX template record\n");
+                    goto out;
+                }
+                memcpy(&enterprise, p, sizeof enterprise);
+                p += sizeof enterprise;
+                fields[i].enterprise = ntohl(enterprise);
+            }
+        }
+        ipfix_template_install(c, key, fields, n_fields, n_scope_fields);
+        ipfix_count(c, IPFIX_CTR_TEMPLATES, 1);
+    }
+
+out:
+    free(fields);
+}
+
+static inline void
+ipfix_store_uint(uint8_t *dst, uint8_t dst_len, uint64_t value)
+{
+    switch (dst_len) {
+    case 1: *dst = value; break;
+    case 2: { uint16_t x = value; memcpy(dst, &x, 2); break; }
+    case 4: { uint32_t x = value; memcpy(dst, &x, 4); break; }
+    case 8: memcpy(dst, &value, 8); break;
+    }
+}
+
+static inline void
+ipfix_apply_op(const struct ipfix_decode_op *op, const uint8_t *src,
+               size_t len, struct ipfix_flow *flow)
+{
+    uint8_t *dst = (uint8_t *) flow + op->dst_ofs;
+
+    switch ((enum ipfix_op_type) op->type) {
+    case IPFIX_OP_SKIP:
+        break;
+    case IPFIX_OP_COPY:
+        memcpy(dst, src, op->dst_len);
+        break;
+    case IPFIX_OP_U8:
+        *dst = *src;
+        break;
+    case IPFIX_OP_BE16: {
+        ovs_be16 x;
+        memcpy(&x, src, sizeof x);
+        ipfix_store_uint(dst, 2, ntohs(x));
+        break;
+    }
+    case IPFIX_OP_BE32: {
+        ovs_be32 x;
+        memcpy(&x, src, sizeof x);
+        ipfix_store_uint(dst, 4, ntohl(x));
+        break;
+    }
+    case IPFIX_OP_BE64: {
+        ovs_be64 x;
+        memcpy(&x, src, sizeof x);
+        ipfix_store_uint(dst, 8, ntohll(x));
+        break;
+    }
+    case IPFIX_OP_UINT: {
+        uint64_t value = 0;
+        for (size_t i = 0; i < len; i++) {
+            value = (value << 8) | src[i];
+        }
+        ipfix_store_uint(dst, op->dst_len, value);
+        break;
+    }
+    }
+}
+
+/* Decodes the record at 'p', which has at most 'len' bytes, into 'flow'.
+ * Returns the record's length, or 0 if it is truncated. */
+static size_t
+ipfix_decode_record(const struct ipfix_template *t, const uint8_t *p,
+                    size_t len, struct ipfix_flow *flow)
+{
+    memset(flow, 0, sizeof *flow);
+    flow->present = t->present;
+
+    if (t->record_len) {
+        if (len < t->record_len) {
+            return 0;
+        }
+        if (t->fast_decode) {
+            t->fast_decode(p, flow);
+            return t->record_len;
+        }
+        for (size_t i = 0; i < t->n_ops; i++) {
+            const struct ipfix_decode_op *op = &t->ops[i];
+            ipfix_apply_op(op, p + op->src_ofs, op->src_len, flow);
+        }
+        return t->record_len;
+    } else {
+        size_t ofs = 0;
+
+        for (size_t i = 0; i < t->n_ops; i++) {
+            const struct ipfix_decode_op *op = &t->ops[i];
+            size_t field_len = op->src_len;
+
+            if (field_len == IPFIX_VARLEN) {
+                if (ofs >= len) {
+                    return 0;
+                }
+                field_len = p[ofs++];
+                if (field_len == 255) {
+                    if (len - ofs < 2) {
+                        return 0;
+                    }
+                    field_len = (p[ofs] << 8) | p[ofs + 1];
+                    ofs += 2;
+                }
+            }
+            if (len - ofs < field_len) {
+                return 0;
+            }
+            if (op->src_len != IPFIX_VARLEN) {
+                ipfix_apply_op(op, p + ofs, field_len, flow);
+            } else if (op->type != IPFIX_OP_SKIP
+                       && field_len && field_len <= op->dst_len) {
+                ipfix_apply_op(op, p + ofs, field_len, flow);
+                flow->present |= IPFIX_F_BIT(op->field);
+            }
+            ofs += field_len;
+        }
+        return ofs;
+    }
+}
+
+/* Specialized decoders for the fixed OVS layouts.  Each expands
+ * IPFIX_OVS_TEMPLATE_FIELDS with constant arguments, so that every field
+ * compiles to a load at a constant offset, a byte swap and a store, with
+ * no per-field dispatch. */
+
+static inline void ALWAYS_INLINE
+ipfix_fast_load(enum ipfix_ie_kind kind, void *dst, size_t dst_len,
+                const uint8_t *src, size_t len)
+{
+    uint64_t value;
+
+    if (kind == IPFIX_KIND_BYTES) {
+        memcpy(dst, src, dst_len);
+        return;
+    }
+    switch (len) {
+    case 1:
+        value = *src;
+        break;
+    case 2: {
+        ovs_be16 x;
+        memcpy(&x, src, sizeof x);
+        value = ntohs(x);
+        break;
+    }
+    case 4: {
+        ovs_be32 x;
+        memcpy(&x, src, sizeof x);
+        value = ntohl(x);
+        break;
+    }
+    case 8: {
+        ovs_be64 x;
+        memcpy(&x, src, sizeof x);
+        value = ntohll(x);
+        break;
+    }
+    default:
+        OVS_NOT_REACHED();
+    }
+    ipfix_store_uint(dst, dst_len, value);
+}
+
+#define IPFIX_FAST_FIELD(ENTERPRISE, IE, LEN, KIND, MEMBER)              \
+    BUILD_ASSERT(LEN == IPFIX_VARLEN || LEN == sizeof flow->MEMBER);    \
+    if (LEN != IPFIX_VARLEN) {                                          \
+        ipfix_fast_load(IPFIX_KIND_##KIND, &flow->MEMBER,               \
+                        sizeof flow->MEMBER, p, LEN);                   \
+        p += LEN;                                                       \
+    }
+
+#define IPFIX_DEFINE_FAST_DECODER(NAME, L2, L3, L4)                      \
+    static size_t                                                       \
+    ipfix_fast_decode_##NAME(const uint8_t *p, struct ipfix_flow *flow) \
+    {                                                                   \
+        const uint8_t *start = p;                                       \
+                                                                        \
+        IPFIX_OVS_TEMPLATE_FIELDS(L2, L3, L4, IPFIX_PROTO_NOT_TUNNELED, \
+                                  IPFIX_FAST_FIELD);                    \
+        return p - start;                                               \
+    }
+
+#define IPFIX_DEFINE_FAST_DECODERS(L2_NAME, L2)                         \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME, L2, IPFIX_PROTO_L3_UNKNOWN,       \
+                              IPFIX_PROTO_L4_UNKNOWN)                   \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME##_ipv4, L2, IPFIX_PROTO_L3_IPV4,   \
+                              IPFIX_PROTO_L4_UNKNOWN)                   \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME##_ipv4_tcp_udp, L2,                \
+                              IPFIX_PROTO_L3_IPV4,                      \
+                              IPFIX_PROTO_L4_TCP_UDP_SCTP)              \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME##_ipv4_icmp, L2, IPFIX_PROTO_L3_IPV4, \
+                              IPFIX_PROTO_L4_ICMP)                      \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME##_ipv6, L2, IPFIX_PROTO_L3_IPV6,   \
+                              IPFIX_PROTO_L4_UNKNOWN)                   \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME##_ipv6_tcp_udp, L2,                \
+                              IPFIX_PROTO_L3_IPV6,                      \
+                              IPFIX_PROTO_L4_TCP_UDP_SCTP)              \
+    IPFIX_DEFINE_FAST_DECODER(L2_NAME##_ipv6_icmp, L2, IPFIX_PROTO_L3_IPV6, \
+                              IPFIX_PROTO_L4_ICMP)
+
+IPFIX_DEFINE_FAST_DECODERS(eth, IPFIX_PROTO_L2_ETH)
+IPFIX_DEFINE_FAST_DECODERS(vlan, IPFIX_PROTO_L2_VLAN)
+
+static ipfix_fast_decode_func *const
+ipfix_fast_decoders[NUM_IPFIX_PROTO_L2][NUM_IPFIX_PROTO_L3]
+                   [NUM_IPFIX_PROTO_L4] = {
+#define IPFIX_FAST_DECODERS(L2_NAME)                                     \
+    {                                                                   \
+        { ipfix_fast_decode_##L2_NAME, NULL, NULL },                    \
+        { ipfix_fast_decode_##L2_NAME##_ipv4,                           \
+          ipfix_fast_decode_##L2_NAME##_ipv4_tcp_udp,                   \
+          ipfix_fast_decode_##L2_NAME##_ipv4_icmp },                    \
+        { ipfix_fast_decode_##L2_NAME##_ipv6,                           \
+          ipfix_fast_decode_##L2_NAME##_ipv6_tcp_udp,                   \
+          ipfix_fast_decode_##L2_NAME##_ipv6_icmp },                    \
+    }
+    [IPFIX_PROTO_L2_ETH] = IPFIX_FAST_DECODERS(eth),
+    [IPFIX_PROTO_L2_VLAN] = IPFIX_FAST_DECODERS(vlan),
+#undef IPFIX_FAST_DECODERS
+};
+
+static uint16_t
+ipfix_ovs_template_id(enum ipfix_proto_l2 l2, enum ipfix_proto_l3 l3,
+                      enum ipfix_proto_l4 l4, enum ipfix_proto_tunnel tunnel)
+{
+    return IPFIX_SET_ID_DATA_MIN
+           + ((l2 * NUM_IPFIX_PROTO_L3 + l3) * NUM_IPFIX_PROTO_L4 + l4)
+             * NUM_IPFIX_PROTO_TUNNEL + tunnel;
+}
+
+/* Inverse of ipfix_ovs_template_id(). */
+static void
+ipfix_ovs_template_classify(uint16_t template_id, enum ipfix_proto_l2 *l2,
+                            enum ipfix_proto_l3 *l3, enum ipfix_proto_l4 *l4,
+                            enum ipfix_proto_tunnel *tunnel)
+{
+    unsigned int x = template_id - IPFIX_SET_ID_DATA_MIN;
+
+    *tunnel = x % NUM_IPFIX_PROTO_TUNNEL;
+    x /= NUM_IPFIX_PROTO_TUNNEL;
+    *l4 = x % NUM_IPFIX_PROTO_L4;
+    x /= NUM_IPFIX_PROTO_L4;
+    *l3 = x % NUM_IPFIX_PROTO_L3;
+    *l2 = x / NUM_IPFIX_PROTO_L3;
+}
+
+/* Returns the layout of OVS data template 'template_id', or NULL if OVS
+ * does not use that ID. */
+static const struct ipfix_ovs_layout *
+ipfix_ovs_layout_find(uint16_t template_id)
+{
+    const struct ipfix_ovs_layout *l;
+
+    if (template_id < IPFIX_SET_ID_DATA_MIN
+        || template_id - IPFIX_SET_ID_DATA_MIN >= IPFIX_N_OVS_TEMPLATE_IDS) {
+        return NULL;
+    }
+    l = &ipfix_ovs_layouts[template_id - IPFIX_SET_ID_DATA_MIN];
+    return l->n_fields ? l : NULL;
+}
+
+/* Column kernels.  Each one reads the 'n' fields at 'src', 'src + stride',
+ * 'src + 2 * stride', ... into the array 'dst': "swap" kernels convert
+ * them to host byte order, "copy" kernels keep them as they are. */
+typedef void ipfix_column_func(const uint8_t *src, size_t stride, size_t n,
+                               void *dst);
+
+struct ipfix_column_kernels{
+    const char *name;
+    ipfix_column_func *swap32;
+    ipfix_column_func *swap64;
+    ipfix_column_func *copy32;
+};
+
+static inline uint32_t
+ipfix_load32(const uint8_t *p)
+{
+    uint32_t x;
+
+    memcpy(&x, p, sizeof x);
+    return x;
+}
+
+static inline uint64_t
+ipfix_load64(const uint8_t *p)
+{
+    uint64_t x;
+
+    memcpy(&x, p, sizeof x);
+    return x;
+}
+
+static void
+ipfix_column_swap32_scalar(const uint8_t *src, size_t stride, size_t n,
+                           void *dst_)
+{
+    uint32_t *dst = dst_;
+
+    for (size_t i = 0; i < n; i++, src += stride) {
+        dst[i] = ntohl(ipfix_load32(src));
+    }
+}
+
+static void
+ipfix_column_swap64_scalar(const uint8_t *src, size_t stride, size_t n,
+                           void *dst_)
+{
+    uint64_t *dst = dst_;
+
+    for (size_t i = 0; i < n; i++, src += stride) {
+        dst[i] = ntohll(ipfix_load64(src));
+    }
+}
+
+static void
+ipfix_column_copy32_scalar(const uint8_t *src, size_t stride, size_t n,
+                           void *dst_)
+{
+    uint32_t *dst = dst_;
+
+    for (size_t i = 0; i < n; i++, src += stride) {
+        dst[i] = ipfix_load32(src);
+    }
+}
+
+#ifdef IPFIX_HAVE_X86_SIMD
+/* SSE4.1: four 32-bit or two 64-bit fields per vector, inserted one by
+ * one and byte swapped with a single shuffle. */
+static void __attribute__((target("sse4.1")))
+ipfix_column_swap32_sse4(const uint8_t *src, size_t stride, size_t n,
+                         void *dst_)
+{
+    const __m128i bswap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                        11, 10, 9, 8, 15, 14, 13, 12);
+    uint32_t *dst = dst_;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4, src += 4 * stride) {
+        __m128i x = _mm_cvtsi32_si128(ipfix_load32(src));
+
+        x = _mm_insert_epi32(x, ipfix_load32(src + stride), 1);
+        x = _mm_insert_epi32(x, ipfix_load32(src + 2 * stride), 2);
+        x = _mm_insert_epi32(x, ipfix_load32(src + 3 * stride), 3);
+        _mm_storeu_si128((__m128i *) &dst[i], _mm_shuffle_epi8(x, bswap));
+    }
+    ipfix_column_swap32_scalar(src, stride, n - i, &dst[i]);
+}
+
+static void __attribute__((target("sse4.1")))
+ipfix_column_swap64_sse4(const uint8_t *src, size_t stride, size_t n,
+                         void *dst_)
+{
+    const __m128i bswap = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                        15, 14, 13, 12, 11, 10, 9, 8);
+    uint64_t *dst = dst_;
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2, src += 2 * stride) {
+        __m128i x = _mm_set_epi64x(ipfix_load64(src + stride),
+                                   ipfix_load64(src));
+
+        _mm_storeu_si128((__m128i *) &dst[i], _mm_shuffle_epi8(x, bswap));
+    }
+    ipfix_column_swap64_scalar(src, stride, n - i, &dst[i]);
+}
+
+static void __attribute__((target("sse4.1")))
+ipfix_column_copy32_sse4(const uint8_t *src, size_t stride, size_t n,
+                         void *dst_)
+{
+    uint32_t *dst = dst_;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4, src += 4 * stride) {
+        __m128i x = _mm_cvtsi32_si128(ipfix_load32(src));
+
+        x = _mm_insert_epi32(x, ipfix_load32(src + stride), 1);
+        x = _mm_insert_epi32(x, ipfix_load32(src + 2 * stride), 2);
+        x = _mm_insert_epi32(x, ipfix_load32(src + 3 * stride), 3);
+        _mm_storeu_si128((__m128i *) &dst[i], x);
+    }
+    ipfix_column_copy32_scalar(src, stride, n - i, &dst[i]);
+}
+
+/* AVX2: eight 32-bit or four 64-bit fields per vector, fetched with one
+ * gather.  A data set is at most 64 kB, so the offsets fit the gather's
+ * 32-bit indexes. */
+static void __attribute__((target("avx2")))
+ipfix_column_swap32_avx2(const uint8_t *src, size_t stride, size_t n,
+                         void *dst_)
+{
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                           11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4,
+                                           11, 10, 9, 8, 15, 14, 13, 12);
+    const int s = stride;
+    const __m256i idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s,
+                                          4 * s, 5 * s, 6 * s, 7 * s);
+    uint32_t *dst = dst_;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8, src += 8 * stride) {
+        __m256i x = _mm256_i32gather_epi32((const int *) src, idx, 1);
+
+        _mm256_storeu_si256((__m256i *) &dst[i],
+                            _mm256_shuffle_epi8(x, bswap));
+    }
+    ipfix_column_swap32_scalar(src, stride, n - i, &dst[i]);
+}
+
+static void __attribute__((target("avx2")))
+ipfix_column_swap64_avx2(const uint8_t *src, size_t stride, size_t n,
+                         void *dst_)
+{
+    const __m256i bswap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                           15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0,
+                                           15, 14, 13, 12, 11, 10, 9, 8);
+    const int s = stride;
+    const __m128i idx = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+    uint64_t *dst = dst_;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4, src += 4 * stride) {
+        __m256i x = _mm256_i32gather_epi64((const long long int *) src,
+                                           idx, 1);
+
+        _mm256_storeu_si256((__m256i *) &dst[i],
+                            _mm256_shuffle_epi8(x, bswap));
+    }
+    ipfix_column_swap64_scalar(src, stride, n - i, &dst[i]);
+}
+
+static void __attribute__((target("avx2")))
+ipfix_column_copy32_avx2(const uint8_t *src, size_t stride, size_t n,
+                         void *dst_)
+{
+    const int s = stride;
+    const __m256i idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s,
+                                          4 * s, 5 * s, 6 * s, 7 * s);
+    uint32_t *dst = dst_;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8, src += 8 * stride) {
+        _mm256_storeu_si256((__m256i *) &dst[i],
+                            _mm256_i32gather_epi32((const int *) src,
+                                                   idx, 1));
+    }
+    ipfix_column_copy32_scalar(src, stride, n - i, &dst[i]);
+}
+#endif
+
+/* From least to most preferred. */
+static const struct ipfix_column_kernels ipfix_column_kernels[] = {
+    { "scalar", ipfix_column_swap32_scalar, ipfix_column_swap64_scalar,
+      ipfix_column_copy32_scalar },
+#ifdef IPFIX_HAVE_X86_SIMD
+    { "sse4", ipfix_column_swap32_sse4, ipfix_column_swap64_sse4,
+      ipfix_column_copy32_sse4 },
+    { "avx2", ipfix_column_swap32_avx2, ipfix_column_swap64_avx2,
+      ipfix_column_copy32_avx2 },
+#endif
+};
+
+/* Kernels that data sets are bulk decoded with, or NULL to decode record
+ * by record. */
+static const struct ipfix_column_kernels *ipfix_kernels;
+
+/* A data set with fewer records than this is decoded record by record. */
+#define IPFIX_COLUMNS_MIN_RECORDS 4
+
+static bool
+ipfix_column_kernels_supported(const struct ipfix_column_kernels *k)
+{
+#ifdef IPFIX_HAVE_X86_SIMD
+    if (!strcmp(k->name, "sse4")) {
+        return __builtin_cpu_supports("sse4.1");
+    } else if (!strcmp(k->name, "avx2")) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+/* Selects the column kernels named 'isa', the best ones that the CPU
+ * supports if 'isa' is "auto", or none if it is "off".  Returns false if
+ * 'isa' is unknown or the CPU lacks it. */
+static bool
+ipfix_column_kernels_select(const char *isa)
+{
+    if (!strcmp(isa, "off")) {
+        ipfix_kernels = NULL;
+        return true;
+    }
+    for (size_t i = ARRAY_SIZE(ipfix_column_kernels); i-- > 0; ) {
+        const struct ipfix_column_kernels *k = &ipfix_column_kernels[i];
+
+        if ((!strcmp(isa, "auto") || !strcmp(isa, k->name))
+            && ipfix_column_kernels_supported(k)) {
+            ipfix_kernels = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+ipfix_columns_destroy(struct ipfix_columns *cols)
+{
+    for (size_t i = 0; i < IPFIX_N_COLUMNS; i++) {
+        free(cols->data[i]);
+        cols->data[i] = NULL;
+    }
+    cols->n = cols->allocated = 0;
+}
+
+/* Decodes the 'n' records of columnar template 't' at 'p' into 'cols'.
+ * Columns of fields that 't' lacks are zeroed. */
+static void
+ipfix_decode_columns(const struct ipfix_template *t, const uint8_t *p,
+                     size_t n, struct ipfix_columns *cols)
+{
+    if (n > cols->allocated) {
+        size_t allocated = MAX(n, 2 * cols->allocated);
+
+        ipfix_columns_destroy(cols);
+        for (size_t i = 0; i < IPFIX_N_COLUMNS; i++) {
+            cols->data[i] = xmalloc(allocated * ipfix_column_defs[i].width);
+        }
+        cols->allocated = allocated;
+    }
+    cols->n = n;
+
+    for (size_t i = 0; i < IPFIX_N_COLUMNS; i++) {
+        const struct ipfix_column_def *def = &ipfix_column_defs[i];
+        uint8_t *dst = cols->data[i];
+        const uint8_t *src;
+
+        if (t->col_ofs[i] == UINT16_MAX) {
+            memset(dst, 0, n * def->width);
+            continue;
+        }
+        src = p + t->col_ofs[i];
+        switch (def->kind) {
+        case IPFIX_COL_SWAP32:
+            ipfix_kernels->swap32(src, t->record_len, n, dst);
+            break;
+        case IPFIX_COL_SWAP64:
+            ipfix_kernels->swap64(src, t->record_len, n, dst);
+            break;
+        case IPFIX_COL_COPY32:
+            ipfix_kernels->copy32(src, t->record_len, n, dst);
+            break;
+        case IPFIX_COL_COPY48:
+            for (size_t j = 0; j < n; j++) {
+                memcpy(&dst[j * 6], &src[j * t->record_len], 6);
+            }
+            break;
+        }
+    }
+}
+
+static void
+ipfix_ipv4_mapped(struct in6_addr *addr, const uint8_t ip[4])
+{
+    memset(addr, 0, sizeof *addr);
+    addr->s6_addr[10] = 0xff;
+    addr->s6_addr[11] = 0xff;
+    memcpy(&addr->s6_addr[12], ip, 4);
+}
+
+/* Stores 'flow''s source address, if 'src', or else its destination
+ * address into 'addr', IPv4 addresses IPv4-mapped.  Returns false, and
+ * leaves 'addr' alone, if 'flow' does not carry that address. */
+static bool
+ipfix_flow_ip(const struct ipfix_flow *flow, bool src, struct in6_addr *addr)
+{
+    if (flow->present & IPFIX_F_BIT(src ? IPFIX_F_SRC_IP : IPFIX_F_DST_IP)) {
+        ipfix_ipv4_mapped(addr, src ? flow->src_ip : flow->dst_ip);
+        return true;
+    }
+    if (flow->present
+        & IPFIX_F_BIT(src ? IPFIX_F_SRC_IPV6 : IPFIX_F_DST_IPV6)) {
+        memcpy(addr, src ? flow->src_ipv6 : flow->dst_ipv6, sizeof *addr);
+        return true;
+    }
+    return false;
+}
+
+static void
+format_capture_addr(struct ds *s, const struct in6_addr *addr)
+{
+    char buf[INET6_ADDRSTRLEN];
+
+    if (IN6_IS_ADDR_V4MAPPED(addr)) {
+        inet_ntop(AF_INET, &addr->s6_addr[12], buf, sizeof buf);
+    } else {
+        inet_ntop(AF_INET6, addr, buf, sizeof buf);
+    }
+    ds_put_cstr(s, buf);
+}
+
+static struct ipfix_agg_table *
+ipfix_agg_table_create(size_t max_flows)
+{
+    struct ipfix_agg_table *table = xzalloc(sizeof *table);
+    size_t n_slots = 1;
+
+    /* Keep the load factor at or below 7/8. */
+    while (n_slots / 8 * 7 < max_flows) {
+        n_slots *= 2;
+    }
+    table->slots = xcalloc(n_slots, sizeof *table->slots);
+    table->mask = n_slots - 1;
+    table->flows = xmalloc(max_flows * sizeof *table->flows);
+    table->max = max_flows;
+    return table;
+}
+
+static void
+ipfix_agg_table_destroy(struct ipfix_agg_table *table)
+{
+    if (table) {
+        free(table->slots);
+        free(table->flows);
+        free(table);
+    }
+}
+
+/* Returns the flow with 'key' and 'hash' in 'table', inserting it if
+ * there is room, otherwise NULL. */
+static struct ipfix_agg_flow *
+ipfix_agg_table_lookup(struct ipfix_agg_table *table,
+                       const struct ipfix_agg_key *key, uint32_t hash)
+{
+    size_t i = hash & table->mask;
+
+    hash = hash ? hash : 1;
+    for (;; i = (i + 1) & table->mask) {
+        struct ipfix_agg_slot *slot = &table->slots[i];
+        struct ipfix_agg_flow *flow;
+
+        if (slot->hash == hash) {
+            flow = &table->flows[slot->idx];
+            if (!memcmp(&flow->key, key, sizeof *key)) {
+                return flow;
+            }
+        } else if (!slot->hash) {
+            if (table->n >= table->max) {
+                return NULL;
+            }
+            slot->hash = hash;
+            slot->idx = table->n;
+            flow = &table->flows[table->n++];
+            memset(flow, 0, sizeof *flow);
+            flow->key = *key;
+            flow->first = LLONG_MAX;
+            flow->last = LLONG_MIN;
+            return flow;
+        }
+    }
+}
+
+/* Returns the sum of the squares of the sizes of a record's 'packets'
+ * packets of 'octets' octets in all: 'sum_sq', the record's
+ * octetDeltaSumOfSquares, if it has one, otherwise assuming that every
+ * packet has the mean size. */
+static inline double
+ipfix_sampling_sum_sq(uint64_t packets, uint64_t octets, uint64_t sum_sq)
+{
+    return (sum_sq ? sum_sq
+            : packets ? (double) octets * octets / packets
+            : 0);
+}
+
+/* Folds 'flow', from the message with header 'msg_hd' of 'stream', into
+ * 'table'. */
+static void
+ipfix_agg_add(struct ipfix_agg_table *table,
+              const struct ipfix_seq_stream *stream,
+              const struct ipfix_message_header *msg_hd,
+              const struct ipfix_flow *flow)
+{
+    long long int export_ms = ntohl(msg_hd->export_time) * 1000LL;
+    struct ipfix_agg_flow *agg;
+    struct ipfix_agg_key key;
+
+    memset(&key, 0, sizeof key);
+    ipfix_flow_ip(flow, true, &key.src_ip);
+    ipfix_flow_ip(flow, false, &key.dst_ip);
+    memcpy(key.src_mac, flow->src_mac, sizeof key.src_mac);
+    memcpy(key.dst_mac, flow->dst_mac, sizeof key.dst_mac);
+    key.eth_type = flow->eth_type;
+    key.ip_pro = flow->ip_pro;
+    key.icmp_type = flow->icmp_type;
+    key.icmp_code = flow->icmp_code;
+    key.src_port = flow->src_port;
+    key.dst_port = flow->dst_port;
+
+    agg = ipfix_agg_table_lookup(table, &key,
+                                 hash_bytes(&key, sizeof key, 0));
+    if (!agg) {
+        table->n_dropped++;
+        return;
+    }
+    agg->n_records++;
+    agg->packets += flow->packets;
+    agg->l2_octets += flow->l2_octor_delta_count;
+    agg->octets += flow->octets;
+    if (stream->sampling_var) {
+        agg->n_sampled++;
+        agg->unsampled_packets += flow->packets * stream->sampling_skip;
+        agg->unsampled_octets += flow->octets * stream->sampling_skip;
+        agg->var_packets += flow->packets * stream->sampling_var;
+        agg->var_octets += (ipfix_sampling_sum_sq(flow->packets, flow->octets,
+                                                  flow->delta_oc_sq)
+                            * stream->sampling_var);
+    }
+    /* The start and end times are microseconds before the export time. */
+    agg->first = MIN(agg->first, export_ms - flow->start_time / 1000);
+    agg->last = MAX(agg->last, export_ms - flow->end_time / 1000);
+}
+
+/* Space-saving summary of 'capacity' keys. */
+static void
+ipfix_hh_topk_init(struct ipfix_hh_topk *topk, size_t capacity)
+{
+    topk->entries = xcalloc(capacity, sizeof *topk->entries);
+    topk->heap = xmalloc(capacity * sizeof *topk->heap);
+    hmap_init(&topk->index);
+    hmap_reserve(&topk->index, capacity);
+    topk->n = 0;
+    topk->capacity = capacity;
+}
+
+static void
+ipfix_hh_topk_destroy(struct ipfix_hh_topk *topk)
+{
+    free(topk->entries);
+    free(topk->heap);
+    hmap_destroy(&topk->index);
+}
+
+static void
+ipfix_hh_heap_swap(struct ipfix_hh_topk *topk, size_t i, size_t j)
+{
+    struct ipfix_hh_entry *tmp = topk->heap[i];
+
+    topk->heap[i] = topk->heap[j];
+    topk->heap[j] = tmp;
+    topk->heap[i]->heap_idx = i;
+    topk->heap[j]->heap_idx = j;
+}
+
+/* Restores the heap property below 'e', whose count increased. */
+static void
+ipfix_hh_heap_down(struct ipfix_hh_topk *topk, struct ipfix_hh_entry *e)
+{
+    for (size_t i = e->heap_idx; ; ) {
+        size_t min = i, left = 2 * i + 1, right = left + 1;
+
+        if (left < topk->n
+            && topk->heap[left]->count < topk->heap[min]->count) {
+            min = left;
+        }
+        if (right < topk->n
+            && topk->heap[right]->count < topk->heap[min]->count) {
+            min = right;
+        }
+        if (min == i) {
+            break;
+        }
+        ipfix_hh_heap_swap(topk, i, min);
+        i = min;
+    }
+}
+
+/* Restores the heap property above 'e', which was just appended. */
+static void
+ipfix_hh_heap_up(struct ipfix_hh_topk *topk, struct ipfix_hh_entry *e)
+{
+    for (size_t i = e->heap_idx; i; ) {
+        size_t parent = (i - 1) / 2;
+
+        if (topk->heap[parent]->count <= topk->heap[i]->count) {
+            break;
+        }
+        ipfix_hh_heap_swap(topk, i, parent);
+        i = parent;
+    }
+}
+
+static struct ipfix_hh_entry *
+ipfix_hh_topk_find(const struct ipfix_hh_topk *topk,
+                   const struct ipfix_hh_key *key, uint32_t hash)
+{
+    struct ipfix_hh_entry *e;
+
+    HMAP_FOR_EACH_WITH_HASH (e, hmap_node, hash, &topk->index) {
+        if (!memcmp(&e->key, key, sizeof *key)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Adds 'weight' to 'key' in 'topk'.  'estimate' is the sketch's estimate
+ * of the key's total, 'weight' included. */
+static void
+ipfix_hh_topk_add(struct ipfix_hh_topk *topk, const struct ipfix_hh_key *key,
+                  uint32_t hash, uint64_t weight, uint64_t estimate)
+{
+    struct ipfix_hh_entry *e = ipfix_hh_topk_find(topk, key, hash);
+
+    if (e) {
+        e->count += weight;
+        ipfix_hh_heap_down(topk, e);
+        return;
+    }
+
+    if (topk->n < topk->capacity) {
+        e = &topk->entries[topk->n];
+        e->heap_idx = topk->n;
+        topk->heap[topk->n++] = e;
+    } else {
+        e = topk->heap[0];
+        if (estimate <= e->count) {
+            return;
+        }
+        hmap_remove(&topk->index, &e->hmap_node);
+    }
+    e->key = *key;
+    e->count = estimate;
+    e->error = estimate - weight;
+    hmap_insert(&topk->index, &e->hmap_node, hash);
+    ipfix_hh_heap_up(topk, e);
+    ipfix_hh_heap_down(topk, e);
+}
+
+static struct ipfix_hh *
+ipfix_hh_create(size_t max_domains, size_t top_k)
+{
+    struct ipfix_hh *hh = xzalloc(sizeof *hh);
+
+    hh->domains = xcalloc(max_domains, sizeof *hh->domains);
+    hh->max_domains = max_domains;
+    for (size_t i = 0; i < max_domains; i++) {
+        struct ipfix_hh_domain *d = &hh->domains[i];
+
+        d->sketch = xcalloc(IPFIX_HH_N_DIMS, sizeof *d->sketch);
+        for (size_t dim = 0; dim < IPFIX_HH_N_DIMS; dim++) {
+            for (size_t m = 0; m < IPFIX_HH_N_METRICS; m++) {
+                /* Spare room keeps the true top 'top_k' from being
+                 * evicted by keys near the threshold. */
+                ipfix_hh_topk_init(&d->topk[dim][m], MAX(4 * top_k, 32));
+            }
+        }
+    }
+    return hh;
+}
+
+static void
+ipfix_hh_destroy(struct ipfix_hh *hh)
+{
+    if (hh) {
+        for (size_t i = 0; i < hh->max_domains; i++) {
+            struct ipfix_hh_domain *d = &hh->domains[i];
+
+            for (size_t dim = 0; dim < IPFIX_HH_N_DIMS; dim++) {
+                for (size_t m = 0; m < IPFIX_HH_N_METRICS; m++) {
+                    ipfix_hh_topk_destroy(&d->topk[dim][m]);
+                }
+            }
+            free(d->sketch);
+        }
+        free(hh->domains);
+        free(hh);
+    }
+}
+
+static const struct ipfix_hh_domain *
+ipfix_hh_find_domain(const struct ipfix_hh *hh, uint32_t obs_domain)
+{
+    for (size_t i = 0; i < hh->n_domains; i++) {
+        if (hh->domains[i].obs_domain == obs_domain) {
+            return &hh->domains[i];
+        }
+    }
+    return NULL;
+}
+
+/* Returns the state of 'obs_domain', claiming a free one if needed, or
+ * NULL if every one is taken. */
+static struct ipfix_hh_domain *
+ipfix_hh_lookup_domain(struct ipfix_hh *hh, uint32_t obs_domain)
+{
+    struct ipfix_hh_domain *d = hh->last_domain;
+
+    if (d && d->obs_domain == obs_domain) {
+        return d;
+    }
+    d = CONST_CAST(struct ipfix_hh_domain *,
+                   ipfix_hh_find_domain(hh, obs_domain));
+    if (!d) {
+        if (hh->n_domains >= hh->max_domains) {
+            return NULL;
+        }
+        d = &hh->domains[hh->n_domains++];
+        d->obs_domain = obs_domain;
+    }
+    hh->last_domain = d;
+    return d;
+}
+
+static inline size_t
+ipfix_hh_cell(uint32_t hash, size_t row)
+{
+    return hash_int(hash, row) & (IPFIX_HH_WIDTH - 1);
+}
+
+/* Returns the sketch's estimate of 'key''s total for 'metric'. */
+static uint64_t
+ipfix_hh_estimate(const struct ipfix_hh_domain *d, enum ipfix_hh_dim dim,
+                  enum ipfix_hh_metric metric, uint32_t hash)
+{
+    uint64_t estimate = UINT64_MAX;
+
+    for (size_t row = 0; row < IPFIX_HH_DEPTH; row++) {
+        estimate = MIN(estimate,
+                       d->sketch[dim][row][ipfix_hh_cell(hash, row)][metric]);
+    }
+    return estimate;
+}
+
+static void
+ipfix_hh_update(struct ipfix_hh_domain *d, enum ipfix_hh_dim dim,
+                const struct ipfix_hh_key *key,
+                const uint64_t weights[IPFIX_HH_N_METRICS])
+{
+    uint64_t estimates[IPFIX_HH_N_METRICS];
+    uint32_t hash = hash_bytes(key, sizeof *key, 0);
+
+    for (size_t m = 0; m < IPFIX_HH_N_METRICS; m++) {
+        estimates[m] = UINT64_MAX;
+    }
+    for (size_t row = 0; row < IPFIX_HH_DEPTH; row++) {
+        uint64_t *cell = d->sketch[dim][row][ipfix_hh_cell(hash, row)];
+
+        for (size_t m = 0; m < IPFIX_HH_N_METRICS; m++) {
+            cell[m] += weights[m];
+            estimates[m] = MIN(estimates[m], cell[m]);
+        }
+    }
+    for (size_t m = 0; m < IPFIX_HH_N_METRICS; m++) {
+        if (weights[m]) {
+            ipfix_hh_topk_add(&d->topk[dim][m], key, hash, weights[m],
+                              estimates[m]);
+        }
+    }
+}
+
+/* Counts 'flow', from 'obs_domain', in 'hh'. */
+static void
+ipfix_hh_add(struct ipfix_hh *hh, uint32_t obs_domain,
+             const struct ipfix_flow *flow)
+{
+    struct ipfix_hh_domain *d = ipfix_hh_lookup_domain(hh, obs_domain);
+    uint64_t weights[IPFIX_HH_N_METRICS];
+    struct ipfix_hh_key key;
+
+    if (!d) {
+        hh->n_untracked++;
+        return;
+    }
+    weights[IPFIX_HH_PACKETS] = flow->packets;
+    weights[IPFIX_HH_OCTETS] = flow->l2_octor_delta_count;
+
+    if (ipfix_flow_ip(flow, true, (struct in6_addr *) key.b)) {
+        ipfix_hh_update(d, IPFIX_HH_SRC_IP, &key, weights);
+    }
+    if (ipfix_flow_ip(flow, false, (struct in6_addr *) key.b)) {
+        ipfix_hh_update(d, IPFIX_HH_DST_IP, &key, weights);
+    }
+    memcpy(&key.b[0], flow->src_mac, 6);
+    memcpy(&key.b[6], flow->dst_mac, 6);
+    memset(&key.b[12], 0, 4);
+    ipfix_hh_update(d, IPFIX_HH_MAC_PAIR, &key, weights);
+}
+
+/* Same as ipfix_hh_add() for each row of 'cols', decoded from records
+ * that provide the fields in 'present' and no IPv6 addresses. */
+static void
+ipfix_hh_add_columns(struct ipfix_hh *hh, uint32_t obs_domain,
+                     uint64_t present, const struct ipfix_columns *cols)
+{
+    struct ipfix_hh_domain *d = ipfix_hh_lookup_domain(hh, obs_domain);
+    const uint64_t *packets = cols->data[IPFIX_COL_PACKETS];
+    const uint64_t *octets = cols->data[IPFIX_COL_L2_OCTETS];
+    const ovs_be32 *src_ip = cols->data[IPFIX_COL_SRC_IP];
+    const ovs_be32 *dst_ip = cols->data[IPFIX_COL_DST_IP];
+    const uint8_t *src_mac = cols->data[IPFIX_COL_SRC_MAC];
+    const uint8_t *dst_mac = cols->data[IPFIX_COL_DST_MAC];
+    struct ipfix_hh_key key;
+
+    if (!d) {
+        hh->n_untracked += cols->n;
+        return;
+    }
+    for (size_t i = 0; i < cols->n; i++) {
+        uint64_t weights[IPFIX_HH_N_METRICS];
+
+        weights[IPFIX_HH_PACKETS] = packets[i];
+        weights[IPFIX_HH_OCTETS] = octets[i];
+        if (present & IPFIX_F_BIT(IPFIX_F_SRC_IP)) {
+            ipfix_ipv4_mapped((struct in6_addr *) key.b,
+                              (const uint8_t *) &src_ip[i]);
+            ipfix_hh_update(d, IPFIX_HH_SRC_IP, &key, weights);
+        }
+        if (present & IPFIX_F_BIT(IPFIX_F_DST_IP)) {
+            ipfix_ipv4_mapped((struct in6_addr *) key.b,
+                              (const uint8_t *) &dst_ip[i]);
+            ipfix_hh_update(d, IPFIX_HH_DST_IP, &key, weights);
+        }
+        memcpy(&key.b[0], &src_mac[i * 6], 6);
+        memcpy(&key.b[6], &dst_mac[i * 6], 6);
+        memset(&key.b[12], 0, 4);
+        ipfix_hh_update(d, IPFIX_HH_MAC_PAIR, &key, weights);
+    }
+}
+
+static struct ipfix_biflow_table *
+ipfix_biflow_table_create(size_t max, long long int window)
+{
+    struct ipfix_biflow_table *table = xzalloc(sizeof *table);
+
+    table->entries = xmalloc(max * sizeof *table->entries);
+    table->max = max;
+    table->window = window;
+    hmap_init(&table->index);
+    hmap_reserve(&table->index, max);
+    return table;
+}
+
+static void
+ipfix_biflow_table_destroy(struct ipfix_biflow_table *table)
+{
+    if (table) {
+        hmap_destroy(&table->index);
+        free(table->entries);
+        free(table);
+    }
+}
+
+/* If 'type' is the type of the request or the reply of an ICMP or ICMPv6
+ * query, returns the request's type and sets '*request' to whether 'type'
+ * is the request's.  Otherwise, returns -1. */
+static int
+ipfix_icmp_query(uint8_t ip_pro, uint8_t type, bool *request)
+{
+    /* Echo, timestamp, information and address mask; ICMPv6 echo. */
+    static const uint8_t icmp_queries[][2] = {
+        { 8, 0 }, { 13, 14 }, { 15, 16 }, { 17, 18 },
+    };
+    static const uint8_t icmpv6_queries[][2] = {
+        { 128, 129 },
+    };
+    const uint8_t (*queries)[2] = (ip_pro == IPPROTO_ICMP
+                                   ? icmp_queries : icmpv6_queries);
+    size_t n = (ip_pro == IPPROTO_ICMP
+                ? ARRAY_SIZE(icmp_queries) : ARRAY_SIZE(icmpv6_queries));
+
+    for (size_t i = 0; i < n; i++) {
+        if (type == queries[i][0] || type == queries[i][1]) {
+            *request = type == queries[i][0];
+            return queries[i][0];
+        }
+    }
+    return -1;
+}
+
+/* Initializes 'key' from 'flow' and sets '*request' to whether 'flow' is
+ * an ICMP query request.  Returns the side of 'key' that 'flow' goes from,
+ * 0 or 1, or -1 if 'flow' does not carry both IP addresses. */
+static int
+ipfix_biflow_key_init(struct ipfix_biflow_key *key,
+                      const struct ipfix_flow *flow, bool *request)
+{
+    struct in6_addr src, dst;
+    int cmp, side;
+
+    *request = false;
+    if (!ipfix_flow_ip(flow, true, &src)
+        || !ipfix_flow_ip(flow, false, &dst)) {
+        return -1;
+    }
+
+    memset(key, 0, sizeof *key);
+    key->ip_pro = flow->ip_pro;
+    if (flow->ip_pro == IPPROTO_ICMP || flow->ip_pro == IPPROTO_ICMPV6) {
+        int query = ipfix_icmp_query(flow->ip_pro, flow->icmp_type, request);
+
+        key->icmp_type = query >= 0 ? query : flow->icmp_type;
+    }
+
+    cmp = memcmp(&src, &dst, sizeof src);
+    if (!cmp) {
+        cmp = (flow->src_port > flow->dst_port)
+              - (flow->src_port < flow->dst_port);
+    }
+    side = cmp > 0;
+    key->ip[side] = src;
+    key->ip[!side] = dst;
+    key->port[side] = flow->src_port;
+    key->port[!side] = flow->dst_port;
+    return side;
+}
+
+static struct ipfix_biflow *
+ipfix_biflow_find(const struct ipfix_biflow_table *table,
+                  const struct ipfix_biflow_key *key, uint32_t hash)
+{
+    struct ipfix_biflow *b;
+
+    HMAP_FOR_EACH_WITH_HASH (b, hmap_node, hash, &table->index) {
+        if (!memcmp(&b->key, key, sizeof *key)) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+static void
+format_biflow_endpoint(struct ds *s, const struct ipfix_biflow_key *key,
+                       int side)
+{
+    bool v6 = !IN6_IS_ADDR_V4MAPPED(&key->ip[side]);
+
+    if (!key->port[0] && !key->port[1]) {
+        format_capture_addr(s, &key->ip[side]);
+        return;
+    }
+    ds_put_cstr(s, v6 ? "[" : "");
+    format_capture_addr(s, &key->ip[side]);
+    ds_put_format(s, "%s:%"PRIu16, v6 ? "]" : "", key->port[side]);
+}
+
+/* Returns the side of 'b' that is its forward direction (RFC 5103 section
+ * 2): the one that sent the ICMP query request, otherwise the one whose
+ * flow started first. */
+static int
+ipfix_biflow_forward(const struct ipfix_biflow *b)
+{
+    const struct ipfix_biflow_side *sides = b->sides;
+
+    if (!sides[0].n_records || !sides[1].n_records) {
+        return !sides[0].n_records;
+    } else if (sides[0].request != sides[1].request) {
+        return sides[1].request;
+    } else {
+        return sides[1].first < sides[0].first;
+    }
+}
+
+static bool
+ipfix_biflow_asymmetric(const struct ipfix_biflow *b)
+{
+    return (b->sides[0].n_records && b->sides[1].n_records
+            && memcmp(&b->sides[0].exporter, &b->sides[1].exporter,
+                      sizeof b->sides[0].exporter));
+}
+
+/* Appends 'b' to 's' as a biflow record: the totals of its forward
+ * direction, then those of the reverse direction with the time from the
+ * forward flow's start to the reverse flow's start. */
+static void
+format_biflow(struct ds *s, const struct ipfix_biflow *b)
+{
+    int fwd = ipfix_biflow_forward(b);
+    const struct ipfix_biflow_side *f = &b->sides[fwd];
+    const struct ipfix_biflow_side *r = &b->sides[!fwd];
+
+    ds_put_cstr(s, "biflow: ");
+    format_biflow_endpoint(s, &b->key, fwd);
+    ds_put_cstr(s, " > ");
+    format_biflow_endpoint(s, &b->key, !fwd);
+    ds_put_format(s, ", protocol %"PRIu8, b->key.ip_pro);
+    if (b->key.ip_pro == IPPROTO_ICMP || b->key.ip_pro == IPPROTO_ICMPV6) {
+        ds_put_format(s, ", icmp type %"PRIu8, b->key.icmp_type);
+    }
+    ds_put_format(s, ": records %llu, packets %llu, octets %llu",
+                  f->n_records, f->packets, f->octets);
+    if (r->n_records) {
+        ds_put_format(s, "; reverse records %llu, packets %llu, octets %llu, "
+                      "start %+lld ms", r->n_records, r->packets, r->octets,
+                      r->first - f->first);
+        if (ipfix_biflow_asymmetric(b)) {
+            ds_put_cstr(s, ", asymmetric");
+        }
+    } else {
+        ds_put_cstr(s, "; no reverse");
+    }
+    ds_put_char(s, '\n');
+}
+
+/* Prints the oldest biflow of 'table' to 's' and removes it. */
+static void
+ipfix_biflow_pop(struct ipfix_biflow_table *table, struct ds *s)
+{
+    struct ipfix_biflow *b = &table->entries[table->head];
+
+    format_biflow(s, b);
+    if (b->sides[0].n_records && b->sides[1].n_records) {
+        table->n_biflows++;
+        table->n_asymmetric += ipfix_biflow_asymmetric(b);
+    } else {
+        table->n_uniflows++;
+    }
+    hmap_remove(&table->index, &b->hmap_node);
+    table->head = (table->head + 1) % table->max;
+    table->n--;
+}
+
+/* Prints to 's' and removes the biflows of 'table' whose window ended by
+ * 'now', in wall clock ms.  Only the expired entries are visited. */
+static void
+ipfix_biflow_expire(struct ipfix_biflow_table *table, long long int now,
+                    struct ds *s)
+{
+    while (table->n && table->entries[table->head].deadline <= now) {
+        ipfix_biflow_pop(table, s);
+    }
+}
+
+/* Stitches 'flow', from the message with header 'msg_hd' of the exporter
+ * and observation domain of 'key', into 'table' at 'now', in wall clock
+ * ms.  Biflows that expire are printed to 's'. */
+static void
+ipfix_biflow_add(struct ipfix_biflow_table *table,
+                 const struct ipfix_template_key *key,
+                 const struct ipfix_message_header *msg_hd,
+                 const struct ipfix_flow *flow, long long int now,
+                 struct ds *s)
+{
+    long long int export_ms = ntohl(msg_hd->export_time) * 1000LL;
+    struct ipfix_biflow_side *side;
+    struct ipfix_biflow_key bkey;
+    struct ipfix_biflow *b;
+    bool request;
+    uint32_t hash;
+    int dir;
+
+    dir = ipfix_biflow_key_init(&bkey, flow, &request);
+    if (dir < 0) {
+        table->n_skipped++;
+        return;
+    }
+    ipfix_biflow_expire(table, now, s);
+
+    hash = hash_bytes(&bkey, sizeof bkey, 0);
+    b = ipfix_biflow_find(table, &bkey, hash);
+    if (!b) {
+        if (table->n >= table->max) {
+            table->n_early++;
+            ipfix_biflow_pop(table, s);
+        }
+        b = &table->entries[(table->head + table->n) % table->max];
+        memset(b, 0, sizeof *b);
+        b->key = bkey;
+        b->deadline = now + table->window;
+        for (size_t i = 0; i < 2; i++) {
+            b->sides[i].first = LLONG_MAX;
+            b->sides[i].last = LLONG_MIN;
+        }
+        hmap_insert(&table->index, &b->hmap_node, hash);
+        table->n++;
+    }
+
+    side = &b->sides[dir];
+    if (!side->n_records) {
+        side->exporter = *key;
+        side->exporter.template_id = 0;
+    }
+    side->n_records++;
+    side->packets += flow->packets;
+    side->octets += flow->octets;
+    /* The start and end times are microseconds before the export time. */
+    side->first = MIN(side->first, export_ms - flow->start_time / 1000);
+    side->last = MAX(side->last, export_ms - flow->end_time / 1000);
+    side->request |= request;
+    table->n_records++;
+}
+
+/* Arranges to wake up when the oldest biflow of 'table' expires. */
+static void
+ipfix_biflow_wait(const struct ipfix_biflow_table *table)
+{
+    if (table->n) {
+        poll_timer_wait(MAX(0, (table->entries[table->head].deadline
+                                - time_wall_msec())));
+    }
+}
+
+/* Returns the index of the histogram bucket that counts 'v'. */
+static inline size_t
+ipfix_hist_bucket(uint64_t v)
+{
+    int shift;
+
+    if (v < IPFIX_HIST_SUB) {
+        return v;
+    }
+    v = MIN(v, (UINT64_C(1) << IPFIX_HIST_MAX_BITS) - 1);
+    shift = log_2_floor(v) - (IPFIX_HIST_SUB_BITS - 1);
+    return shift * IPFIX_HIST_HALF + (v >> shift);
+}
+
+/* Returns the largest value that bucket 'idx' counts. */
+static uint64_t
+ipfix_hist_bucket_max(size_t idx)
+{
+    uint64_t mantissa;
+    int shift;
+
+    if (idx < IPFIX_HIST_SUB) {
+        return idx;
+    }
+    shift = idx / IPFIX_HIST_HALF - 1;
+    mantissa = idx % IPFIX_HIST_HALF + IPFIX_HIST_HALF;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static inline void
+ipfix_hist_add(struct ipfix_hist *h, uint64_t v)
+{
+    h->counts[ipfix_hist_bucket(v)]++;
+    if (OVS_UNLIKELY(!h->n)) {
+        h->min = h->max = v;
+    } else {
+        h->min = MIN(h->min, v);
+        h->max = MAX(h->max, v);
+    }
+    h->n++;
+    h->sum += v;
+}
+
+/* Adds the values counted in 'src' to 'dst'. */
+static void
+ipfix_hist_merge(struct ipfix_hist *dst, const struct ipfix_hist *src)
+{
+    if (!src->n) {
+        return;
+    }
+    for (size_t i = 0; i < IPFIX_HIST_N_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->min = dst->n ? MIN(dst->min, src->min) : src->min;
+    dst->max = dst->n ? MAX(dst->max, src->max) : src->max;
+    dst->n += src->n;
+    dst->sum += src->sum;
+}
+
+/* Returns the value below which 'pm' per mille of the values in 'h' lie,
+ * rounded up to its bucket's upper bound, or 0 if 'h' is empty. */
+static uint64_t
+ipfix_hist_percentile(const struct ipfix_hist *h, unsigned int pm)
+{
+    uint64_t rank = MAX(1, (h->n * pm + 999) / 1000);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < IPFIX_HIST_N_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            return MIN(ipfix_hist_bucket_max(i), h->max);
+        }
+    }
+    return h->n ? h->max : 0;
+}
+
+static void
+format_hist(struct ds *s, const char *name, const struct ipfix_hist *h,
+            const char *unit)
+{
+    static const unsigned int pms[] = { 500, 900, 990, 999 };
+
+    ds_put_format(s, "  %s: %"PRIu64" samples", name, h->n);
+    if (h->n) {
+        ds_put_format(s, ", min %"PRIu64", mean %"PRIu64, h->min,
+                      h->sum / h->n);
+        for (size_t i = 0; i < ARRAY_SIZE(pms); i++) {
+            ds_put_format(s, ", p%u", pms[i] / 10);
+            if (pms[i] % 10) {
+                ds_put_format(s, ".%u", pms[i] % 10);
+            }
+            ds_put_format(s, " %"PRIu64, ipfix_hist_percentile(h, pms[i]));
+        }
+        ds_put_format(s, ", max %"PRIu64" %s", h->max, unit);
+    }
+    ds_put_char(s, '\n');
+}
+
+/* Returns the time on the monotonic clock, in nanoseconds. */
+static long long int
+ipfix_now_ns(void)
+{
+    struct timespec ts;
+
+    xclock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Sets the probability with which 'stream''s domain samples packets to
+ * 'p', which must be in (0, 1].  Records that the stream has already
+ * accounted for keep the probability they were sampled with. */
+static void
+ipfix_sampling_set(struct ipfix_seq_stream *stream, double p,
+                   enum ipfix_sampling_source source)
+{
+    stream->sampling_source = source;
+    stream->sampling_p = p;
+    stream->sampling_skip = 1.0 / p - 1.0;
+    stream->sampling_var = (1.0 - p) / (p * p);
+}
+
+/* Accounts for a record of 'packets' packets and 'octets' IP octets, whose
+ * sizes' squares sum to 'sum_sq' (0 if unknown), that 'stream' sampled.
+ * Taking each packet as sampled independently with probability p, k
+ * sampled packets estimate k / p packets with variance k (1 - p) / p**2,
+ * and sampled packet sizes s estimate sum(s) / p octets with variance
+ * sum(s**2) (1 - p) / p**2.  Keeping the estimates apart from the sampled
+ * counts leaves only the counting to unsampled domains. */
+static inline void
+ipfix_sampling_add(struct ipfix_seq_stream *stream, uint64_t packets,
+                   uint64_t octets, uint64_t sum_sq)
+{
+    stream->sampled_packets += packets;
+    stream->sampled_octets += octets;
+    if (stream->sampling_var) {
+        stream->unsampled_packets += packets * stream->sampling_skip;
+        stream->unsampled_octets += octets * stream->sampling_skip;
+        stream->var_packets += packets * stream->sampling_var;
+        stream->var_octets += (ipfix_sampling_sum_sq(packets, octets, sum_sq)
+                               * stream->sampling_var);
+    }
+}
+
+/* ipfix_sampling_add() for each row of 'cols'. */
+static void
+ipfix_sampling_add_columns(struct ipfix_seq_stream *stream,
+                           const struct ipfix_columns *cols)
+{
+    const uint64_t *packets = cols->data[IPFIX_COL_PACKETS];
+    const uint64_t *octets = cols->data[IPFIX_COL_OCTETS];
+    const uint64_t *sum_sq = cols->data[IPFIX_COL_DELTA_OC_SQ];
+    uint64_t total_packets = 0, total_octets = 0;
+
+    if (stream->sampling_var) {
+        for (size_t i = 0; i < cols->n; i++) {
+            ipfix_sampling_add(stream, packets[i], octets[i], sum_sq[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < cols->n; i++) {
+        total_packets += packets[i];
+        total_octets += octets[i];
+    }
+    stream->sampled_packets += total_packets;
+    stream->sampled_octets += total_octets;
+}
+
+static struct ipfix_seq_stream *
+ipfix_seq_stream_lookup(struct ipfix_collector *c,
+                        const struct ipfix_template_key *key)
+{
+    struct ipfix_seq_stream *stream = c->last_stream;
+    uint32_t hash;
+
+    if (stream && !memcmp(&stream->key, key, sizeof *key)) {
+        return stream;
+    }
+    hash = ipfix_template_hash(key);
+    HMAP_FOR_EACH_WITH_HASH (stream, hmap_node, hash, &c->streams) {
+        if (!memcmp(&stream->key, key, sizeof *key)) {
+            c->last_stream = stream;
+            return stream;
+        }
+    }
+
+    stream = xzalloc(sizeof *stream);
+    stream->key = *key;
+    ipfix_sampling_set(stream, 1.0 / default_sampling,
+                       (default_sampling > 1 ? IPFIX_SAMPLING_OPTION
+                        : IPFIX_SAMPLING_NONE));
+    hmap_insert(&c->streams, &stream->hmap_node, hash);
+    c->last_stream = stream;
+    return stream;
+}
+
+/* Accounts for a message of 'msg_len' bytes with sequence number 'seq'
+ * and 'n_records' data records in 'stream'.  'uncounted' is true if the
+ * message also held data sets whose records could not be counted, because
+ * their template is unknown.  Unless sequence numbers count messages, the
+ * next message then cannot tell how many records it follows, so a jump in
+ * its sequence number is taken as is rather than as a loss. */
+static void
+ipfix_seq_update(struct ipfix_seq_stream *stream, uint32_t seq,
+                 size_t n_records, bool uncounted, uint16_t msg_len)
+{
+    uint32_t advance = seq_per_message ? 1 : n_records;
+    bool unsure = uncounted && !seq_per_message;
+    int32_t delta = seq - stream->next_seq;
+
+    if (!stream->n_messages) {
+        stream->next_seq = seq + advance;
+        stream->next_seq_unsure = unsure;
+    } else if (delta >= 0) {
+        if (delta && !stream->next_seq_unsure) {
+            stream->n_gaps++;
+            stream->n_lost += delta;
+        }
+        stream->next_seq = seq + advance;
+        stream->next_seq_unsure = unsure;
+    } else if (seq == stream->last_seq && advance) {
+        stream->n_duplicates++;
+    } else if (seq && stream->next_seq - seq <= IPFIX_SEQ_REORDER_WINDOW) {
+        /* A late arrival fills in part of an earlier gap. */
+        stream->n_reorders++;
+        stream->n_lost -= MIN(stream->n_lost, advance);
+    } else {
+        stream->n_resets++;
+        stream->next_seq = seq + advance;
+        stream->next_seq_unsure = unsure;
+    }
+    stream->last_seq = seq;
+    stream->n_messages++;
+    stream->n_records += n_records;
+    stream->n_bytes += msg_len;
+}
+
+/* Returns the unsigned integer of 'len' bytes, in network byte order, at
+ * 'p', or UINT64_MAX if it does not fit. */
+static uint64_t
+ipfix_get_uint(const uint8_t *p, size_t len)
+{
+    uint64_t value = 0;
+
+    if (len > 8) {
+        return UINT64_MAX;
+    }
+    for (size_t i = 0; i < len; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+/* Stores the field with IANA information element 'ie_id' and the 'len'
+ * bytes at 'p' as value in 'rec', if it is one that the collector uses. */
+static void
+ipfix_options_field(struct ipfix_options_rec *rec, uint16_t ie_id,
+                    const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < IPFIX_N_OPTS; i++) {
+        if (ipfix_option_ies[i] != ie_id) {
+            continue;
+        }
+        if (i == IPFIX_OPT_SAMPLING_PROBABILITY) {
+            /* float64, or float32 in reduced-size encoding. */
+            uint64_t bits = ipfix_get_uint(p, len);
+
+            if (len == 8) {
+                memcpy(&rec->probability, &bits, sizeof rec->probability);
+            } else if (len == 4) {
+                uint32_t bits32 = bits;
+                float f;
+
+                memcpy(&f, &bits32, sizeof f);
+                rec->probability = f;
+            } else {
+                return;
+            }
+        } else {
+            rec->values[i] = ipfix_get_uint(p, len);
+        }
+        rec->present |= IPFIX_OPT_BIT(i);
+        return;
+    }
+}
+
+/* Decodes the options data record of 't' at the front of the 'len' bytes
+ * at 'p' into 'rec'.  Returns the record's length, or 0 if it is
+ * truncated. */
+static size_t
+ipfix_parse_options_record(const struct ipfix_template *t,
+                           const uint8_t *p, size_t len,
+                           struct ipfix_options_rec *rec)
+{
+    const uint8_t *start = p, *end = p + len;
+
+    memset(rec, 0, sizeof *rec);
+    for (size_t i = 0; i < t->n_fields; i++) {
+        const struct ipfix_field *f = &t->fields[i];
+        size_t field_len = f->length;
+
+        if (field_len == IPFIX_VARLEN) {
+            if (end - p < 1) {
+                return 0;
+            }
+            field_len = *p++;
+            if (field_len == 255) {
+                if (end - p < 2) {
+                    return 0;
+                }
+                field_len = (p[0] << 8) | p[1];
+                p += 2;
+            }
+        }
+        if (end - p < field_len) {
+            return 0;
+        }
+        if (!f->enterprise) {
+            ipfix_options_field(rec, f->ie_id, p, field_len);
+        }
+        p += field_len;
+    }
+    return p - start;
+}
+
+static bool
+ipfix_options_has(const struct ipfix_options_rec *rec, enum ipfix_option opt)
+{
+    return rec->present & IPFIX_OPT_BIT(opt);
+}
+
+/* Returns the packet sampling probability that 'rec' announces, or 0 if it
+ * announces none.  The most direct of the ways of stating it wins: a
+ * probability (RFC 5477 random sampling), n out of N (random n-out-of-N
+ * sampling), an interval and space (systematic count-based sampling), or
+ * the older 1-in-N intervals (RFC 7270). */
+static double
+ipfix_options_sampling_p(const struct ipfix_options_rec *rec)
+{
+    const uint64_t *v = rec->values;
+    double p = 0;
+
+    if (ipfix_options_has(rec, IPFIX_OPT_SAMPLING_PROBABILITY)) {
+        p = rec->probability;
+    } else if (ipfix_options_has(rec, IPFIX_OPT_SAMPLING_SIZE)
+               && ipfix_options_has(rec, IPFIX_OPT_SAMPLING_POPULATION)
+               && v[IPFIX_OPT_SAMPLING_POPULATION]) {
+        p = ((double) v[IPFIX_OPT_SAMPLING_SIZE]
+             / v[IPFIX_OPT_SAMPLING_POPULATION]);
+    } else if (ipfix_options_has(rec, IPFIX_OPT_PACKET_INTERVAL)
+               && ipfix_options_has(rec, IPFIX_OPT_PACKET_SPACE)
+               && v[IPFIX_OPT_PACKET_INTERVAL]) {
+        p = ((double) v[IPFIX_OPT_PACKET_INTERVAL]
+             / ((double) v[IPFIX_OPT_PACKET_INTERVAL]
+                + v[IPFIX_OPT_PACKET_SPACE]));
+    } else if (ipfix_options_has(rec, IPFIX_OPT_SAMPLER_RANDOM_INTERVAL)
+               && v[IPFIX_OPT_SAMPLER_RANDOM_INTERVAL]) {
+        p = 1.0 / v[IPFIX_OPT_SAMPLER_RANDOM_INTERVAL];
+    } else if (ipfix_options_has(rec, IPFIX_OPT_SAMPLING_INTERVAL)
+               && v[IPFIX_OPT_SAMPLING_INTERVAL]) {
+        p = 1.0 / v[IPFIX_OPT_SAMPLING_INTERVAL];
+    }
+    return p > 0 && p <= 1 ? p : 0;
+}
+
+/* Takes the received totals that the exporter statistics of 'stream' are
+ * compared with: the stream's own or, with process scope, the sum over
+ * every stream of the same exporter. */
+static void
+ipfix_exporter_stats_take(const struct ipfix_collector *c,
+                          struct ipfix_seq_stream *stream)
+{
+    struct ipfix_exporter_stats *es = &stream->exporter_stats;
+    const struct ipfix_seq_stream *s;
+
+    es->pending = false;
+    if (!es->process_scope) {
+        es->rx_messages = stream->n_messages;
+        es->rx_records = stream->n_records;
+        es->rx_bytes = stream->n_bytes;
+        return;
+    }
+
+    es->rx_messages = es->rx_records = es->rx_bytes = 0;
+    HMAP_FOR_EACH (s, hmap_node, &c->streams) {
+        if (!memcmp(&s->key.exporter, &stream->key.exporter,
+                    sizeof s->key.exporter)
+            && s->key.exporter_port == stream->key.exporter_port) {
+            es->rx_messages += s->n_messages;
+            es->rx_records += s->n_records;
+            es->rx_bytes += s->n_bytes;
+        }
+    }
+}
+
+/* Applies the options data record 'rec', from a message of 'stream'.  A
+ * record with an observationDomainId describes that domain; any other
+ * describes the message's domain and, for statistics, the exporting
+ * process.  Statistics about the message's own stream are compared with
+ * what was received once the message has been accounted for. */
+static void
+ipfix_options_apply(struct ipfix_collector *c,
+                    struct ipfix_seq_stream *stream,
+                    const struct ipfix_options_rec *rec)
+{
+    bool domain_scope = ipfix_options_has(rec, IPFIX_OPT_OBS_DOMAIN);
+    struct ipfix_seq_stream *target = stream;
+    double p;
+
+    if (domain_scope
+        && rec->values[IPFIX_OPT_OBS_DOMAIN] != stream->key.obs_domain) {
+        struct ipfix_template_key key = stream->key;
+
+        key.obs_domain = rec->values[IPFIX_OPT_OBS_DOMAIN];
+        target = ipfix_seq_stream_lookup(c, &key);
+    }
+
+    p = ipfix_options_sampling_p(rec);
+    if (p) {
+        ipfix_sampling_set(target, p, IPFIX_SAMPLING_EXPORTER);
+    }
+
+    if (rec->present & IPFIX_OPT_EXPORTER_STATS) {
+        struct ipfix_exporter_stats *es = &target->exporter_stats;
+
+        es->rec = *rec;
+        es->rec.present &= IPFIX_OPT_EXPORTER_STATS;
+        es->process_scope = !domain_scope;
+        if (target == stream) {
+            es->pending = true;
+        } else {
+            ipfix_exporter_stats_take(c, target);
+        }
+    }
+}
+
+/* Decodes and applies every record of the options data set payload of
+ * 'len' bytes at 'p', for template 't', from a message of 'stream'.
+ * Returns the number of records. */
+static size_t
+ipfix_options_data_set(struct ipfix_collector *c,
+                       struct ipfix_seq_stream *stream,
+                       const struct ipfix_template *t,
+                       const uint8_t *p, size_t len)
+{
+    size_t n_records = 0;
+
+    while (len && len >= t->min_record_len) {
+        struct ipfix_options_rec rec;
+        size_t rec_len = ipfix_parse_options_record(t, p, len, &rec);
+
+        if (!rec_len) {
+            ipfix_count(c, IPFIX_CTR_BAD_RECORD, 1);
+            ds_put_format(&c->out, "failed to get IPFIX options data record "
+                          "for template %"PRIu16"\n", t->key.template_id);
+            break;
+        }
+        ipfix_options_apply(c, stream, &rec);
+        p += rec_len;
+        len -= rec_len;
+        n_records++;
+    }
+    ipfix_count(c, IPFIX_CTR_OPTIONS_RECORDS, n_records);
+    return n_records;
+}
+
+/* Records in 'stream' the latency from 'export_time', the export time of a
+ * message in seconds since the epoch, to the arrival of the batch that
+ * holds the message, and returns it in microseconds.
+ *
+ * Export times have a resolution of one second, so a latency is overstated
+ * by up to a second; what the histograms show well is a backlog or clock
+ * skew of seconds or more.  A message exported after it was received, by
+ * the collector's clock, counts as 0 and in 'n_future'. */
+static uint64_t
+ipfix_latency_export(const struct ipfix_collector *c,
+                     struct ipfix_seq_stream *stream, uint32_t export_time)
+{
+    long long int latency = c->rx_usec - export_time * 1000000LL;
+
+    if (latency < 0) {
+        stream->n_future++;
+        latency = 0;
+    }
+    ipfix_hist_add(&stream->export_latency, latency);
+    return latency;
+}
+
+static void
+ipfix_latency_clear(struct ipfix_seq_stream *stream)
+{
+    memset(&stream->export_latency, 0, sizeof stream->export_latency);
+    memset(&stream->record_latency, 0, sizeof stream->record_latency);
+    stream->n_future = 0;
+}
+
+static void
+ipfix_collector_init(struct ipfix_collector *c)
+{
+    hmap_init(&c->templates);
+    c->last_template = NULL;
+    hmap_init(&c->streams);
+    c->last_stream = NULL;
+    c->agg = agg_max_flows ? ipfix_agg_table_create(agg_max_flows) : NULL;
+    c->hh = hh_top_k ? ipfix_hh_create(hh_max_domains, hh_top_k) : NULL;
+    c->biflow = (biflow_window
+                 ? ipfix_biflow_table_create(biflow_max, biflow_window)
+                 : NULL);
+    ds_init(&c->out);
+    c->out_ring = NULL;
+    c->out_deadline = 0;
+    c->capture = NULL;
+    c->n_capture = c->allocated_capture = 0;
+    memset(&c->cols, 0, sizeof c->cols);
+    c->filtered = NULL;
+    c->filtered_size = 0;
+    c->rx_usec = 0;
+    c->counters = xzalloc_cacheline(sizeof *c->counters);
+}
+
+static void
+ipfix_collector_destroy(struct ipfix_collector *c)
+{
+    struct ipfix_seq_stream *stream, *next_stream;
+    struct ipfix_template *t, *next;
+
+    HMAP_FOR_EACH_SAFE (t, next, hmap_node, &c->templates) {
+        hmap_remove(&c->templates, &t->hmap_node);
+        ipfix_template_destroy(t);
+    }
+    hmap_destroy(&c->templates);
+    HMAP_FOR_EACH_SAFE (stream, next_stream, hmap_node, &c->streams) {
+        hmap_remove(&c->streams, &stream->hmap_node);
+        free(stream);
+    }
+    hmap_destroy(&c->streams);
+    ipfix_agg_table_destroy(c->agg);
+    ipfix_hh_destroy(c->hh);
+    ipfix_biflow_table_destroy(c->biflow);
+    ds_destroy(&c->out);
+    free(c->capture);
+    ipfix_columns_destroy(&c->cols);
+    free(c->filtered);
+    free_cacheline(c->counters);
+}
+
+static uint64_t
+ipfix_capture_bloom(const struct in6_addr *exporter)
+{
+    uint32_t hash = hash_bytes(exporter, sizeof *exporter, 0);
+    return (UINT64_C(1) << (hash & 63)) | (UINT64_C(1) << ((hash >> 6) & 63));
+}
+
+static void
+ipfix_capture_header_init(struct ipfix_capture_header *h, const char *magic,
+                          size_t entry_size)
+{
+    memset(h, 0, sizeof *h);
+    memcpy(h->magic, magic, sizeof h->magic);
+    h->version = IPFIX_CAPTURE_VERSION;
+    h->byte_order = IPFIX_CAPTURE_BYTE_ORDER;
+    h->entry_size = entry_size;
+}
+
+/* Checks the header of capture file 'fd', writing one if the file is
+ * empty.  Returns the number of entries the file holds, after dropping
+ * any partially written one, or -1 on error. */
+static off_t
+ipfix_capture_open_file(int fd, const char *name, const char *magic,
+                        size_t entry_size)
+{
+    struct ipfix_capture_header h, expected;
+    struct stat s;
+    off_t n;
+
+    ipfix_capture_header_init(&expected, magic, entry_size);
+    if (fstat(fd, &s)) {
+        VLOG_ERR("%s: stat failed (%s)", name, ovs_strerror(errno));
+        return -1;
+    }
+    if (!s.st_size) {
+        size_t bytes_written;
+        int error = write_fully(fd, &expected, sizeof expected,
+                                &bytes_written);
+        if (error) {
+            VLOG_ERR("%s: write failed (%s)", name, ovs_strerror(error));
+            return -1;
+        }
+        return 0;
+    }
+
+    if (pread(fd, &h, sizeof h, 0) != sizeof h
+        || memcmp(&h, &expected, sizeof h)) {
+        VLOG_ERR("%s: not a capture file of this version and byte order",
+                 name);
+        return -1;
+    }
+    n = (s.st_size - sizeof h) / entry_size;
+    if (ftruncate(fd, sizeof h + n * entry_size)
+        || lseek(fd, 0, SEEK_END) < 0) {
+        VLOG_ERR("%s: truncate failed (%s)", name, ovs_strerror(errno));
+        return -1;
+    }
+    return n;
+}
+
+/* Opens capture 'file_name' and its index for appending. */
+static struct ipfix_capture *
+ipfix_capture_open(const char *file_name)
+{
+    struct ipfix_capture *cap = xzalloc(sizeof *cap);
+    char *index_name = xasprintf("%s.idx", file_name);
+    off_t n;
+
+    cap->file_name = xstrdup(file_name);
+    cap->fd = open(file_name, O_RDWR | O_CREAT, 0666);
+    cap->index_fd = open(index_name, O_RDWR | O_CREAT, 0666);
+    if (cap->fd < 0 || cap->index_fd < 0) {
+        ovs_fatal(errno, "%s: open failed", cap->fd < 0 ? file_name
+                  : index_name);
+    }
+
+    n = ipfix_capture_open_file(cap->fd, file_name, IPFIX_CAPTURE_MAGIC,
+                                sizeof(struct ipfix_capture_rec));
+    if (n < 0 || ipfix_capture_open_file(cap->index_fd, index_name,
+                                         IPFIX_CAPTURE_INDEX_MAGIC,
+                                         sizeof cap->block) < 0) {
+        ovs_fatal(0, "%s: cannot append to capture", file_name);
+    }
+    free(index_name);
+
+    ovs_mutex_init(&cap->mutex);
+    cap->n_records = n;
+    cap->block.first = n;
+    return cap;
+}
+
+static void
+ipfix_capture_write_block(struct ipfix_capture *cap)
+    OVS_REQUIRES(cap->mutex)
+{
+    if (cap->block.n) {
+        size_t bytes_written;
+        int error = write_fully(cap->index_fd, &cap->block, sizeof cap->block,
+                                &bytes_written);
+        if (error) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+            VLOG_WARN_RL(&rl, "%s.idx: write failed (%s)",
+                         cap->file_name, ovs_strerror(error));
+        }
+    }
+    memset(&cap->block, 0, sizeof cap->block);
+    cap->block.first = cap->n_records;
+}
+
+/* Appends the 'n' records in 'recs' to 'cap'. */
+static void
+ipfix_capture_write(struct ipfix_capture *cap,
+                    const struct ipfix_capture_rec *recs, size_t n)
+{
+    size_t bytes_written;
+    int error;
+
+    ovs_mutex_lock(&cap->mutex);
+    error = write_fully(cap->fd, recs, n * sizeof *recs, &bytes_written);
+    if (error) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+        VLOG_WARN_RL(&rl, "%s: write failed (%s)",
+                     cap->file_name, ovs_strerror(error));
+        n = bytes_written / sizeof *recs;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        struct ipfix_capture_block *b = &cap->block;
+        const struct ipfix_capture_rec *rec = &recs[i];
+
+        if (!b->n || rec->export_time < b->min_time) {
+            b->min_time = rec->export_time;
+        }
+        b->max_time = MAX(b->max_time, rec->export_time);
+        b->exporters |= ipfix_capture_bloom(&rec->exporter);
+        b->n++;
+        cap->n_records++;
+        if (b->n >= IPFIX_CAPTURE_BLOCK_RECORDS) {
+            ipfix_capture_write_block(cap);
+        }
+    }
+    ovs_mutex_unlock(&cap->mutex);
+}
+
+static void
+ipfix_capture_close(struct ipfix_capture *cap)
+{
+    if (cap) {
+        ovs_mutex_lock(&cap->mutex);
+        ipfix_capture_write_block(cap);
+        ovs_mutex_unlock(&cap->mutex);
+        close(cap->fd);
+        close(cap->index_fd);
+        ovs_mutex_destroy(&cap->mutex);
+        free(cap->file_name);
+        free(cap);
+    }
+}
+
+/* Queues 'flow' for writing to the capture file. */
+static void
+ipfix_capture_add(struct ipfix_collector *c,
+                  const struct ipfix_template_key *key,
+                  const struct ipfix_message_header *msg_hd,
+                  const struct ipfix_flow *flow)
+{
+    struct ipfix_capture_rec *rec;
+
+    if (c->n_capture >= c->allocated_capture) {
+        c->capture = x2nrealloc(c->capture, &c->allocated_capture,
+                                sizeof *c->capture);
+    }
+    rec = &c->capture[c->n_capture++];
+    memset(rec, 0, sizeof *rec);
+
+    rec->exporter = key->exporter;
+    ipfix_flow_ip(flow, true, &rec->src_ip);
+    ipfix_flow_ip(flow, false, &rec->dst_ip);
+    rec->packets = flow->packets;
+    rec->l2_octets = flow->l2_octor_delta_count;
+    rec->octets = flow->octets;
+    rec->export_time = ntohl(msg_hd->export_time);
+    rec->obs_domain = key->obs_domain;
+    rec->seq = ntohl(msg_hd->seq_number);
+    rec->obs_point_id = flow->obs_point_id;
+    rec->start_time = flow->start_time;
+    rec->end_time = flow->end_time;
+    rec->template_id = key->template_id;
+    rec->eth_type = flow->eth_type;
+    memcpy(rec->src_mac, flow->src_mac, sizeof rec->src_mac);
+    memcpy(rec->dst_mac, flow->dst_mac, sizeof rec->dst_mac);
+    rec->ip_ver = flow->ip_ver;
+    rec->ip_pro = flow->ip_pro;
+    rec->icmp_type = flow->icmp_type;
+    rec->icmp_code = flow->icmp_code;
+    rec->direction_ingress = flow->direction_ingress;
+    rec->flow_end_reason = flow->flow_end_reason;
+}
+
+/* Serializes the workers' writes to the output when there is no writer
+ * thread. */
+static struct ovs_mutex output_mutex = OVS_MUTEX_INITIALIZER;
+
+/* The output: stdout, or --output.  Only one thread at a time writes it,
+ * the writer thread or else the holder of 'output_mutex'. */
+static int output_fd = STDOUT_FILENO;
+static off_t output_size;       /* Bytes in --output so far. */
+
+/* Output totals, updated like struct ipfix_counters by whichever thread
+ * writes the output, and read from any thread. */
+static atomic_ullong output_bytes;
+static atomic_ullong output_writes;
+static atomic_ullong output_errors;
+static atomic_ullong output_rotations;
+
+/*Output queued for the writer thread (--writer-queue).
+ *
+ * Each thread that produces output owns one ring of 'writer_queue'
+ * buffers, which only it fills and only the writer thread drains, so that
+ * neither side takes a lock.  A producer hands over a buffer by swapping
+ * it with an emptied one from the ring, so that in the steady state
+ * neither side copies or allocates, and it never waits for I/O*/
+struct ipfix_out_ring{
+    /* Written only by the producer.  'head' counts the buffers handed
+     * over. */
+    PADDED_MEMBERS(CACHE_LINE_SIZE,
+        atomic_ullong head;
+        atomic_ullong n_dropped;        /* Buffers dropped when full. */
+        atomic_ullong n_dropped_bytes;
+        atomic_ullong n_stalls;         /* Waits for room when full. */
+    );
+
+    /* Written only by the writer.  'tail' counts the buffers written out,
+     * so that the ring holds 'head - tail' buffers. */
+    atomic_ullong tail;
+
+    struct ds *bufs;            /* 'writer_queue' buffers. */
+};
+
+/* The writer thread's rings, one per worker and then one for the main
+ * thread, or NULL without --writer-queue. */
+static struct ipfix_out_ring **out_rings;
+static size_t n_out_rings;
+static pthread_t writer_thread;
+
+/* The writer thread sets 'writer_idle' before it checks the rings for the
+ * last time and sleeps on 'writer_latch'.  A producer reads it after it
+ * hands over a buffer, and sets the latch if it is true, so that the
+ * writer either sees the buffer or wakes up, while a busy writer costs the
+ * producers no system call.  The writer changes 'writer_seq' after it
+ * makes room in the rings. */
+static atomic_bool writer_idle;
+static atomic_bool writer_exiting;
+static struct latch writer_latch;
+static struct seq *writer_seq;
+
+/* Opens --output for appending and makes it the output.  Returns 0 if
+ * successful, otherwise a positive errno value. */
+static int
+ipfix_output_open(void)
+{
+    struct stat s;
+    int fd;
+
+    fd = open(output_file, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (fd < 0) {
+        return errno;
+    }
+    if (output_fd != STDOUT_FILENO) {
+        close(output_fd);
+    }
+    output_fd = fd;
+    output_size = fstat(fd, &s) ? 0 : s.st_size;
+    return 0;
+}
+
+/* Renames --output to FILE.1, FILE.1 to FILE.2, and so on up to
+ * --rotate-keep, and starts a new FILE. */
+static void
+ipfix_output_rotate(void)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+    int error;
+
+    for (int i = rotate_keep; i > 0; i--) {
+        char *old = (i > 1 ? xasprintf("%s.%d", output_file, i - 1)
+                     : xstrdup(output_file));
+        char *new = xasprintf("%s.%d", output_file, i);
+
+        if (rename(old, new) && errno != ENOENT) {
+            VLOG_WARN_RL(&rl, "%s: rename to %s failed (%s)",
+                         old, new, ovs_strerror(errno));
+        }
+        free(old);
+        free(new);
+    }
+
+    error = ipfix_output_open();
+    if (error) {
+        /* Keep appending to the renamed file. */
+        VLOG_WARN_RL(&rl, "%s: open failed (%s)",
+                     output_file, ovs_strerror(error));
+        return;
+    }
+    ipfix_counter_add(&output_rotations, 1);
+}
+
+/* Writes the 'len' bytes at 'data' to the output, first rotating --output
+ * if they would take it past --rotate-bytes.  See 'output_fd' for which
+ * thread may call this. */
+static void
+ipfix_output_write(const char *data, size_t len)
+{
+    size_t bytes_written;
+    int error;
+
+    if (rotate_bytes && output_size && output_size + len > rotate_bytes) {
+        ipfix_output_rotate();
+    }
+    error = write_fully(output_fd, data, len, &bytes_written);
+    output_size += bytes_written;
+    ipfix_counter_add(&output_bytes, bytes_written);
+    ipfix_counter_add(&output_writes, 1);
+    if (error) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+        VLOG_WARN_RL(&rl, "write to %s failed (%s)",
+                     output_file ? output_file : "stdout",
+                     ovs_strerror(error));
+        ipfix_counter_add(&output_errors, 1);
+    }
+}
+
+/* Hands 's' over to the writer thread through 'ring', which the caller
+ * owns, and leaves 's' empty.  If the ring is full, drops the contents of
+ * 's' or waits for room, according to --writer-full. */
+static void
+ipfix_out_ring_push(struct ipfix_out_ring *ring, struct ds *s)
+{
+    unsigned long long int head, tail;
+    struct ds *buf, tmp;
+    bool idle;
+
+    atomic_read_relaxed(&ring->head, &head);
+    atomic_read_explicit(&ring->tail, &tail, memory_order_acquire);
+    if (head - tail >= writer_queue) {
+        if (writer_drop) {
+            ipfix_counter_add(&ring->n_dropped, 1);
+            ipfix_counter_add(&ring->n_dropped_bytes, s->length);
+            ds_clear(s);
+            return;
+        }
+
+        ipfix_counter_add(&ring->n_stalls, 1);
+        for (;;) {
+            uint64_t seqno = seq_read(writer_seq);
+
+            atomic_read_explicit(&ring->tail, &tail, memory_order_acquire);
+            if (head - tail < writer_queue) {
+                break;
+            }
+            seq_wait(writer_seq, seqno);
+            poll_block();
+        }
+    }
+
+    buf = &ring->bufs[head % writer_queue];
+    tmp = *buf;
+    *buf = *s;
+    *s = tmp;
+    atomic_store(&ring->head, head + 1);
+    atomic_read(&writer_idle, &idle);
+    if (idle) {
+        latch_set(&writer_latch);
+    }
+}
+
+/* Writes out every buffer queued in the rings.  Returns true if there was
+ * any. */
+static bool
+ipfix_writer_drain(void)
+{
+    bool any = false;
+
+    for (size_t i = 0; i < n_out_rings; i++) {
+        struct ipfix_out_ring *ring = out_rings[i];
+        unsigned long long int head, tail;
+
+        atomic_read(&ring->head, &head);
+        atomic_read_relaxed(&ring->tail, &tail);
+        for (; tail != head; tail++) {
+            struct ds *buf = &ring->bufs[tail % writer_queue];
+
+            ipfix_output_write(buf->string, buf->length);
+            ds_clear(buf);
+            atomic_store_explicit(&ring->tail, tail + 1,
+                                  memory_order_release);
+            any = true;
+        }
+    }
+    if (any) {
+        seq_change(writer_seq);
+    }
+    return any;
+}
+
+static void *
+ipfix_writer_main(void *aux OVS_UNUSED)
+{
+    for (;;) {
+        bool exiting;
+
+        /* Everything queued before the exit request is written out. */
+        atomic_read(&writer_exiting, &exiting);
+        if (ipfix_writer_drain()) {
+            continue;
+        } else if (exiting) {
+            break;
+        }
+
+        atomic_store(&writer_idle, true);
+        if (!ipfix_writer_drain()) {
+            latch_wait(&writer_latch);
+            poll_block();
+            latch_poll(&writer_latch);
+        }
+        atomic_store(&writer_idle, false);
+    }
+    return NULL;
+}
+
+/* Creates 'n' rings, one for each thread that produces output, and starts
+ * the writer thread. */
+static void
+ipfix_writer_start(size_t n)
+{
+    n_out_rings = n;
+    out_rings = xmalloc(n * sizeof *out_rings);
+    for (size_t i = 0; i < n; i++) {
+        struct ipfix_out_ring *ring = xzalloc_cacheline(sizeof *ring);
+
+        ring->bufs = xmalloc(writer_queue * sizeof *ring->bufs);
+        for (size_t j = 0; j < writer_queue; j++) {
+            ds_init(&ring->bufs[j]);
+        }
+        out_rings[i] = ring;
+    }
+    latch_init(&writer_latch);
+    writer_seq = seq_create();
+    writer_thread = ovs_thread_create("ipfix_writer", ipfix_writer_main,
+                                      NULL);
+}
+
+/* Waits for the writer thread to write out everything queued, which must
+ * not grow any more, and stops it. */
+static void
+ipfix_writer_stop(void)
+{
+    if (!out_rings) {
+        return;
+    }
+    atomic_store(&writer_exiting, true);
+    latch_set(&writer_latch);
+    xpthread_join(writer_thread, NULL);
+
+    for (size_t i = 0; i < n_out_rings; i++) {
+        struct ipfix_out_ring *ring = out_rings[i];
+
+        for (size_t j = 0; j < writer_queue; j++) {
+            ds_destroy(&ring->bufs[j]);
+        }
+        free(ring->bufs);
+        free_cacheline(ring);
+    }
+    free(out_rings);
+    out_rings = NULL;
+    n_out_rings = 0;
+    latch_destroy(&writer_latch);
+    seq_destroy(writer_seq);
+}
+
+/* Writes out 's', output of the main thread, and leaves it empty. */
+static void
+ipfix_main_output(struct ds *s)
+{
+    if (out_rings) {
+        ipfix_out_ring_push(out_rings[n_out_rings - 1], s);
+    } else {
+        ovs_mutex_lock(&output_mutex);
+        ipfix_output_write(s->string, s->length);
+        ovs_mutex_unlock(&output_mutex);
+        ds_clear(s);
+    }
+}
+
+/* Writes out everything 'c' has printed so far with a single write(), or
+ * hands it over to the writer thread, and writes its queued capture
+ * records. */
+static void
+ipfix_collector_flush(struct ipfix_collector *c)
+{
+    if (c->n_capture) {
+        ipfix_capture_write(capture, c->capture, c->n_capture);
+        c->n_capture = 0;
+    }
+    if (c->out_ring) {
+        if (c->out.length) {
+            ipfix_out_ring_push(c->out_ring, &c->out);
+        }
+    } else if (c->out.length) {
+        ovs_mutex_lock(&output_mutex);
+        ipfix_output_write(c->out.string, c->out.length);
+        ovs_mutex_unlock(&output_mutex);
+        ds_clear(&c->out);
+    }
+    c->out_deadline = 0;
+}
+
+/* Prints the biflows of 'c' whose window ended, then writes out 'c''s
+ * output if it crossed the size or time threshold. */
+static void
+ipfix_collector_run(struct ipfix_collector *c)
+{
+    size_t pending;
+
+    if (c->biflow) {
+        ipfix_biflow_expire(c->biflow, time_wall_msec(), &c->out);
+    }
+    pending = c->out.length + c->n_capture * sizeof *c->capture;
+    if (!pending) {
+        return;
+    }
+    if (!flush_bytes || pending >= flush_bytes) {
+        ipfix_collector_flush(c);
+        return;
+    }
+
+    if (!c->out_deadline) {
+        c->out_deadline = time_msec() + flush_ms;
+    } else if (time_msec() >= c->out_deadline) {
+        ipfix_collector_flush(c);
+    }
+}
+
+/* Stores the fields of the OVS data template for the given classification
+ * into 'fields' and returns their number. */
+static size_t
+ipfix_ovs_template_fields(enum ipfix_proto_l2 l2, enum ipfix_proto_l3 l3,
+                          enum ipfix_proto_l4 l4,
+                          enum ipfix_proto_tunnel tunnel,
+                          struct ipfix_field fields[IPFIX_OVS_MAX_FIELDS])
+{
+    size_t n = 0;
+
+#define IPFIX_LAYOUT_FIELD(ENTERPRISE, IE, LEN, KIND, MEMBER)            \
+    ovs_assert(n < IPFIX_OVS_MAX_FIELDS);                               \
+    fields[n].enterprise = ENTERPRISE;                                  \
+    fields[n].ie_id = IPFIX_IE_##IE;                                    \
+    fields[n].length = LEN;                                             \
+    n++;
+    IPFIX_OVS_TEMPLATE_FIELDS(l2, l3, l4, tunnel, IPFIX_LAYOUT_FIELD);
+#undef IPFIX_LAYOUT_FIELD
+
+    return n;
+}
+
+static void
+ipfix_builtin_templates_init(void)
+{
+    struct ipfix_template_key key;
+
+    if (ipfix_builtins[0]) {
+        return;
+    }
+
+    for (int l2 = 0; l2 < NUM_IPFIX_PROTO_L2; l2++) {
+        for (int l3 = 0; l3 < NUM_IPFIX_PROTO_L3; l3++) {
+            for (int l4 = 0; l4 < NUM_IPFIX_PROTO_L4; l4++) {
+                if (l3 == IPFIX_PROTO_L3_UNKNOWN
+                    && l4 != IPFIX_PROTO_L4_UNKNOWN) {
+                    continue;
+                }
+                for (int tunnel = 0; tunnel < NUM_IPFIX_PROTO_TUNNEL;
+                     tunnel++) {
+                    uint16_t id = ipfix_ovs_template_id(l2, l3, l4, tunnel);
+                    struct ipfix_ovs_layout *l
+                        = &ipfix_ovs_layouts[id - IPFIX_SET_ID_DATA_MIN];
+
+                    l->n_fields = ipfix_ovs_template_fields(l2, l3, l4,
+                                                            tunnel,
+                                                            l->fields);
+                    if (tunnel == IPFIX_PROTO_NOT_TUNNELED) {
+                        l->fast_decode = ipfix_fast_decoders[l2][l3][l4];
+                    }
+                }
+            }
+        }
+    }
+
+    memset(&key, 0, sizeof key);
+    for (size_t i = 0; i < IPFIX_N_OVS_TEMPLATE_IDS; i++) {
+        const struct ipfix_ovs_layout *l = &ipfix_ovs_layouts[i];
+        struct ipfix_template *t;
+
+        if (!l->n_fields) {
+            continue;
+        }
+        key.template_id = IPFIX_SET_ID_DATA_MIN + i;
+        t = ipfix_template_compile(&key, l->fields, l->n_fields, 0);
+
+        /* A specialized decoder must consume exactly its layout. */
+        if (l->fast_decode) {
+            uint8_t rec[IPFIX_OVS_MAX_FIELDS * 16];
+            struct ipfix_flow flow;
+
+            memset(rec, 0, sizeof rec);
+            ovs_assert(t->record_len && t->record_len <= sizeof rec);
+            ovs_assert(l->fast_decode(rec, &flow) == t->record_len);
+        }
+        ipfix_builtins[i] = t;
+    }
+
+    ovs_assert(ipfix_builtins[IPFIX_TEMPLATE_ID_ETH - IPFIX_SET_ID_DATA_MIN]
+               ->record_len == IPFIX_DATA_RECORD_ETH_LEN);
+    ovs_assert(ipfix_builtins[IPFIX_TEMPLATE_ID_ICMP - IPFIX_SET_ID_DATA_MIN]
+               ->record_len == IPFIX_DATA_RECORD_ICMP_LEN);
+}
+
+/* Converts the source address of a datagram into template scope. */
+static void
+ipfix_exporter_from_ss(const struct sockaddr_storage *ss,
+                       struct ipfix_template_key *key)
+{
+    memset(key, 0, sizeof *key);
+    if (ss->ss_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *) ss;
+        ipfix_ipv4_mapped(&key->exporter,
+                          (const uint8_t *) &sin->sin_addr);
+        key->exporter_port = sin->sin_port;
+    } else if (ss->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) ss;
+        key->exporter = sin6->sin6_addr;
+        key->exporter_port = sin6->sin6_port;
+    }
+}
+
+static void
+print_message_header(struct ds *s, const struct ipfix_message_header *msg_hd){
+    char *p = out_begin(s);
+
+    //print ipfix header
+    p = EMIT_LITERAL(p, "header: v");
+    p = emit_u64(p, ntohs(msg_hd->version));
+    p = EMIT_LITERAL(p, ", length ");
+    p = emit_u64(p, ntohs(msg_hd->length));
+    p = EMIT_LITERAL(p, ", seq ");
+    p = emit_u64(p, ntohl(msg_hd->seq_number));
+    p = EMIT_LITERAL(p, ", ovservation domain ");
+    p = emit_u64(p, ntohl(msg_hd->obs_dmID));
+    *p++ = '\n';
+    out_end(s, p);
+}
+
+static void
+print_set_header(struct ds *s, uint16_t set_id, uint16_t set_len){
+    char *p = out_begin(s);
+
+    //print ipfix set header
+    p = EMIT_LITERAL(p, "set header: setId ");
+    p = emit_u64(p, set_id);
+    p = EMIT_LITERAL(p, ", set length ");
+    p = emit_u64(p, set_len);
+    *p++ = '\n';
+    out_end(s, p);
+}
+
+/* Hands one decoded record to every enabled consumer.  'key' identifies
+ * the record's exporter, observation domain and template, and 'stream' the
+ * domain's sequence and sampling state. */
+static void
+ipfix_process_flow(struct ipfix_collector *c,
+                   const struct ipfix_template_key *key,
+                   struct ipfix_seq_stream *stream,
+                   const struct ipfix_message_header *msg_hd,
+                   const struct ipfix_flow *flow)
+{
+    ipfix_sampling_add(stream, flow->packets, flow->octets,
+                       flow->delta_oc_sq);
+    if (print_records) {
+        print_flow(&c->out, flow);
+    }
+    if (capture) {
+        ipfix_capture_add(c, key, msg_hd, flow);
+    }
+    if (c->agg) {
+        ipfix_agg_add(c->agg, stream, msg_hd, flow);
+    }
+    if (c->hh) {
+        ipfix_hh_add(c->hh, key->obs_domain, flow);
+    }
+    if (c->biflow) {
+        ipfix_biflow_add(c->biflow, key, msg_hd, flow, c->rx_usec / 1000,
+                         &c->out);
+    }
+}
+
+/* Copies those of the 'n' fixed-length records of 't' at 'p' that match
+ * --filter into 'c''s 'filtered' buffer, and returns their number. */
+static size_t
+ipfix_filter_records(struct ipfix_collector *c,
+                     const struct ipfix_template *t, const uint8_t *p,
+                     size_t n)
+{
+    size_t n_match = 0;
+
+    if (n * t->record_len > c->filtered_size) {
+        c->filtered_size = MAX(n * t->record_len, 2 * c->filtered_size);
+        free(c->filtered);
+        c->filtered = xmalloc(c->filtered_size);
+    }
+    for (size_t i = 0; i < n; i++, p += t->record_len) {
+        if (ipfix_filter_match(t, p, t->record_len)) {
+            memcpy(&c->filtered[n_match++ * t->record_len], p,
+                   t->record_len);
+        }
+    }
+    return n_match;
+}
+
+/* Decodes and processes every record of the data set payload of 'len'
+ * bytes at 'p' that matches --filter.  Trailing bytes too short to hold a
+ * record are padding (RFC 7011 section 3.3.1).  Records with a flow end
+ * time add their latency, 'export_latency' plus the time from flow end to
+ * export, to 'stream'.  Returns the number of records in the set, whether
+ * or not they matched. */
+static size_t
+print_data_set(struct ipfix_collector *c, const struct ipfix_template_key *key,
+               const struct ipfix_message_header *msg_hd,
+               struct ipfix_seq_stream *stream, uint64_t export_latency,
+               const struct ipfix_template *t, const uint8_t *p, size_t len){
+    bool has_end = t->present & IPFIX_F_BIT(IPFIX_F_END_TIME);
+    size_t n_records = 0, n_filtered = 0;
+    struct ipfix_flow flow;
+
+    /* Without per-record stages, a set of many fixed-layout records is
+     * decoded column by column. */
+    if (t->columnar && ipfix_kernels
+        && len / t->record_len >= IPFIX_COLUMNS_MIN_RECORDS
+        && !print_records && !capture && !c->agg && !c->biflow
+        && !(t->present & (IPFIX_F_BIT(IPFIX_F_SRC_IPV6)
+                           | IPFIX_F_BIT(IPFIX_F_DST_IPV6)))) {
+        size_t n_rows;
+
+        n_records = len / t->record_len;
+        if (filter) {
+            n_rows = ipfix_filter_records(c, t, p, n_records);
+            ipfix_count(c, IPFIX_CTR_FILTERED, n_records - n_rows);
+            p = c->filtered;
+        } else {
+            n_rows = n_records;
+        }
+        ipfix_decode_columns(t, p, n_rows, &c->cols);
+        if (has_end) {
+            const uint32_t *end = c->cols.data[IPFIX_COL_END_TIME];
+
+            for (size_t i = 0; i < n_rows; i++) {
+                ipfix_hist_add(&stream->record_latency,
+                               export_latency + end[i]);
+            }
+        }
+        if (c->hh) {
+            ipfix_hh_add_columns(c->hh, key->obs_domain, t->present,
+                                 &c->cols);
+        }
+        ipfix_sampling_add_columns(stream, &c->cols);
+        return n_records;
+    }
+
+    while (len && len >= t->min_record_len) {
+        /* A truncated record is left for the decoder to report. */
+        size_t rec_len = filter ? ipfix_record_length(t, p, len) : 0;
+
+        if (rec_len && !ipfix_filter_match(t, p, rec_len)) {
+            n_filtered++;
+        } else {
+            rec_len = ipfix_decode_record(t, p, len, &flow);
+            if (!rec_len) {
+                ipfix_count(c, IPFIX_CTR_BAD_RECORD, 1);
+                ds_put_format(&c->out, "failed to get IPFIX data record "
+                              "for template %"PRIu16"\n", key->template_id);
+                break;
+            }
+            ipfix_process_flow(c, key, stream, msg_hd, &flow);
+            if (has_end) {
+                ipfix_hist_add(&stream->record_latency,
+                               export_latency + flow.end_time);
+            }
+        }
+        p += rec_len;
+        len -= rec_len;
+        n_records++;
+    }
+    if (n_filtered) {
+        ipfix_count(c, IPFIX_CTR_FILTERED, n_filtered);
+    }
+    return n_records;
+}
+
+/* Decodes the IPFIX message at the front of 'buf', walking every set it
+ * contains within the bounds of the message and set 'length' fields.
+ * Returns the number of data records printed. */
+static size_t
+print_ipfix(struct ipfix_collector *c, const struct sockaddr_storage *from,
+            struct ofpbuf *buf){
+
+    const struct ipfix_message_header *msg_hd;
+    struct ipfix_seq_stream *stream;
+    struct ipfix_template_key key;
+    bool header_printed = false;
+    uint64_t export_latency;
+    size_t n_records = 0;
+    bool uncounted = false;
+    struct ofpbuf msg;
+    uint16_t msg_len;
+
+    msg_hd = ofpbuf_try_pull(buf, IPFIX_MES_HEADER_LEN);
+    if(!msg_hd ){
+        ipfix_count(c, IPFIX_CTR_SHORT_HEADER, 1);
+        ds_put_format(&c->out, "failed to get IPFIX packet header\n");
+        return 0;
+    }
+
+    msg_len = ntohs(msg_hd->length);
+    if (msg_len < IPFIX_MES_HEADER_LEN
+        || msg_len - IPFIX_MES_HEADER_LEN > buf->size) {
+        ipfix_count(c, IPFIX_CTR_BAD_LENGTH, 1);
+        ds_put_format(&c->out, "failed to get IPFIX message of length "
+                      "%"PRIu16"\n", msg_len);
+        return 0;
+    }
+    ofpbuf_use_const(&msg, ofpbuf_pull(buf, msg_len - IPFIX_MES_HEADER_LEN),
+                     msg_len - IPFIX_MES_HEADER_LEN);
+    if (!msg.size) {
+        ipfix_count(c, IPFIX_CTR_EMPTY_MESSAGE, 1);
+        ds_put_format(&c->out, "failed to get IPFIX set header\n");
+        return 0;
+    }
+
+    ipfix_exporter_from_ss(from, &key);
+    key.obs_domain = ntohl(msg_hd->obs_dmID);
+    stream = ipfix_seq_stream_lookup(c, &key);
+    export_latency = ipfix_latency_export(c, stream,
+                                          ntohl(msg_hd->export_time));
+
+    while (msg.size) {
+        const struct ipfix_set_header *set_hd;
+        const struct ipfix_template *t;
+        uint16_t set_id, set_len;
+        const uint8_t *payload;
+        size_t n;
+
+        set_hd = ofpbuf_try_pull(&msg, IPFIX_SET_HEADER_LEN);
+        if(!set_hd){
+            ipfix_count(c, IPFIX_CTR_SHORT_SET_HEADER, 1);
+            ds_put_format(&c->out, "failed to get IPFIX set header\n");
+            break;
+        }
+        set_id = ntohs(set_hd->set_id);
+        set_len = ntohs(set_hd->length);
+        if (set_len < IPFIX_SET_HEADER_LEN
+            || set_len - IPFIX_SET_HEADER_LEN > msg.size) {
+            ipfix_count(c, IPFIX_CTR_BAD_SET_LENGTH, 1);
+            ds_put_format(&c->out, "failed to get IPFIX set\n");
+            break;
+        }
+        payload = ofpbuf_pull(&msg, set_len - IPFIX_SET_HEADER_LEN);
+
+        if (set_id == IPFIX_SET_ID_TEMPLATE
+            || set_id == IPFIX_SET_ID_OPTIONS_TEMPLATE) {
+            ipfix_count(c, IPFIX_CTR_TEMPLATE_SETS, 1);
+            ipfix_parse_template_set(c, &key,
+                                     set_id == IPFIX_SET_ID_OPTIONS_TEMPLATE,
+                                     payload, set_len - IPFIX_SET_HEADER_LEN);
+            continue;
+        } else if (set_id < IPFIX_SET_ID_DATA_MIN) {
+            ipfix_count(c, IPFIX_CTR_SKIPPED_SET, 1);
+            continue;
+        }
+
+        key.template_id = set_id;
+        t = ipfix_template_find(c, &key);
+        if (!t) {
+            t = (set_id - IPFIX_SET_ID_DATA_MIN < IPFIX_N_OVS_TEMPLATE_IDS
+                 ? ipfix_builtins[set_id - IPFIX_SET_ID_DATA_MIN]
+                 : NULL);
+            if (!t) {
+                ipfix_count(c, IPFIX_CTR_UNKNOWN_SET, 1);
+                uncounted = true;
+                continue;
+            }
+        }
+
+        /* Options data is not printed.  Skip the headers of a set that
+         * --filter drops as a whole. */
+        if (t->n_scope_fields) {
+            n = ipfix_options_data_set(c, stream, t, payload,
+                                       set_len - IPFIX_SET_HEADER_LEN);
+            n_records += n;
+            continue;
+        } else if (print_records && (!filter || t->n_filter_ops)) {
+            if (!header_printed) {
+                print_message_header(&c->out, msg_hd);
+                header_printed = true;
+            }
+            print_set_header(&c->out, set_id, set_len);
+        }
+
+        n = print_data_set(c, &key, msg_hd, stream, export_latency, t,
+                           payload, set_len - IPFIX_SET_HEADER_LEN);
+        ipfix_count(c, IPFIX_CTR_SET_RECORDS
+                    + MIN(set_id - IPFIX_SET_ID_DATA_MIN,
+                          IPFIX_N_OVS_TEMPLATE_IDS), n);
+        n_records += n;
+    }
+
+    ipfix_seq_update(stream, ntohl(msg_hd->seq_number), n_records,
+                     uncounted, msg_len);
+    if (stream->exporter_stats.pending) {
+        ipfix_exporter_stats_take(c, stream);
+    }
+    ipfix_count(c, IPFIX_CTR_MESSAGES, 1);
+    ipfix_count(c, IPFIX_CTR_BYTES, msg_len);
+    ipfix_count(c, IPFIX_CTR_RECORDS, n_records);
+    VLOG_DBG("message seq %"PRIu32": %"PRIuSIZE" data records",
+             ntohl(msg_hd->seq_number), n_records);
+    return n_records;
+}
+
+/*Preallocated buffers that one recvmmsg() call fills, or with --io-uring
+ * views of the datagrams that an io_uring received*/
+struct ipfix_rx_ring{
+    size_t n;                   /* Number of slots, i.e. the batch size. */
+    struct ofpbuf *bufs;        /* Datagram buffers, one per slot. */
+    struct sockaddr_storage *from;  /* Source address, one per slot. */
+    bool *truncated;            /* Datagram was larger than its buffer. */
+#ifdef __linux__
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+#endif
+    struct ipfix_uring *uring;  /* With --io-uring, else NULL. */
+
+    /* Statistics. */
+    unsigned long long int n_batches;   /* Nonempty batches received. */
+    unsigned long long int n_datagrams; /* Datagrams received. */
+    unsigned long long int n_drained;   /* Nonempty batches that emptied the
+                                         * socket. */
+    unsigned long long int n_truncated; /* Datagrams cut by MSG_TRUNC. */
+    size_t max_fill;                    /* Largest batch received. */
+};
+
+#ifdef IPFIX_HAVE_IO_URING
+/* Buffer group of the provided buffers, the only group in each ring. */
+#define IPFIX_URING_BGID 0
+
+/*An io_uring with a multishot recvmsg armed on one datagram socket.  The
+ * kernel receives each datagram into a buffer that it takes from a ring of
+ * provided buffers and posts a completion naming that buffer.  The worker
+ * reaps completions and hands buffers back through shared memory, so a
+ * busy socket costs no system call at all*/
+struct ipfix_uring{
+    int fd;                     /* io_uring file descriptor. */
+    int sock;                   /* Socket that the recvmsg reads. */
+    struct msghdr msg;          /* Lengths of name and control to reserve. */
+    bool armed;                 /* Is the multishot recvmsg still active? */
+
+    /* Submission queue. */
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    /* Completion queue, in 'sq_ring''s mapping if 'cq_ring' is NULL. */
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* 'n_bufs' provided buffers of 'buf_size' bytes each in 'bufs',
+     * offered to the kernel through 'br'.  'n_bufs' is a power of 2. */
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    uint16_t br_tail;
+    uint8_t *bufs;
+    size_t buf_size;
+    unsigned int n_bufs;
+
+    /* Buffers holding the last batch, handed back before the next one. */
+    uint16_t *held;
+    size_t n_held;
+
+    /* Statistics. */
+    unsigned long long int n_arms;      /* Multishot recvmsg submissions. */
+    unsigned long long int n_nobufs;    /* Stops for lack of a buffer. */
+    unsigned long long int n_errors;    /* Failed completions. */
+};
+
+/* Maps 'size' bytes of io_uring 'fd' at 'offset', or anonymous memory if
+ * 'fd' is negative.  Returns NULL on failure, with errno set. */
+static void *
+ipfix_uring_mmap(int fd, size_t size, off_t offset)
+{
+    void *p = (fd < 0
+               ? mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+               : mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, offset));
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/* Queues buffer 'bid' for the kernel.  It becomes available to the kernel
+ * at the next ipfix_uring_publish(). */
+static void
+ipfix_uring_offer(struct ipfix_uring *u, uint16_t bid)
+{
+    struct io_uring_buf *buf;
+
+    buf = &u->br->bufs[u->br_tail++ & (u->n_bufs - 1)];
+    buf->addr = (uintptr_t) &u->bufs[bid * u->buf_size];
+    buf->len = u->buf_size;
+    buf->bid = bid;
+}
+
+static void
+ipfix_uring_publish(struct ipfix_uring *u)
+{
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+/* Submits the multishot recvmsg, unless an earlier submission is still
+ * queued, in which case it only retries the system call.  Returns 0 if
+ * successful, otherwise a positive errno value. */
+static int
+ipfix_uring_arm(struct ipfix_uring *u)
+{
+    unsigned int tail = *u->sq_tail;
+    int retval;
+
+    if (__atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) == tail) {
+        unsigned int idx = tail & u->sq_mask;
+        struct io_uring_sqe *sqe = &u->sqes[idx];
+
+        memset(sqe, 0, sizeof *sqe);
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = u->sock;
+        sqe->addr = (uintptr_t) &u->msg;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = IPFIX_URING_BGID;
+        u->sq_array[idx] = idx;
+        __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    do {
+        retval = syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0);
+    } while (retval < 0 && errno == EINTR);
+    if (retval < 0) {
+        return errno;
+    }
+    u->armed = true;
+    u->n_arms++;
+    return 0;
+}
+
+static void
+ipfix_uring_destroy(struct ipfix_uring *u)
+{
+    if (u) {
+        if (u->fd >= 0) {
+            close(u->fd);
+        }
+        if (u->sq_ring) {
+            munmap(u->sq_ring, u->sq_ring_size);
+        }
+        if (u->cq_ring) {
+            munmap(u->cq_ring, u->cq_ring_size);
+        }
+        if (u->sqes) {
+            munmap(u->sqes, u->sqes_size);
+        }
+        if (u->br) {
+            munmap(u->br, u->br_size);
+        }
+        if (u->bufs) {
+            munmap(u->bufs, u->n_bufs * u->buf_size);
+        }
+        free(u->held);
+        free(u);
+    }
+}
+
+/* Creates an io_uring that receives datagrams from 'sock' into 'n_bufs'
+ * provided buffers, 'n_bufs' a power of 2, for batches of up to 'batch'
+ * datagrams.  Returns 0 and stores the io_uring in '*up' if successful,
+ * otherwise a positive errno value: ENOSYS or EPERM if io_uring is
+ * unavailable or disabled, EINVAL if the kernel predates provided buffer
+ * rings (Linux 5.19) or multishot recvmsg (Linux 6.0). */
+static int
+ipfix_uring_create(int sock, unsigned int n_bufs, size_t batch,
+                   struct ipfix_uring **up)
+{
+    struct io_uring_buf_reg reg;
+    struct io_uring_params p;
+    struct ipfix_uring *u;
+    unsigned int head;
+    uint8_t *cq;
+    int error;
+
+    u = xzalloc(sizeof *u);
+    u->sock = sock;
+    u->msg.msg_namelen = sizeof(struct sockaddr_storage);
+    u->held = xmalloc(batch * sizeof *u->held);
+
+    /* Each buffer yields at most one completion, so a completion queue of
+     * twice as many entries cannot overflow. */
+    memset(&p, 0, sizeof p);
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = 2 * n_bufs;
+    u->fd = syscall(__NR_io_uring_setup, 2, &p);
+    if (u->fd < 0) {
+        goto error;
+    }
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof *u->sq_array;
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof *u->cqes;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->sq_ring_size = MAX(u->sq_ring_size, u->cq_ring_size);
+    }
+    u->sq_ring = ipfix_uring_mmap(u->fd, u->sq_ring_size, IORING_OFF_SQ_RING);
+    if (!u->sq_ring) {
+        goto error;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        u->cq_ring = ipfix_uring_mmap(u->fd, u->cq_ring_size,
+                                      IORING_OFF_CQ_RING);
+        if (!u->cq_ring) {
+            goto error;
+        }
+    }
+    u->sqes_size = p.sq_entries * sizeof *u->sqes;
+    u->sqes = ipfix_uring_mmap(u->fd, u->sqes_size, IORING_OFF_SQES);
+    if (!u->sqes) {
+        goto error;
+    }
+    u->sq_head = (void *) ((uint8_t *) u->sq_ring + p.sq_off.head);
+    u->sq_tail = (void *) ((uint8_t *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned int *) ((uint8_t *) u->sq_ring
+                                    + p.sq_off.ring_mask);
+    u->sq_array = (void *) ((uint8_t *) u->sq_ring + p.sq_off.array);
+    cq = u->cq_ring ? u->cq_ring : u->sq_ring;
+    u->cq_head = (void *) (cq + p.cq_off.head);
+    u->cq_tail = (void *) (cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned int *) (cq + p.cq_off.ring_mask);
+    u->cqes = (void *) (cq + p.cq_off.cqes);
+
+    /* The buffers are only touched as far as datagrams fill them, like
+     * recvmmsg()'s. */
+    u->n_bufs = n_bufs;
+    u->buf_size = ROUND_UP(sizeof(struct io_uring_recvmsg_out)
+                           + u->msg.msg_namelen + MAX_RECV,
+                           CACHE_LINE_SIZE);
+    u->bufs = ipfix_uring_mmap(-1, n_bufs * u->buf_size, 0);
+    u->br_size = n_bufs * sizeof(struct io_uring_buf);
+    u->br = ipfix_uring_mmap(-1, u->br_size, 0);
+    if (!u->bufs || !u->br) {
+        goto error;
+    }
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = (uintptr_t) u->br;
+    reg.ring_entries = n_bufs;
+    reg.bgid = IPFIX_URING_BGID;
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+        goto error;
+    }
+    for (unsigned int bid = 0; bid < n_bufs; bid++) {
+        ipfix_uring_offer(u, bid);
+    }
+    ipfix_uring_publish(u);
+
+    error = ipfix_uring_arm(u);
+    if (error) {
+        goto error_errno;
+    }
+
+    /* A kernel that does not support multishot recvmsg fails it as soon
+     * as it is submitted. */
+    head = *u->cq_head;
+    if (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+
+        if (!(cqe->flags & IORING_CQE_F_MORE) && cqe->res < 0
+            && cqe->res != -ENOBUFS) {
+            error = -cqe->res;
+            goto error_errno;
+        }
+    }
+
+    *up = u;
+    return 0;
+
+error:
+    error = errno;
+error_errno:
+    ipfix_uring_destroy(u);
+    *up = NULL;
+    return error;
+}
+
+/* Hands the buffers of the previous batch back to the kernel and reaps up
+ * to 'ring->n' received datagrams into 'ring', whose slots then point into
+ * the provided buffers until the next call.  Re-arms the recvmsg if it
+ * stopped, e.g. because the kernel ran out of buffers.  Returns the number
+ * of datagrams. */
+static size_t
+ipfix_uring_recv(struct ipfix_uring *u, struct ipfix_rx_ring *ring)
+{
+    unsigned int head, tail;
+    size_t n = 0;
+
+    if (u->n_held) {
+        for (size_t i = 0; i < u->n_held; i++) {
+            ipfix_uring_offer(u, u->held[i]);
+        }
+        u->n_held = 0;
+        ipfix_uring_publish(u);
+    }
+
+    head = *u->cq_head;
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && n < ring->n; head++) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        const struct io_uring_recvmsg_out *out;
+        const uint8_t *payload;
+        size_t room;
+        uint16_t bid;
+
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            u->armed = false;
+        }
+        if (cqe->res < 0) {
+            if (cqe->res == -ENOBUFS) {
+                u->n_nobufs++;
+            } else {
+                static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+                VLOG_WARN_RL(&rl, "io_uring receive failed (%s)",
+                             ovs_strerror(-cqe->res));
+                u->n_errors++;
+            }
+            continue;
+        } else if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+            continue;
+        }
+
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        u->held[u->n_held++] = bid;
+        out = (const void *) &u->bufs[bid * u->buf_size];
+        payload = (const uint8_t *) (out + 1) + u->msg.msg_namelen;
+        room = u->buf_size - (payload - (const uint8_t *) out);
+
+        memset(&ring->from[n], 0, sizeof ring->from[n]);
+        memcpy(&ring->from[n], out + 1,
+               MIN(out->namelen, u->msg.msg_namelen));
+        ofpbuf_use_const(&ring->bufs[n], payload, MIN(out->payloadlen, room));
+        ring->truncated[n] = (out->flags & MSG_TRUNC) != 0;
+        n++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+    /* The final completion of a recvmsg is its last, so there is nothing
+     * left to reap from it and this batch holds at most 'ring->n' of the
+     * buffers. */
+    if (!u->armed) {
+        int error = ipfix_uring_arm(u);
+        if (error) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+            VLOG_WARN_RL(&rl, "io_uring submit failed (%s)",
+                         ovs_strerror(error));
+        }
+    }
+    return n;
+}
+
+/* Returns true if 'u' has completions that have not been reaped. */
+static bool
+ipfix_uring_pending(const struct ipfix_uring *u)
+{
+    return *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static void
+ipfix_rx_ring_init(struct ipfix_rx_ring *ring, size_t n, size_t buf_size)
+{
+    memset(ring, 0, sizeof *ring);
+    ring->n = n;
+    ring->bufs = xmalloc(n * sizeof *ring->bufs);
+    ring->from = xzalloc(n * sizeof *ring->from);
+    ring->truncated = xzalloc(n * sizeof *ring->truncated);
+    for (size_t i = 0; i < n; i++) {
+        ofpbuf_init(&ring->bufs[i], buf_size);
+    }
+#ifdef __linux__
+    ring->msgs = xzalloc(n * sizeof *ring->msgs);
+    ring->iovs = xzalloc(n * sizeof *ring->iovs);
+    for (size_t i = 0; i < n; i++) {
+        ring->iovs[i].iov_base = ring->bufs[i].base;
+        ring->iovs[i].iov_len = buf_size;
+        ring->msgs[i].msg_hdr.msg_iov = &ring->iovs[i];
+        ring->msgs[i].msg_hdr.msg_iovlen = 1;
+        ring->msgs[i].msg_hdr.msg_name = &ring->from[i];
+    }
+#endif
+}
+
+/* Switches 'ring' to receiving from 'sock' through an io_uring, unless the
+ * kernel or the build does not support it, in which case 'ring' keeps
+ * using recvmmsg(). */
+static void
+ipfix_rx_ring_use_uring(struct ipfix_rx_ring *ring, int sock)
+{
+#ifdef IPFIX_HAVE_IO_URING
+    unsigned int n_bufs = 16;
+    int error;
+
+    while (n_bufs < 4 * ring->n) {
+        n_bufs *= 2;
+    }
+    error = ipfix_uring_create(sock, n_bufs, ring->n, &ring->uring);
+    if (error) {
+        VLOG_WARN("io_uring unavailable (%s), receiving with recvmmsg()",
+                  ovs_strerror(error));
+        return;
+    }
+
+    /* The slots point into the provided buffers instead. */
+    for (size_t i = 0; i < ring->n; i++) {
+        ofpbuf_uninit(&ring->bufs[i]);
+        ofpbuf_init(&ring->bufs[i], 0);
+        ring->iovs[i].iov_base = NULL;
+        ring->iovs[i].iov_len = 0;
+    }
+#else
+    VLOG_WARN("io_uring not supported by this build, receiving with "
+              "recvmmsg()");
+#endif
+}
+
+static void
+ipfix_rx_ring_destroy(struct ipfix_rx_ring *ring)
+{
+    for (size_t i = 0; i < ring->n; i++) {
+        ofpbuf_uninit(&ring->bufs[i]);
+    }
+    free(ring->bufs);
+    free(ring->from);
+    free(ring->truncated);
+#ifdef __linux__
+    free(ring->msgs);
+    free(ring->iovs);
+#endif
+#ifdef IPFIX_HAVE_IO_URING
+    ipfix_uring_destroy(ring->uring);
+#endif
+}
+
+/* Updates 'ring''s statistics for a batch of 'n' datagrams.  Returns
+ * 'n'. */
+static size_t
+ipfix_rx_ring_account(struct ipfix_rx_ring *ring, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (ring->truncated[i]) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+            VLOG_WARN_RL(&rl, "dropped datagram larger than %d bytes",
+                         MAX_RECV);
+            ring->n_truncated++;
+        }
+    }
+    if (n) {
+        ring->n_batches++;
+        ring->n_datagrams += n;
+        ring->max_fill = MAX(ring->max_fill, n);
+    }
+    if (n && n < ring->n) {
+        ring->n_drained++;
+    }
+    return n;
+}
+
+/* Receives up to 'ring->n' datagrams from 'sock' without blocking, using
+ * a single recvmmsg() call where available, or no system call at all with
+ * --io-uring.  Returns the number received; slot i then holds datagram i
+ * in 'bufs[i]' and its source in 'from[i]', and 'truncated[i]' tells
+ * whether the datagram did not fit. */
+static size_t
+ipfix_rx_ring_recv(struct ipfix_rx_ring *ring, int sock)
+{
+    size_t n = 0;
+    int retval;
+
+#ifdef IPFIX_HAVE_IO_URING
+    if (ring->uring) {
+        return ipfix_rx_ring_account(ring,
+                                     ipfix_uring_recv(ring->uring, ring));
+    }
+#endif
+#ifdef __linux__
+    for (size_t i = 0; i < ring->n; i++) {
+        ring->msgs[i].msg_hdr.msg_namelen = sizeof ring->from[i];
+    }
+    do {
+        retval = recvmmsg(sock, ring->msgs, ring->n, 0, NULL);
+    } while (retval < 0 && errno == EINTR);
+    n = retval > 0 ? retval : 0;
+    for (size_t i = 0; i < n; i++) {
+        struct ofpbuf *buf = &ring->bufs[i];
+        ofpbuf_clear(buf);
+        ofpbuf_put_uninit(buf, ring->msgs[i].msg_len);
+        ring->truncated[i] = ring->msgs[i].msg_hdr.msg_flags & MSG_TRUNC;
+    }
+#else
+    while (n < ring->n) {
+        struct ofpbuf *buf = &ring->bufs[n];
+        struct iovec iov;
+        struct msghdr msg;
+
+        ofpbuf_clear(buf);
+        iov.iov_base = buf->data;
+        iov.iov_len = buf->allocated;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_name = &ring->from[n];
+        msg.msg_namelen = sizeof ring->from[n];
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        do {
+            retval = recvmsg(sock, &msg, 0);
+        } while (retval < 0 && errno == EINTR);
+        if (retval < 0) {
+            break;
+        }
+        ofpbuf_put_uninit(buf, retval);
+        ring->truncated[n] = msg.msg_flags & MSG_TRUNC;
+        n++;
+    }
+#endif
+
+    if (retval < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+        VLOG_WARN_RL(&rl, "receive failed (%s)", ovs_strerror(errno));
+    }
+    return ipfix_rx_ring_account(ring, n);
+}
+
+/* Size of a TCP connection's reassembly buffer.  Twice the largest
+ * message, so that a partial message is only moved back to the start of
+ * the buffer once per 64 kB or so received. */
+#define IPFIX_TCP_BUF_SIZE (2 * 65536)
+
+/*An exporter's TCP connection (--tcp).  Messages are decoded in place in
+ * 'buf' as soon as they are complete; only a message split across reads
+ * is ever copied*/
+struct ipfix_tcp_conn{
+    int fd;
+    struct sockaddr_storage from;   /* Exporter, i.e. template scope. */
+    uint8_t *buf;               /* IPFIX_TCP_BUF_SIZE bytes. */
+    size_t start, end;          /* Unconsumed data is buf[start:end]. */
+};
+
+/* Bytes that a TCP forwarding target may queue while its connection is
+ * being set up or cannot keep up. */
+#define IPFIX_FWD_BACKLOG (1024 * 1024)
+
+/* How long to wait before reconnecting to a TCP forwarding target, in
+ * ms. */
+#define IPFIX_FWD_RETRY_MS 1000
+
+/*One worker's connection to a downstream collector (--forward).  UDP
+ * targets get a connected socket each.  TCP targets are reconnected when
+ * the connection fails, and messages that the socket does not take at once
+ * are copied into 'buf', up to IPFIX_FWD_BACKLOG bytes, and sent later*/
+struct ipfix_fwd_target{
+    const char *name;           /* As given to --forward. */
+    bool tcp;
+    int fd;                     /* Negative while disconnected. */
+    bool connecting;            /* TCP connection in progress? */
+    long long int retry;        /* When to reconnect, if 'fd' < 0. */
+
+    /* TCP only: whole messages not sent yet, in buf[start:end], of which
+     * the first 'sent' bytes have been. */
+    uint8_t *buf;
+    size_t start, end, sent;
+
+    /* Statistics. */
+    unsigned long long int n_messages;  /* Messages handed to the kernel. */
+    unsigned long long int n_bytes;     /* Bytes of those messages. */
+    unsigned long long int n_dropped;   /* Messages not forwarded. */
+    unsigned long long int n_connects;  /* TCP connections made. */
+};
+
+/*Messages that a worker re-exports to every --forward target.  'iovs'
+ * point into the receive buffers, so they are only valid until the
+ * worker receives again*/
+struct ipfix_fwd{
+    struct ipfix_fwd_target *targets;
+    size_t n_targets;
+
+    struct iovec *iovs;
+    size_t n, allocated;
+#ifdef __linux__
+    struct mmsghdr *msgs;       /* One per element of 'iovs'. */
+#endif
+};
+
+/* Returns the length of the IPFIX message at the start of 'data'. */
+static size_t
+ipfix_fwd_msg_len(const uint8_t *data)
+{
+    const struct ipfix_message_header *msg_hd = (const void *) data;
+
+    return ntohs(msg_hd->length);
+}
+
+static void
+ipfix_fwd_connect(struct ipfix_fwd_target *t)
+{
+    const char *peer = t->name + 4;
+    int error;
+
+    error = inet_open_active(t->tcp ? SOCK_STREAM : SOCK_DGRAM, peer, 0,
+                             NULL, &t->fd, 0);
+    if (error && error != EAGAIN) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+        VLOG_WARN_RL(&rl, "%s: connect failed (%s)",
+                     t->name, ovs_strerror(error));
+        t->fd = -1;
+        t->retry = time_msec() + IPFIX_FWD_RETRY_MS;
+        return;
+    }
+    t->connecting = error == EAGAIN;
+    if (t->tcp && !t->connecting) {
+        t->n_connects++;
+    }
+}
+
+/* Closes 't''s failed TCP connection with error 'error' and drops the
+ * messages that it had queued. */
+static void
+ipfix_fwd_disconnect(struct ipfix_fwd_target *t, int error)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+
+    VLOG_WARN_RL(&rl, "%s: connection failed (%s)",
+                 t->name, ovs_strerror(error));
+    for (size_t ofs = t->start; ofs < t->end;
+         ofs += ipfix_fwd_msg_len(&t->buf[ofs])) {
+        t->n_dropped++;
+    }
+    t->start = t->end = t->sent = 0;
+    closesocket(t->fd);
+    t->fd = -1;
+    t->connecting = false;
+    t->retry = time_msec() + IPFIX_FWD_RETRY_MS;
+}
+
+/* Sends as much of 't''s queued messages as its TCP socket takes. */
+static void
+ipfix_fwd_send_backlog(struct ipfix_fwd_target *t)
+{
+    while (t->start < t->end) {
+        ssize_t retval;
+
+        retval = send(t->fd, &t->buf[t->start + t->sent],
+                      t->end - t->start - t->sent,
+                      MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (retval < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ipfix_fwd_disconnect(t, errno);
+            }
+            return;
+        }
+
+        t->sent += retval;
+        while (t->start < t->end) {
+            size_t len = ipfix_fwd_msg_len(&t->buf[t->start]);
+
+            if (t->sent < len) {
+                break;
+            }
+            t->sent -= len;
+            t->start += len;
+            t->n_messages++;
+            t->n_bytes += len;
+        }
+    }
+    t->start = t->end = t->sent = 0;
+}
+
+/* Copies the message in 'iov' to 't''s queue, of which 'sent' bytes have
+ * already been sent, or drops it if the queue is full. */
+static void
+ipfix_fwd_queue(struct ipfix_fwd_target *t, const struct iovec *iov,
+                size_t sent)
+{
+    if (t->end + iov->iov_len > IPFIX_FWD_BACKLOG && t->start) {
+        memmove(t->buf, &t->buf[t->start], t->end - t->start);
+        t->end -= t->start;
+        t->start = 0;
+    }
+    if (t->end + iov->iov_len > IPFIX_FWD_BACKLOG) {
+        t->n_dropped++;
+        return;
+    }
+    if (!t->buf) {
+        t->buf = xmalloc(IPFIX_FWD_BACKLOG);
+    }
+    if (t->start == t->end) {
+        t->sent = sent;
+    }
+    memcpy(&t->buf[t->end], iov->iov_base, iov->iov_len);
+    t->end += iov->iov_len;
+}
+
+/* Sends the 'n' messages in 'iovs' over 't''s TCP connection, straight
+ * from the receive buffers unless earlier messages are still queued. */
+static void
+ipfix_fwd_send_tcp(struct ipfix_fwd_target *t, const struct iovec *iovs,
+                   size_t n)
+{
+    size_t i = 0;
+
+    if (t->fd >= 0 && !t->connecting) {
+        ipfix_fwd_send_backlog(t);
+    }
+    while (t->fd >= 0 && !t->connecting && t->start == t->end && i < n) {
+        struct msghdr msg;
+        ssize_t retval;
+        size_t sent;
+
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = CONST_CAST(struct iovec *, &iovs[i]);
+        msg.msg_iovlen = MIN(n - i, IOV_MAX);
+        retval = sendmsg(t->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (retval < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ipfix_fwd_disconnect(t, errno);
+            }
+            break;
+        }
+
+        for (sent = retval; i < n && sent >= iovs[i].iov_len; i++) {
+            sent -= iovs[i].iov_len;
+            t->n_messages++;
+            t->n_bytes += iovs[i].iov_len;
+        }
+        if (sent) {
+            /* The rest of a message must follow before anything else. */
+            ipfix_fwd_queue(t, &iovs[i++], sent);
+        }
+    }
+
+    for (; i < n; i++) {
+        if (t->fd >= 0) {
+            ipfix_fwd_queue(t, &iovs[i], 0);
+        } else {
+            t->n_dropped++;
+        }
+    }
+}
+
+/* Sends the messages queued in 'fwd' as datagrams on 't''s connected UDP
+ * socket.  Datagrams that the socket does not take at once are dropped
+ * rather than waited for. */
+static void
+ipfix_fwd_send_udp(struct ipfix_fwd_target *t, struct ipfix_fwd *fwd)
+{
+    size_t i = 0;
+
+    if (t->fd < 0) {
+        t->n_dropped += fwd->n;
+        return;
+    }
+    while (i < fwd->n) {
+        int retval;
+
+#ifdef __linux__
+        retval = sendmmsg(t->fd, &fwd->msgs[i], fwd->n - i, MSG_DONTWAIT);
+#else
+        retval = send(t->fd, fwd->iovs[i].iov_base, fwd->iovs[i].iov_len,
+                      MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+        if (retval < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK
+                       || errno == ENOBUFS) {
+                t->n_dropped += fwd->n - i;
+                break;
+            }
+
+            /* E.g. ECONNREFUSED, reported for an earlier datagram. */
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+            VLOG_WARN_RL(&rl, "%s: send failed (%s)",
+                         t->name, ovs_strerror(errno));
+            t->n_dropped++;
+            i++;
+            continue;
+        }
+        for (int j = 0; j < retval; j++, i++) {
+            t->n_messages++;
+            t->n_bytes += fwd->iovs[i].iov_len;
+        }
+    }
+}
+
+static void
+ipfix_fwd_init(struct ipfix_fwd *fwd)
+{
+    memset(fwd, 0, sizeof *fwd);
+    fwd->n_targets = n_forward_targets;
+    fwd->targets = xcalloc(n_forward_targets, sizeof *fwd->targets);
+    for (size_t i = 0; i < n_forward_targets; i++) {
+        struct ipfix_fwd_target *t = &fwd->targets[i];
+
+        t->name = forward_targets[i];
+        t->tcp = !strncmp(t->name, "tcp:", 4);
+        ipfix_fwd_connect(t);
+    }
+}
+
+static void
+ipfix_fwd_destroy(struct ipfix_fwd *fwd)
+{
+    for (size_t i = 0; i < fwd->n_targets; i++) {
+        struct ipfix_fwd_target *t = &fwd->targets[i];
+
+        if (t->fd >= 0) {
+            if (!t->connecting) {
+                ipfix_fwd_send_backlog(t);
+            }
+            if (t->fd >= 0) {
+                closesocket(t->fd);
+            }
+        }
+        free(t->buf);
+    }
+    free(fwd->targets);
+    free(fwd->iovs);
+#ifdef __linux__
+    free(fwd->msgs);
+#endif
+}
+
+/* Queues the 'size'-byte IPFIX message in 'data' for forwarding, without
+ * copying it.  Malformed messages are not forwarded, since over TCP they
+ * would break the framing of every message after them. */
+static void
+ipfix_fwd_add(struct ipfix_fwd *fwd, const void *data, size_t size)
+{
+    size_t len;
+
+    if (size < IPFIX_MES_HEADER_LEN) {
+        return;
+    }
+    len = ipfix_fwd_msg_len(data);
+    if (len < IPFIX_MES_HEADER_LEN || len > size) {
+        return;
+    }
+
+    if (fwd->n >= fwd->allocated) {
+        fwd->iovs = x2nrealloc(fwd->iovs, &fwd->allocated,
+                               sizeof *fwd->iovs);
+#ifdef __linux__
+        fwd->msgs = xrealloc(fwd->msgs, fwd->allocated * sizeof *fwd->msgs);
+        for (size_t i = 0; i < fwd->allocated; i++) {
+            memset(&fwd->msgs[i], 0, sizeof fwd->msgs[i]);
+            fwd->msgs[i].msg_hdr.msg_iov = &fwd->iovs[i];
+            fwd->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+    }
+    fwd->iovs[fwd->n].iov_base = CONST_CAST(void *, data);
+    fwd->iovs[fwd->n].iov_len = len;
+    fwd->n++;
+}
+
+/* Sends the queued messages to every target. */
+static void
+ipfix_fwd_flush(struct ipfix_fwd *fwd)
+{
+    if (fwd->n) {
+        for (size_t i = 0; i < fwd->n_targets; i++) {
+            struct ipfix_fwd_target *t = &fwd->targets[i];
+
+            if (t->tcp) {
+                ipfix_fwd_send_tcp(t, fwd->iovs, fwd->n);
+            } else {
+                ipfix_fwd_send_udp(t, fwd);
+            }
+        }
+        fwd->n = 0;
+    }
+}
+
+/* Reconnects targets whose connections failed, completes connections in
+ * progress and sends queued messages. */
+static void
+ipfix_fwd_run(struct ipfix_fwd *fwd)
+{
+    for (size_t i = 0; i < fwd->n_targets; i++) {
+        struct ipfix_fwd_target *t = &fwd->targets[i];
+
+        if (t->fd < 0) {
+            if (time_msec() >= t->retry) {
+                ipfix_fwd_connect(t);
+            }
+        } else if (t->connecting) {
+            int error = check_connection_completion(t->fd);
+
+            if (!error) {
+                t->connecting = false;
+                t->n_connects++;
+            } else if (error != EAGAIN) {
+                ipfix_fwd_disconnect(t, error);
+            }
+        }
+        if (t->fd >= 0 && !t->connecting) {
+            ipfix_fwd_send_backlog(t);
+        }
+    }
+}
+
+static void
+ipfix_fwd_wait(const struct ipfix_fwd *fwd)
+{
+    for (size_t i = 0; i < fwd->n_targets; i++) {
+        const struct ipfix_fwd_target *t = &fwd->targets[i];
+
+        if (t->fd < 0) {
+            poll_timer_wait_until(t->retry);
+        } else if (t->connecting || t->start < t->end) {
+            poll_fd_wait(t->fd, POLLOUT);
+        }
+    }
+}
+
+/* Returns true if no target has messages queued. */
+static bool
+ipfix_fwd_idle(const struct ipfix_fwd *fwd)
+{
+    for (size_t i = 0; i < fwd->n_targets; i++) {
+        if (fwd->targets[i].start < fwd->targets[i].end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns a sum of 'c''s counters that grows whenever print_ipfix()
+ * decodes a message that --forward-filtered re-exports: one with a
+ * template or options template set or a record that passes --filter. */
+static unsigned long long int
+ipfix_fwd_mark(const struct ipfix_collector *c)
+{
+    return (ipfix_counter_read(c->counters, IPFIX_CTR_TEMPLATE_SETS)
+            + ipfix_counter_read(c->counters, IPFIX_CTR_SKIPPED_SET)
+            + ipfix_counter_read(c->counters, IPFIX_CTR_RECORDS)
+            - ipfix_counter_read(c->counters, IPFIX_CTR_FILTERED));
+}
+
+/*Stages of a worker's batch.  With --tcp, reads are part of "decode"*/
+enum ipfix_stage {
+    IPFIX_STAGE_RECV,
+    IPFIX_STAGE_DECODE,
+    IPFIX_STAGE_OUTPUT,
+    IPFIX_N_STAGES
+};
+
+static const char *const ipfix_stage_names[IPFIX_N_STAGES] = {
+    "recv", "decode", "output",
+};
+
+/*A receive/decode thread with its own socket, template cache and output
+ * buffer.  With --tcp, 'sock' is a listening socket and the worker reads
+ * every connection it accepts from its single event loop*/
+struct ipfix_worker{
+    struct ovs_mutex mutex;     /* Protects the members below. */
+    int sock;
+    struct ipfix_rx_ring ring OVS_GUARDED;
+    struct ipfix_collector collector OVS_GUARDED;
+    struct ipfix_fwd fwd OVS_GUARDED;
+    pthread_t thread;           /* Unused if there is only one worker. */
+
+    struct ipfix_tcp_conn **conns OVS_GUARDED;
+    size_t n_conns, allocated_conns;
+    bool tcp_busy;              /* Some connection may have more to read. */
+    unsigned long long int n_accepted;  /* Connections accepted. */
+    unsigned long long int n_closed;    /* Connections closed. */
+    unsigned long long int n_framing_errors;    /* Closed as unparsable. */
+    unsigned long long int n_tcp_bytes; /* Bytes read from connections. */
+
+    /* Time each stage of a nonempty batch took, in nanoseconds.  Stages
+     * never block, so elapsed time is the thread's CPU time except when
+     * it is preempted, and reading the monotonic clock is much cheaper
+     * than reading the thread CPU clock. */
+    struct ipfix_hist stages[IPFIX_N_STAGES] OVS_GUARDED;
+
+    /* The collector's counters as of the last ipfix/reset-counters, which
+     * ipfix/show subtracts.  Only the main thread uses them. */
+    unsigned long long int counters_zero[IPFIX_N_COUNTER_SLOTS];
+};
+
+static struct ipfix_worker *workers;
+static size_t n_workers;
+
+/*A pending ipfix/wait-records or ipfix/wait-drained command*/
+struct ipfix_records_wait{
+    struct unixctl_conn *conn;
+    bool drain;                 /* ipfix/wait-drained? */
+    unsigned long long int n_records;   /* Total to wait for. */
+    long long int deadline;     /* In ms, on the monotonic clock. */
+};
+
+/* Pending ipfix/wait-records commands.  While there are any, a worker
+ * thread changes 'records_seq' after each batch that decoded a record, so
+ * that the main thread wakes up to check them.  A worker reads
+ * 'records_waiting' under its mutex and the main thread sums the
+ * counters under the same mutexes, so either the main thread sees the
+ * worker's records or the worker sees the flag. */
+static struct ipfix_records_wait *records_waits;
+static size_t n_records_waits, allocated_records_waits;
+static struct seq *records_seq;
+static atomic_bool records_waiting;
+
+/* Default timeout for ipfix/wait-records, in ms. */
+#define IPFIX_WAIT_RECORDS_TIMEOUT 10000
+
+/* Set by the main thread to make the workers exit. */
+static struct latch exit_latch;
+
+/* Grows the receive buffer of datagram socket 'fd' to hold a full batch of
+ * maximum-size messages, so that a burst of large messages is not dropped
+ * while the previous batch is being decoded.  The kernel may cap the size
+ * (net.core.rmem_max on Linux); that is not an error. */
+static void
+grow_rcvbuf(int fd)
+{
+    int size = batch_size * MAX_RECV;
+    int cur;
+    socklen_t len = sizeof cur;
+
+    if (!getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &cur, &len) && cur >= size) {
+        return;
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size)) {
+        VLOG_WARN("setsockopt(SO_RCVBUF=%d) failed (%s)",
+                  size, ovs_strerror(errno));
+    }
+}
+
+static void
+ipfix_worker_init(struct ipfix_worker *w, int sock)
+{
+    ovs_mutex_init(&w->mutex);
+    w->sock = sock;
+    if (!tcp_mode) {
+        grow_rcvbuf(sock);
+    }
+    ipfix_rx_ring_init(&w->ring, batch_size, MAX_RECV);
+    ipfix_collector_init(&w->collector);
+    ipfix_fwd_init(&w->fwd);
+}
+
+/* With --io-uring, switches 'w' to receiving through an io_uring.  The
+ * kernel completes a request on behalf of the thread that submitted it, so
+ * this must be called from the thread that receives for 'w'. */
+static void
+ipfix_worker_use_uring(struct ipfix_worker *w)
+{
+    if (use_io_uring && !tcp_mode) {
+        ovs_mutex_lock(&w->mutex);
+        ipfix_rx_ring_use_uring(&w->ring, w->sock);
+        ovs_mutex_unlock(&w->mutex);
+    }
+}
+
+static void ipfix_tcp_close(struct ipfix_worker *, size_t idx);
+
+static void
+ipfix_worker_destroy(struct ipfix_worker *w)
+{
+    ovs_mutex_lock(&w->mutex);
+    while (w->n_conns) {
+        ipfix_tcp_close(w, w->n_conns - 1);
+    }
+    free(w->conns);
+    ovs_mutex_unlock(&w->mutex);
+    if (w->collector.biflow) {
+        ipfix_biflow_expire(w->collector.biflow, LLONG_MAX,
+                            &w->collector.out);
+    }
+    ipfix_collector_flush(&w->collector);
+    ipfix_fwd_destroy(&w->fwd);
+    ipfix_rx_ring_destroy(&w->ring);
+    ipfix_collector_destroy(&w->collector);
+    closesocket(w->sock);
+    ovs_mutex_destroy(&w->mutex);
+}
+
+static void
+format_exporter(struct ds *s, const struct sockaddr_storage *ss)
+{
+    struct ipfix_template_key key;
+
+    ipfix_exporter_from_ss(ss, &key);
+    format_capture_addr(s, &key.exporter);
+    ds_put_format(s, ":%"PRIu16, ntohs(key.exporter_port));
+}
+
+/* Accepts up to a batch of pending connections on 'w''s listening
+ * socket. */
+static void
+ipfix_tcp_accept(struct ipfix_worker *w)
+    OVS_REQUIRES(w->mutex)
+{
+    for (int i = 0; i < batch_size; i++) {
+        struct sockaddr_storage ss;
+        socklen_t ss_len = sizeof ss;
+        struct ipfix_tcp_conn *conn;
+        struct ds s;
+        int fd;
+
+        do {
+            fd = accept(w->sock, (struct sockaddr *) &ss, &ss_len);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+                VLOG_WARN_RL(&rl, "accept failed (%s)", ovs_strerror(errno));
+            }
+            return;
+        }
+        xset_nonblocking(fd);
+
+        conn = xmalloc(sizeof *conn);
+        conn->fd = fd;
+        conn->from = ss;
+        conn->buf = xmalloc(IPFIX_TCP_BUF_SIZE);
+        conn->start = conn->end = 0;
+        if (w->n_conns >= w->allocated_conns) {
+            w->conns = x2nrealloc(w->conns, &w->allocated_conns,
+                                  sizeof *w->conns);
+        }
+        w->conns[w->n_conns++] = conn;
+        w->n_accepted++;
+
+        ds_init(&s);
+        format_exporter(&s, &ss);
+        VLOG_INFO("%s: accepted connection", ds_cstr(&s));
+        ds_destroy(&s);
+    }
+    w->tcp_busy = true;
+}
+
+/* Closes 'w''s connection 'idx', forgetting its templates. */
+static void
+ipfix_tcp_close(struct ipfix_worker *w, size_t idx)
+    OVS_REQUIRES(w->mutex)
+{
+    struct ipfix_tcp_conn *conn = w->conns[idx];
+    struct ipfix_template_key key;
+
+    ipfix_exporter_from_ss(&conn->from, &key);
+    ipfix_template_flush_session(&w->collector, &key);
+    closesocket(conn->fd);
+    free(conn->buf);
+    free(conn);
+    w->conns[idx] = w->conns[--w->n_conns];
+    w->n_closed++;
+}
+
+/* Decodes the message in 'buf', received from 'from', and queues it to be
+ * forwarded.  The caller must call ipfix_fwd_flush() before the memory
+ * that 'buf' points to changes. */
+static void
+ipfix_worker_decode(struct ipfix_worker *w,
+                    const struct sockaddr_storage *from, struct ofpbuf *buf)
+    OVS_REQUIRES(w->mutex)
+{
+    const void *data = buf->data;
+    size_t size = buf->size;
+    unsigned long long int mark;
+
+    if (!w->fwd.n_targets) {
+        print_ipfix(&w->collector, from, buf);
+        return;
+    }
+
+    mark = forward_filtered ? ipfix_fwd_mark(&w->collector) : 0;
+    print_ipfix(&w->collector, from, buf);
+    if (!forward_filtered || ipfix_fwd_mark(&w->collector) != mark) {
+        ipfix_fwd_add(&w->fwd, data, size);
+    }
+}
+
+/* Decodes the complete messages buffered in 'conn'.  Returns false if the
+ * stream cannot be framed, in which case the connection must be closed. */
+static bool
+ipfix_tcp_decode(struct ipfix_worker *w, struct ipfix_tcp_conn *conn)
+    OVS_REQUIRES(w->mutex)
+{
+    while (conn->end - conn->start >= IPFIX_MES_HEADER_LEN) {
+        const struct ipfix_message_header *msg_hd;
+        struct ofpbuf msg;
+        uint16_t msg_len;
+
+        msg_hd = (const void *) &conn->buf[conn->start];
+        msg_len = ntohs(msg_hd->length);
+        if (msg_len < IPFIX_MES_HEADER_LEN) {
+            w->n_framing_errors++;
+            ipfix_fwd_flush(&w->fwd);
+            return false;
+        }
+        if (conn->end - conn->start < msg_len) {
+            break;
+        }
+        ofpbuf_use_const(&msg, msg_hd, msg_len);
+        ipfix_worker_decode(w, &conn->from, &msg);
+        conn->start += msg_len;
+    }
+    ipfix_fwd_flush(&w->fwd);
+
+    if (conn->start == conn->end) {
+        conn->start = conn->end = 0;
+    } else if (conn->end > IPFIX_TCP_BUF_SIZE - IPFIX_MAX_MESSAGE_LEN) {
+        /* Make room for the rest of the partial message. */
+        memmove(conn->buf, &conn->buf[conn->start], conn->end - conn->start);
+        conn->end -= conn->start;
+        conn->start = 0;
+    }
+    return true;
+}
+
+/* Reads and decodes what 'conn' has to offer, up to a batch of reads so
+ * that one busy exporter cannot starve the others.  Returns false if the
+ * connection closed or failed. */
+static bool
+ipfix_tcp_input(struct ipfix_worker *w, struct ipfix_tcp_conn *conn)
+    OVS_REQUIRES(w->mutex)
+{
+    for (int i = 0; i < batch_size; i++) {
+        ssize_t retval;
+
+        do {
+            retval = read(conn->fd, &conn->buf[conn->end],
+                          IPFIX_TCP_BUF_SIZE - conn->end);
+        } while (retval < 0 && errno == EINTR);
+        if (retval < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+            VLOG_WARN_RL(&rl, "read failed (%s)", ovs_strerror(errno));
+            return false;
+        } else if (!retval) {
+            if (conn->start != conn->end) {
+                static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+                VLOG_WARN_RL(&rl, "connection closed with %"PRIuSIZE" "
+                             "bytes of a partial message",
+                             conn->end - conn->start);
+            }
+            return false;
+        }
+
+        conn->end += retval;
+        w->n_tcp_bytes += retval;
+        if (!ipfix_tcp_decode(w, conn)) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+            VLOG_WARN_RL(&rl, "bad IPFIX message length, closing "
+                         "connection");
+            return false;
+        }
+    }
+    w->tcp_busy = true;
+    return true;
+}
+
+/* Accepts new connections and serves the existing ones.  Returns the number
+ * of connections. */
+static size_t
+ipfix_tcp_run(struct ipfix_worker *w)
+    OVS_REQUIRES(w->mutex)
+{
+    w->tcp_busy = false;
+    ipfix_tcp_accept(w);
+    for (size_t i = 0; i < w->n_conns; ) {
+        struct ipfix_tcp_conn *conn = w->conns[i];
+
+        if (ipfix_tcp_input(w, conn)) {
+            i++;
+        } else {
+            ipfix_tcp_close(w, i);
+        }
+    }
+    return w->n_conns;
+}
+
+/* Receives, decodes and writes out one batch of datagrams, or with --tcp
+ * whatever the connections have to offer.  Returns the number of
+ * datagrams received. */
+static size_t
+ipfix_worker_run(struct ipfix_worker *w)
+{
+    long long int start, received, decoded;
+    size_t n = 0;
+    bool busy;
+
+    ovs_mutex_lock(&w->mutex);
+    ipfix_fwd_run(&w->fwd);
+    start = ipfix_now_ns();
+    if (tcp_mode) {
+        unsigned long long int n_tcp_bytes = w->n_tcp_bytes;
+
+        w->collector.rx_usec = time_wall_usec();
+        ipfix_tcp_run(w);
+        received = start;
+        busy = w->n_tcp_bytes != n_tcp_bytes;
+    } else {
+        n = ipfix_rx_ring_recv(&w->ring, w->sock);
+        received = ipfix_now_ns();
+        busy = n > 0;
+        if (busy) {
+            w->collector.rx_usec = time_wall_usec();
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (w->ring.truncated[i]) {
+                ipfix_count(&w->collector, IPFIX_CTR_TRUNCATED, 1);
+            } else if (w->ring.bufs[i].size) {
+                /* Empty datagrams are ignored. */
+                ipfix_worker_decode(w, &w->ring.from[i], &w->ring.bufs[i]);
+            }
+        }
+        ipfix_fwd_flush(&w->fwd);
+    }
+    decoded = ipfix_now_ns();
+    if (busy && n_workers > 1) {
+        bool waiting;
+
+        atomic_read_relaxed(&records_waiting, &waiting);
+        if (waiting) {
+            seq_change(records_seq);
+        }
+    }
+    ipfix_collector_run(&w->collector);
+    if (busy) {
+        if (!tcp_mode) {
+            ipfix_hist_add(&w->stages[IPFIX_STAGE_RECV], received - start);
+        }
+        ipfix_hist_add(&w->stages[IPFIX_STAGE_DECODE], decoded - received);
+        ipfix_hist_add(&w->stages[IPFIX_STAGE_OUTPUT],
+                       ipfix_now_ns() - decoded);
+    }
+    ovs_mutex_unlock(&w->mutex);
+
+    return n;
+}
+
+static void
+ipfix_worker_wait(struct ipfix_worker *w, size_t n)
+{
+    ovs_mutex_lock(&w->mutex);
+    if (tcp_mode ? w->tcp_busy : n == w->ring.n) {
+        /* There may be more to read. */
+        poll_immediate_wake();
+#ifdef IPFIX_HAVE_IO_URING
+    } else if (w->ring.uring && w->ring.uring->armed) {
+        /* The io_uring is readable when it has completions to reap. */
+        poll_fd_wait(w->ring.uring->fd, POLLIN);
+#endif
+    } else {
+        poll_fd_wait(w->sock, POLLIN);
+        for (size_t i = 0; i < w->n_conns; i++) {
+            poll_fd_wait(w->conns[i]->fd, POLLIN);
+        }
+    }
+    if (w->collector.out_deadline) {
+        poll_timer_wait_until(w->collector.out_deadline);
+    }
+    if (w->collector.biflow) {
+        ipfix_biflow_wait(w->collector.biflow);
+    }
+    ipfix_fwd_wait(&w->fwd);
+    ovs_mutex_unlock(&w->mutex);
+}
+
+static void *
+ipfix_worker_main(void *w_)
+{
+    struct ipfix_worker *w = w_;
+
+    ipfix_worker_use_uring(w);
+    while (!latch_is_set(&exit_latch)) {
+        size_t n = ipfix_worker_run(w);
+
+        ipfix_worker_wait(w, n);
+        latch_wait(&exit_latch);
+        poll_block();
+    }
+    return NULL;
+}
+
+/* Opens 'n' sockets of the given 'style' (SOCK_DGRAM or SOCK_STREAM)
+ * bound to the same 'target' address with SO_REUSEPORT, so that the kernel
+ * hashes each exporter onto one of them, and stores them in 'socks'. */
+static void
+open_reuseport_sockets(const char *target, int style, int *socks, size_t n)
+{
+#ifdef SO_REUSEPORT
+    struct sockaddr_storage ss;
+
+    if (!inet_parse_passive(target, 0, &ss)) {
+        ovs_fatal(0, "%s: bad peer name format", target);
+    }
+    for (size_t i = 0; i < n; i++) {
+        int one = 1;
+        int fd;
+
+        fd = socket(ss.ss_family, style, 0);
+        if (fd < 0) {
+            ovs_fatal(errno, "%s: socket failed", target);
+        }
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one)) {
+            ovs_fatal(errno, "%s: setsockopt(SO_REUSEPORT) failed", target);
+        }
+        if (bind(fd, (struct sockaddr *) &ss, ss_length(&ss))) {
+            ovs_fatal(errno, "%s: bind failed", target);
+        }
+        if (style == SOCK_STREAM && listen(fd, 64)) {
+            ovs_fatal(errno, "%s: listen failed", target);
+        }
+        xset_nonblocking(fd);
+
+        if (!i) {
+            /* Bind the rest to the port the kernel picked, if any. */
+            socklen_t ss_len = sizeof ss;
+            if (getsockname(fd, (struct sockaddr *) &ss, &ss_len)) {
+                ovs_fatal(errno, "%s: getsockname failed", target);
+            }
+            VLOG_INFO("%s: listening on port %"PRIu16,
+                      target, ss_get_port(&ss));
+        }
+        socks[i] = fd;
+    }
+#else
+    ovs_fatal(0, "--threads requires SO_REUSEPORT support");
+#endif
+}
+
+static void
+parse_options(int argc, char *argv[]){
+    enum {
+        OPT_BATCH = UCHAR_MAX + 1,
+        OPT_THREADS,
+        OPT_FLUSH_BYTES,
+        OPT_FLUSH_MS,
+        OPT_CAPTURE,
+        OPT_NO_TEXT,
+        OPT_SEQ_PER_MESSAGE,
+        OPT_AGGREGATE,
+        OPT_DUMP_INTERVAL,
+        OPT_TOP_K,
+        OPT_HH_DOMAINS,
+        OPT_TCP,
+        OPT_COLUMNS,
+        OPT_FILTER,
+        OPT_WRITER_QUEUE,
+        OPT_WRITER_FULL,
+        OPT_OUTPUT,
+        OPT_ROTATE_BYTES,
+        OPT_ROTATE_KEEP,
+        OPT_IO_URING,
+        OPT_FORWARD,
+        OPT_FORWARD_FILTERED,
+        OPT_SAMPLING,
+        OPT_BIFLOW,
+        OPT_BIFLOW_MAX,
+        DAEMON_OPTION_ENUMS,
+        VLOG_OPTION_ENUMS
+    };
+    static const struct option long_options[] = {
+            {"help", no_argument, NULL, 'h'},
+            {"batch", required_argument, NULL, OPT_BATCH},
+            {"threads", required_argument, NULL, OPT_THREADS},
+            {"flush-bytes", required_argument, NULL, OPT_FLUSH_BYTES},
+            {"flush-ms", required_argument, NULL, OPT_FLUSH_MS},
+            {"capture", required_argument, NULL, OPT_CAPTURE},
+            {"no-text", no_argument, NULL, OPT_NO_TEXT},
+            {"seq-per-message", no_argument, NULL, OPT_SEQ_PER_MESSAGE},
+            {"aggregate", required_argument, NULL, OPT_AGGREGATE},
+            {"dump-interval", required_argument, NULL, OPT_DUMP_INTERVAL},
+            {"top-k", required_argument, NULL, OPT_TOP_K},
+            {"hh-domains", required_argument, NULL, OPT_HH_DOMAINS},
+            {"tcp", no_argument, NULL, OPT_TCP},
+            {"columns", required_argument, NULL, OPT_COLUMNS},
+            {"filter", required_argument, NULL, OPT_FILTER},
+            {"writer-queue", required_argument, NULL, OPT_WRITER_QUEUE},
+            {"writer-full", required_argument, NULL, OPT_WRITER_FULL},
+            {"output", required_argument, NULL, OPT_OUTPUT},
+            {"rotate-bytes", required_argument, NULL, OPT_ROTATE_BYTES},
+            {"rotate-keep", required_argument, NULL, OPT_ROTATE_KEEP},
+            {"io-uring", no_argument, NULL, OPT_IO_URING},
+            {"forward", required_argument, NULL, OPT_FORWARD},
+            {"forward-filtered", no_argument, NULL, OPT_FORWARD_FILTERED},
+            {"sampling", required_argument, NULL, OPT_SAMPLING},
+            {"biflow", required_argument, NULL, OPT_BIFLOW},
+            {"biflow-max", required_argument, NULL, OPT_BIFLOW_MAX},
+            DAEMON_LONG_OPTIONS,
+            VLOG_LONG_OPTIONS,
+            {NULL, 0, NULL, 0},
+    };
+    char *short_options = ovs_cmdl_long_options_to_short_options(long_options);
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case 'h':
+                usage();
+            case OPT_BATCH:
+                if (!str_to_int(optarg, 10, &batch_size)
+                    || batch_size < 1 || batch_size > 1024) {
+                    ovs_fatal(0, "--batch argument must be between 1 and "
+                              "1024");
+                }
+                break;
+            case OPT_THREADS:
+                if (!str_to_int(optarg, 10, &n_threads)
+                    || n_threads < 1 || n_threads > 64) {
+                    ovs_fatal(0, "--threads argument must be between 1 and "
+                              "64");
+                }
+                break;
+            case OPT_FLUSH_BYTES:
+                if (!str_to_int(optarg, 10, &flush_bytes) || flush_bytes < 0) {
+                    ovs_fatal(0, "--flush-bytes argument must be "
+                              "nonnegative");
+                }
+                break;
+            case OPT_FLUSH_MS:
+                if (!str_to_int(optarg, 10, &flush_ms) || flush_ms < 0) {
+                    ovs_fatal(0, "--flush-ms argument must be nonnegative");
+                }
+                break;
+            case OPT_CAPTURE:
+                capture_file = optarg;
+                break;
+            case OPT_NO_TEXT:
+                print_records = false;
+                break;
+            case OPT_SEQ_PER_MESSAGE:
+                seq_per_message = true;
+                break;
+            case OPT_AGGREGATE:
+                if (!str_to_int(optarg, 10, &agg_max_flows)
+                    || agg_max_flows < 1 || agg_max_flows > 16777216) {
+                    ovs_fatal(0, "--aggregate argument must be between 1 and "
+                              "16777216");
+                }
+                break;
+            case OPT_DUMP_INTERVAL:
+                if (!str_to_int(optarg, 10, &agg_dump_interval)
+                    || agg_dump_interval < 0
+                    || agg_dump_interval > 86400000) {
+                    ovs_fatal(0, "--dump-interval argument must be between 0 "
+                              "and 86400000");
+                }
+                break;
+            case OPT_TOP_K:
+                if (!str_to_int(optarg, 10, &hh_top_k)
+                    || hh_top_k < 0 || hh_top_k > 1024) {
+                    ovs_fatal(0, "--top-k argument must be between 0 and "
+                              "1024");
+                }
+                break;
+            case OPT_HH_DOMAINS:
+                if (!str_to_int(optarg, 10, &hh_max_domains)
+                    || hh_max_domains < 1 || hh_max_domains > 1024) {
+                    ovs_fatal(0, "--hh-domains argument must be between 1 "
+                              "and 1024");
+                }
+                break;
+            case OPT_TCP:
+                tcp_mode = true;
+                break;
+            case OPT_IO_URING:
+                use_io_uring = true;
+                break;
+            case OPT_FORWARD: {
+                struct sockaddr_storage ss;
+
+                if ((strncmp(optarg, "udp:", 4) && strncmp(optarg, "tcp:", 4))
+                    || !inet_parse_active(optarg + 4, 0, &ss)) {
+                    ovs_fatal(0, "--forward: %s: target must be "
+                              "udp:IP:PORT or tcp:IP:PORT", optarg);
+                }
+                if (n_forward_targets >= allocated_forward_targets) {
+                    forward_targets = x2nrealloc(forward_targets,
+                                                 &allocated_forward_targets,
+                                                 sizeof *forward_targets);
+                }
+                forward_targets[n_forward_targets++] = optarg;
+                break;
+            }
+            case OPT_FORWARD_FILTERED:
+                forward_filtered = true;
+                break;
+            case OPT_SAMPLING:
+                if (!str_to_int(optarg, 10, &default_sampling)
+                    || default_sampling < 1) {
+                    ovs_fatal(0, "--sampling argument must be positive");
+                }
+                break;
+            case OPT_BIFLOW:
+                if (!str_to_int(optarg, 10, &biflow_window)
+                    || biflow_window < 1) {
+                    ovs_fatal(0, "--biflow argument must be positive");
+                }
+                break;
+            case OPT_BIFLOW_MAX:
+                if (!str_to_int(optarg, 10, &biflow_max)
+                    || biflow_max < 1 || biflow_max > 16777216) {
+                    ovs_fatal(0, "--biflow-max argument must be between 1 "
+                              "and 16777216");
+                }
+                break;
+            case OPT_COLUMNS:
+                columns_isa = optarg;
+                break;
+            case OPT_FILTER: {
+                char *error;
+
+                ipfix_filter_destroy(filter);
+                filter = NULL;
+                error = ipfix_filter_parse(optarg, &filter);
+                if (error) {
+                    ovs_fatal(0, "--filter: %s", error);
+                }
+                break;
+            }
+            case OPT_WRITER_QUEUE:
+                if (!str_to_int(optarg, 10, &writer_queue)
+                    || writer_queue < 0 || writer_queue > 1024) {
+                    ovs_fatal(0, "--writer-queue argument must be between 0 "
+                              "and 1024");
+                }
+                break;
+            case OPT_WRITER_FULL:
+                if (!strcmp(optarg, "drop")) {
+                    writer_drop = true;
+                } else if (!strcmp(optarg, "block")) {
+                    writer_drop = false;
+                } else {
+                    ovs_fatal(0, "--writer-full must be drop or block");
+                }
+                break;
+            case OPT_OUTPUT:
+                output_file = optarg;
+                break;
+            case OPT_ROTATE_BYTES:
+                if (!str_to_llong(optarg, 10, &rotate_bytes)
+                    || rotate_bytes < 0) {
+                    ovs_fatal(0, "--rotate-bytes argument must be "
+                              "nonnegative");
+                }
+                break;
+            case OPT_ROTATE_KEEP:
+                if (!str_to_int(optarg, 10, &rotate_keep)
+                    || rotate_keep < 1 || rotate_keep > 99) {
+                    ovs_fatal(0, "--rotate-keep argument must be between 1 "
+                              "and 99");
+                }
+                break;
+                DAEMON_OPTION_HANDLERS
+                VLOG_OPTION_HANDLERS
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+    free(short_options);
+}
+
+static void
+usage(void){
+    printf("%s: ipfix collector test utility\n"
+                   "usage: %s [OPTIONS] PORT[:IP]\n"
+                   "where PORT is the UDP port to listen on and IP is optionally\n"
+                   "the IP address to listen on.\n",
+           program_name, program_name);
+    daemon_usage();
+    vlog_usage();
+    printf("\nOther options:\n"
+           "  --batch=N                   receive up to N datagrams per "
+           "wakeup (default 32)\n"
+           "  --threads=N                 receive on N SO_REUSEPORT sockets, "
+           "one thread each\n"
+           "  --flush-bytes=N             buffer up to N bytes of output "
+           "across batches\n"
+           "  --flush-ms=MS               write buffered output after at "
+           "most MS ms (default 100)\n"
+           "  --capture=FILE              append decoded records to binary "
+           "capture FILE\n"
+           "  --no-text                   do not print decoded records\n"
+           "  --seq-per-message           sequence numbers count messages, "
+           "not records\n"
+           "  --aggregate=N               aggregate up to N flows per "
+           "thread\n"
+           "  --dump-interval=MS          print aggregated flows every MS "
+           "ms\n"
+           "  --top-k=K                   track the K heaviest addresses "
+           "(default 10, 0 to disable)\n"
+           "  --hh-domains=N              track heavy hitters of up to N "
+           "domains (default 8)\n"
+           "  --tcp                       accept exporters over TCP instead "
+           "of UDP\n"
+           "  --io-uring                  receive through an io_uring "
+           "multishot recvmsg,\n"
+           "                              falling back to recvmmsg() if "
+           "unavailable\n"
+           "  --forward=udp:IP:PORT|tcp:IP:PORT\n"
+           "                              re-export every message received "
+           "to a downstream\n"
+           "                              collector (may be repeated)\n"
+           "  --forward-filtered          re-export only messages with a "
+           "template set or a\n"
+           "                              record that passes --filter\n"
+           "  --sampling=N                assume 1-in-N packet sampling "
+           "where the exporter\n"
+           "                              announces none (default 1)\n"
+           "  --biflow=MS                 stitch the records of the two "
+           "directions of a\n"
+           "                              conversation seen within MS ms "
+           "into biflows\n"
+           "  --biflow-max=N              hold at most N biflows per thread "
+           "(default 16384)\n"
+           "  --columns=ISA               bulk decode with auto (default), "
+           "scalar, sse4,\n"
+           "                              avx2 or off\n"
+           "  --filter=EXPR               process only records that match "
+           "EXPR, e.g.\n"
+           "                              \"ip_pro=6 and dst_port!=0-1023 or "
+           "src_ip=10.0.0.0/8\",\n"
+           "                              on fields obs_point_id, eth_type, "
+           "vlan_id, ip_pro,\n"
+           "                              src_port, dst_port, src_ip, "
+           "dst_ip, src_mac, dst_mac\n"
+           "                              (FIELD!=VALUE holds for records "
+           "without FIELD)\n"
+           "  --writer-queue=N            write output from a separate "
+           "thread, queuing up\n"
+           "                              to N buffers per thread\n"
+           "  --writer-full=drop|block    drop output or wait when a queue "
+           "is full\n"
+           "                              (default block)\n"
+           "  --output=FILE               write records to FILE instead of "
+           "stdout\n"
+           "  --rotate-bytes=N            rotate FILE when it would exceed N "
+           "bytes\n"
+           "  --rotate-keep=N             keep N rotated files, FILE.1 to "
+           "FILE.N (default 1)\n"
+           "  -h, --help                  display this help message\n");
+    exit(EXIT_SUCCESS);
+}
+
+static void
+test_ipfix_exit(struct unixctl_conn *conn,
+                int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                void *exiting_)
+{
+    bool *exiting = exiting_;
+    *exiting = true;
+    unixctl_command_reply(conn, NULL);
+}
+
+static void
+test_ipfix_batch_stats(struct unixctl_conn *conn,
+                       int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                       void *aux OVS_UNUSED)
+{
+    unsigned long long int n_batches = 0, n_datagrams = 0, n_drained = 0;
+    unsigned long long int n_records = 0, n_truncated = 0;
+    unsigned long long int n_accepted = 0, n_closed = 0, n_framing = 0;
+    unsigned long long int n_tcp_bytes = 0;
+    unsigned long long int n_arms = 0, n_nobufs = 0, n_uring_errors = 0;
+    struct ds s = DS_EMPTY_INITIALIZER;
+    size_t max_fill = 0, n_conns = 0, n_urings = 0;
+
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+
+        ovs_mutex_lock(&w->mutex);
+        n_batches += w->ring.n_batches;
+        n_datagrams += w->ring.n_datagrams;
+        n_drained += w->ring.n_drained;
+        n_truncated += w->ring.n_truncated;
+        n_records += ipfix_counter_read(w->collector.counters,
+                                        IPFIX_CTR_RECORDS);
+        max_fill = MAX(max_fill, w->ring.max_fill);
+        n_conns += w->n_conns;
+        n_accepted += w->n_accepted;
+        n_closed += w->n_closed;
+        n_framing += w->n_framing_errors;
+        n_tcp_bytes += w->n_tcp_bytes;
+#ifdef IPFIX_HAVE_IO_URING
+        if (w->ring.uring) {
+            n_urings++;
+            n_arms += w->ring.uring->n_arms;
+            n_nobufs += w->ring.uring->n_nobufs;
+            n_uring_errors += w->ring.uring->n_errors;
+        }
+#endif
+        if (n_workers > 1) {
+            ds_put_format(&s, "worker %"PRIuSIZE": %llu datagrams, "
+                          "%llu records\n", i, w->ring.n_datagrams,
+                          ipfix_counter_read(w->collector.counters,
+                                             IPFIX_CTR_RECORDS));
+        }
+        ovs_mutex_unlock(&w->mutex);
+    }
+
+    ds_put_format(&s, "batch size: %d\n", batch_size);
+    ds_put_format(&s, "batches: %llu\n", n_batches);
+    ds_put_format(&s, "datagrams: %llu\n", n_datagrams);
+    ds_put_format(&s, "average fill: %.2f\n",
+                  n_batches ? (double) n_datagrams / n_batches : 0.0);
+    ds_put_format(&s, "max fill: %"PRIuSIZE"\n", max_fill);
+    ds_put_format(&s, "drained to empty: %llu\n", n_drained);
+    ds_put_format(&s, "truncated: %llu\n", n_truncated);
+    ds_put_format(&s, "records: %llu\n", n_records);
+    if (tcp_mode) {
+        ds_put_format(&s, "tcp connections: %"PRIuSIZE" (accepted %llu, "
+                      "closed %llu, framing errors %llu)\n",
+                      n_conns, n_accepted, n_closed, n_framing);
+        ds_put_format(&s, "tcp bytes: %llu\n", n_tcp_bytes);
+    }
+    if (use_io_uring) {
+        ds_put_format(&s, "io_uring: %"PRIuSIZE" of %"PRIuSIZE" workers "
+                      "(recvmsg submissions %llu, out of buffers %llu, "
+                      "errors %llu)\n", n_urings, n_workers, n_arms,
+                      n_nobufs, n_uring_errors);
+    }
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static int
+compare_seq_streams(const void *a_, const void *b_)
+{
+    const struct ipfix_seq_stream *const *a = a_;
+    const struct ipfix_seq_stream *const *b = b_;
+    const struct ipfix_template_key *ak = &(*a)->key, *bk = &(*b)->key;
+    int cmp = memcmp(&ak->exporter, &bk->exporter, sizeof ak->exporter);
+
+    if (cmp) {
+        return cmp;
+    } else if (ak->exporter_port != bk->exporter_port) {
+        return ntohs(ak->exporter_port) < ntohs(bk->exporter_port) ? -1 : 1;
+    } else {
+        return (ak->obs_domain > bk->obs_domain)
+                - (ak->obs_domain < bk->obs_domain);
+    }
+}
+
+static void
+format_stream_exporter(struct ds *s, const struct ipfix_template_key *key)
+{
+    char buf[INET6_ADDRSTRLEN];
+
+    if (IN6_IS_ADDR_V4MAPPED(&key->exporter)) {
+        inet_ntop(AF_INET, &key->exporter.s6_addr[12], buf, sizeof buf);
+        ds_put_format(s, "%s:%"PRIu16, buf, ntohs(key->exporter_port));
+    } else {
+        inet_ntop(AF_INET6, &key->exporter, buf, sizeof buf);
+        ds_put_format(s, "[%s]:%"PRIu16, buf, ntohs(key->exporter_port));
+    }
+}
+
+static void
+format_seq_stream(struct ds *s, const struct ipfix_seq_stream *stream)
+{
+    const struct ipfix_template_key *key = &stream->key;
+
+    format_stream_exporter(s, key);
+    ds_put_format(s, ", domain %"PRIu32": messages %llu, records %llu, "
+                  "next seq %"PRIu32"\n", key->obs_domain,
+                  stream->n_messages, stream->n_records, stream->next_seq);
+    ds_put_format(s, "  gaps %llu (%llu lost), duplicates %llu, "
+                  "reorders %llu, resets %llu\n", stream->n_gaps,
+                  stream->n_lost, stream->n_duplicates, stream->n_reorders,
+                  stream->n_resets);
+}
+
+static void
+test_ipfix_stats(struct unixctl_conn *conn,
+                 int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                 void *aux OVS_UNUSED)
+{
+    struct ipfix_seq_stream **streams = NULL;
+    struct ipfix_seq_stream total;
+    size_t n = 0, allocated = 0;
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    /* Snapshot every worker's streams, since a worker may add or update
+     * them as soon as its mutex is released. */
+    memset(&total, 0, sizeof total);
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        const struct ipfix_seq_stream *stream;
+
+        ovs_mutex_lock(&w->mutex);
+        HMAP_FOR_EACH (stream, hmap_node, &w->collector.streams) {
+            if (n >= allocated) {
+                streams = x2nrealloc(streams, &allocated, sizeof *streams);
+            }
+            streams[n++] = xmemdup(stream, sizeof *stream);
+            total.n_messages += stream->n_messages;
+            total.n_records += stream->n_records;
+            total.n_gaps += stream->n_gaps;
+            total.n_lost += stream->n_lost;
+            total.n_duplicates += stream->n_duplicates;
+            total.n_reorders += stream->n_reorders;
+            total.n_resets += stream->n_resets;
+        }
+        ovs_mutex_unlock(&w->mutex);
+    }
+
+    qsort(streams, n, sizeof *streams, compare_seq_streams);
+    for (size_t i = 0; i < n; i++) {
+        format_seq_stream(&s, streams[i]);
+        free(streams[i]);
+    }
+    free(streams);
+    ds_put_format(&s, "total: %"PRIuSIZE" streams, messages %llu, "
+                  "records %llu\n", n, total.n_messages, total.n_records);
+    ds_put_format(&s, "  gaps %llu (%llu lost), duplicates %llu, "
+                  "reorders %llu, resets %llu\n", total.n_gaps, total.n_lost,
+                  total.n_duplicates, total.n_reorders, total.n_resets);
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_latency(struct unixctl_conn *conn,
+                   int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                   void *aux OVS_UNUSED)
+{
+    struct ipfix_hist *stages = xzalloc(IPFIX_N_STAGES * sizeof *stages);
+    struct ipfix_seq_stream **streams = NULL;
+    size_t n = 0, allocated = 0;
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    /* Snapshot every stream with its domain cleared, so that sorting
+     * brings together the streams of each exporter. */
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        const struct ipfix_seq_stream *stream;
+
+        ovs_mutex_lock(&w->mutex);
+        HMAP_FOR_EACH (stream, hmap_node, &w->collector.streams) {
+            if (n >= allocated) {
+                streams = x2nrealloc(streams, &allocated, sizeof *streams);
+            }
+            streams[n] = xmemdup(stream, sizeof *stream);
+            streams[n++]->key.obs_domain = 0;
+        }
+        for (size_t j = 0; j < IPFIX_N_STAGES; j++) {
+            ipfix_hist_merge(&stages[j], &w->stages[j]);
+        }
+        ovs_mutex_unlock(&w->mutex);
+    }
+
+    qsort(streams, n, sizeof *streams, compare_seq_streams);
+    for (size_t i = 0; i < n; ) {
+        struct ipfix_seq_stream *exporter = streams[i];
+
+        while (++i < n && !compare_seq_streams(&exporter, &streams[i])) {
+            ipfix_hist_merge(&exporter->export_latency,
+                             &streams[i]->export_latency);
+            ipfix_hist_merge(&exporter->record_latency,
+                             &streams[i]->record_latency);
+            exporter->n_messages += streams[i]->n_messages;
+            exporter->n_future += streams[i]->n_future;
+            free(streams[i]);
+        }
+
+        format_stream_exporter(&s, &exporter->key);
+        ds_put_format(&s, ": messages %llu, exported in the future %llu\n",
+                      exporter->n_messages, exporter->n_future);
+        format_hist(&s, "export latency", &exporter->export_latency, "us");
+        format_hist(&s, "record latency", &exporter->record_latency, "us");
+        free(exporter);
+    }
+    free(streams);
+
+    ds_put_format(&s, "stages per batch:\n");
+    for (size_t i = 0; i < IPFIX_N_STAGES; i++) {
+        format_hist(&s, ipfix_stage_names[i], &stages[i], "ns");
+    }
+    free(stages);
+
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_latency_clear(struct unixctl_conn *conn,
+                         int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                         void *aux OVS_UNUSED)
+{
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        struct ipfix_seq_stream *stream;
+
+        ovs_mutex_lock(&w->mutex);
+        HMAP_FOR_EACH (stream, hmap_node, &w->collector.streams) {
+            ipfix_latency_clear(stream);
+        }
+        memset(w->stages, 0, sizeof w->stages);
+        ovs_mutex_unlock(&w->mutex);
+    }
+    unixctl_command_reply(conn, NULL);
+}
+
+static const char *const ipfix_sampling_source_names[] = {
+    [IPFIX_SAMPLING_NONE] = "none announced",
+    [IPFIX_SAMPLING_OPTION] = "--sampling",
+    [IPFIX_SAMPLING_EXPORTER] = "exporter",
+};
+
+static void
+format_sampling_estimate(struct ds *s, const char *name,
+                         unsigned long long int sampled, double unsampled,
+                         double var)
+{
+    ds_put_format(s, "  %s: sampled %llu, estimated %.0f +/- %.0f\n",
+                  name, sampled, sampled + unsampled, IPFIX_Z95 * sqrt(var));
+}
+
+/* Appends to 's' the exporter statistics of 'es', as sent by the exporter
+ * and as received by the collector, with their differences. */
+static void
+format_exporter_stats(struct ds *s, const struct ipfix_exporter_stats *es)
+{
+    static const struct {
+        const char *name;
+        enum ipfix_option opt;
+    } sent[] = {
+        { "messages", IPFIX_OPT_EXPORTED_MESSAGES },
+        { "records", IPFIX_OPT_EXPORTED_RECORDS },
+        { "octets", IPFIX_OPT_EXPORTED_OCTETS },
+    }, not_sent[] = {
+        { "records", IPFIX_OPT_NOT_SENT_RECORDS },
+        { "packets", IPFIX_OPT_NOT_SENT_PACKETS },
+        { "octets", IPFIX_OPT_NOT_SENT_OCTETS },
+    }, ignored[] = {
+        { "packets", IPFIX_OPT_IGNORED_PACKETS },
+        { "octets", IPFIX_OPT_IGNORED_OCTETS },
+    };
+    const unsigned long long int rx[] = {
+        es->rx_messages, es->rx_records, es->rx_bytes
+    };
+    const struct ipfix_options_rec *rec = &es->rec;
+    const char *sep;
+
+    ds_put_format(s, "  exporter totals (%s scope):\n",
+                  es->process_scope ? "process" : "domain");
+    for (size_t i = 0; i < ARRAY_SIZE(sent); i++) {
+        if (ipfix_options_has(rec, sent[i].opt)) {
+            unsigned long long int n = rec->values[sent[i].opt];
+
+            ds_put_format(s, "    %s: sent %llu, received %llu, "
+                          "missing %lld\n", sent[i].name, n, rx[i],
+                          (long long int) (n - rx[i]));
+        }
+    }
+
+    sep = "    not sent: ";
+    for (size_t i = 0; i < ARRAY_SIZE(not_sent); i++) {
+        if (ipfix_options_has(rec, not_sent[i].opt)) {
+            ds_put_format(s, "%s%s %"PRIu64, sep, not_sent[i].name,
+                          rec->values[not_sent[i].opt]);
+            sep = ", ";
+        }
+    }
+    if (*sep == ',') {
+        ds_put_char(s, '\n');
+    }
+
+    sep = "    ignored: ";
+    for (size_t i = 0; i < ARRAY_SIZE(ignored); i++) {
+        if (ipfix_options_has(rec, ignored[i].opt)) {
+            ds_put_format(s, "%s%s %"PRIu64, sep, ignored[i].name,
+                          rec->values[ignored[i].opt]);
+            sep = ", ";
+        }
+    }
+    if (*sep == ',') {
+        ds_put_char(s, '\n');
+    }
+}
+
+static void
+format_sampling_stream(struct ds *s, const struct ipfix_seq_stream *stream)
+{
+    format_stream_exporter(s, &stream->key);
+    ds_put_format(s, ", domain %"PRIu32": ", stream->key.obs_domain);
+    if (stream->sampling_p < 1) {
+        ds_put_format(s, "sampling probability %.6g (1 in %.6g)",
+                      stream->sampling_p, 1.0 / stream->sampling_p);
+    } else {
+        ds_put_cstr(s, "unsampled");
+    }
+    ds_put_format(s, " (%s), records %llu\n",
+                  ipfix_sampling_source_names[stream->sampling_source],
+                  stream->n_records);
+    format_sampling_estimate(s, "packets", stream->sampled_packets,
+                             stream->unsampled_packets, stream->var_packets);
+    format_sampling_estimate(s, "octets", stream->sampled_octets,
+                             stream->unsampled_octets, stream->var_octets);
+    if (stream->exporter_stats.rec.present) {
+        format_exporter_stats(s, &stream->exporter_stats);
+    }
+}
+
+static void
+test_ipfix_sampling(struct unixctl_conn *conn,
+                    int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                    void *aux OVS_UNUSED)
+{
+    struct ipfix_seq_stream **streams = NULL;
+    struct ipfix_seq_stream total;
+    size_t n = 0, allocated = 0;
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    /* Estimates of different streams are independent, so their variances
+     * add up. */
+    memset(&total, 0, sizeof total);
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        const struct ipfix_seq_stream *stream;
+
+        ovs_mutex_lock(&w->mutex);
+        HMAP_FOR_EACH (stream, hmap_node, &w->collector.streams) {
+            if (n >= allocated) {
+                streams = x2nrealloc(streams, &allocated, sizeof *streams);
+            }
+            streams[n++] = xmemdup(stream, sizeof *stream);
+            total.sampled_packets += stream->sampled_packets;
+            total.sampled_octets += stream->sampled_octets;
+            total.unsampled_packets += stream->unsampled_packets;
+            total.var_packets += stream->var_packets;
+            total.unsampled_octets += stream->unsampled_octets;
+            total.var_octets += stream->var_octets;
+        }
+        ovs_mutex_unlock(&w->mutex);
+    }
+
+    qsort(streams, n, sizeof *streams, compare_seq_streams);
+    for (size_t i = 0; i < n; i++) {
+        format_sampling_stream(&s, streams[i]);
+        free(streams[i]);
+    }
+    free(streams);
+    ds_put_format(&s, "total: %"PRIuSIZE" streams\n", n);
+    format_sampling_estimate(&s, "packets", total.sampled_packets,
+                             total.unsampled_packets, total.var_packets);
+    format_sampling_estimate(&s, "octets", total.sampled_octets,
+                             total.unsampled_octets, total.var_octets);
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static const char *const ipfix_counter_names[IPFIX_N_COUNTERS] = {
+#define IPFIX_COUNTER_NAME(ENUM, NAME) NAME,
+    IPFIX_COUNTERS(IPFIX_COUNTER_NAME)
+#undef IPFIX_COUNTER_NAME
+};
+
+/* Returns the sum of every worker's counter 'idx' since the last
+ * ipfix/reset-counters. */
+static unsigned long long int
+ipfix_counter_total(size_t idx)
+{
+    unsigned long long int total = 0;
+
+    for (size_t i = 0; i < n_workers; i++) {
+        const struct ipfix_worker *w = &workers[i];
+
+        total += (ipfix_counter_read(w->collector.counters, idx)
+                  - w->counters_zero[idx]);
+    }
+    return total;
+}
+
+static void
+test_ipfix_show(struct unixctl_conn *conn,
+                int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                void *aux OVS_UNUSED)
+{
+    unsigned long long int totals[IPFIX_N_COUNTER_SLOTS];
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    for (size_t i = 0; i < IPFIX_N_COUNTER_SLOTS; i++) {
+        totals[i] = ipfix_counter_total(i);
+    }
+
+    for (size_t i = 0; i < IPFIX_N_COUNTERS; i++) {
+        ds_put_format(&s, "%s: %llu\n", ipfix_counter_names[i], totals[i]);
+    }
+    ds_put_cstr(&s, "data records by set ID:\n");
+    for (size_t i = 0; i <= IPFIX_N_OVS_TEMPLATE_IDS; i++) {
+        unsigned long long int n = totals[IPFIX_CTR_SET_RECORDS + i];
+
+        if (!n) {
+            continue;
+        } else if (i < IPFIX_N_OVS_TEMPLATE_IDS) {
+            ds_put_format(&s, "  %"PRIuSIZE": %llu\n",
+                          i + IPFIX_SET_ID_DATA_MIN, n);
+        } else {
+            ds_put_format(&s, "  other: %llu\n", n);
+        }
+    }
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_writer_stats(struct unixctl_conn *conn,
+                        int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                        void *aux OVS_UNUSED)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    ds_put_format(&s, "output: %s, bytes %llu, writes %llu, errors %llu, "
+                  "rotations %llu\n", output_file ? output_file : "stdout",
+                  ipfix_counter_get(&output_bytes),
+                  ipfix_counter_get(&output_writes),
+                  ipfix_counter_get(&output_errors),
+                  ipfix_counter_get(&output_rotations));
+    if (!out_rings) {
+        ds_put_cstr(&s, "writer thread: disabled\n");
+    } else {
+        ds_put_format(&s, "writer thread: %d buffers per thread, %s when "
+                      "full\n", writer_queue, writer_drop ? "drop" : "block");
+    }
+    for (size_t i = 0; i < n_out_rings; i++) {
+        struct ipfix_out_ring *ring = out_rings[i];
+        unsigned long long int head = ipfix_counter_get(&ring->head);
+        unsigned long long int tail = ipfix_counter_get(&ring->tail);
+
+        if (i < n_workers) {
+            ds_put_format(&s, "  thread %"PRIuSIZE":", i);
+        } else {
+            ds_put_cstr(&s, "  main:");
+        }
+        ds_put_format(&s, " buffers %llu, queued %llu, dropped %llu "
+                      "(%llu bytes), stalls %llu\n", head,
+                      head >= tail ? head - tail : 0,
+                      ipfix_counter_get(&ring->n_dropped),
+                      ipfix_counter_get(&ring->n_dropped_bytes),
+                      ipfix_counter_get(&ring->n_stalls));
+    }
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_forward_stats(struct unixctl_conn *conn,
+                         int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                         void *aux OVS_UNUSED)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    if (!n_forward_targets) {
+        ds_put_cstr(&s, "forwarding: disabled\n");
+    }
+    for (size_t i = 0; i < n_forward_targets; i++) {
+        unsigned long long int n_messages = 0, n_bytes = 0, n_dropped = 0;
+        unsigned long long int n_connects = 0;
+        size_t n_connected = 0, n_queued = 0;
+
+        for (size_t j = 0; j < n_workers; j++) {
+            struct ipfix_worker *w = &workers[j];
+            const struct ipfix_fwd_target *t;
+
+            ovs_mutex_lock(&w->mutex);
+            t = &w->fwd.targets[i];
+            n_messages += t->n_messages;
+            n_bytes += t->n_bytes;
+            n_dropped += t->n_dropped;
+            n_connects += t->n_connects;
+            n_connected += t->fd >= 0 && !t->connecting;
+            n_queued += t->end - t->start;
+            ovs_mutex_unlock(&w->mutex);
+        }
+
+        ds_put_format(&s, "%s: messages %llu, bytes %llu, dropped %llu",
+                      forward_targets[i], n_messages, n_bytes, n_dropped);
+        if (!strncmp(forward_targets[i], "tcp:", 4)) {
+            ds_put_format(&s, ", connected %"PRIuSIZE" of %"PRIuSIZE
+                          " (connects %llu), queued %"PRIuSIZE" bytes",
+                          n_connected, n_workers, n_connects, n_queued);
+        }
+        ds_put_char(&s, '\n');
+    }
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_reset_counters(struct unixctl_conn *conn,
+                          int argc OVS_UNUSED, const char *argv[] OVS_UNUSED,
+                          void *aux OVS_UNUSED)
+{
+    /* The workers keep counting; a reset only moves the baseline. */
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+
+        for (size_t j = 0; j < IPFIX_N_COUNTER_SLOTS; j++) {
+            w->counters_zero[j] = ipfix_counter_read(w->collector.counters,
+                                                     j);
+        }
+    }
+    unixctl_command_reply(conn, NULL);
+}
+
+/* Returns the number of data records decoded since the last
+ * ipfix/reset-counters, synchronizing with the workers as described at
+ * 'records_waiting'. */
+static unsigned long long int
+ipfix_records_total(void)
+{
+    unsigned long long int total = 0;
+
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+
+        ovs_mutex_lock(&w->mutex);
+        total += (ipfix_counter_read(w->collector.counters,
+                                     IPFIX_CTR_RECORDS)
+                  - w->counters_zero[IPFIX_CTR_RECORDS]);
+        ovs_mutex_unlock(&w->mutex);
+    }
+    return total;
+}
+
+/* Returns true if no worker has a datagram or TCP data waiting to be read
+ * and no worker is in the middle of a batch or has messages queued for a
+ * --forward target, that is, if everything that reached the collector's
+ * sockets before the call has been decoded and forwarded. */
+static bool
+ipfix_workers_drained(void)
+{
+    bool drained = true;
+
+    for (size_t i = 0; drained && i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        int n;
+
+        ovs_mutex_lock(&w->mutex);
+        if (!tcp_mode) {
+            drained = !ioctl(w->sock, FIONREAD, &n) && !n;
+#ifdef IPFIX_HAVE_IO_URING
+            if (drained && w->ring.uring) {
+                drained = !ipfix_uring_pending(w->ring.uring);
+            }
+#endif
+        }
+        for (size_t j = 0; drained && j < w->n_conns; j++) {
+            drained = !ioctl(w->conns[j]->fd, FIONREAD, &n) && !n;
+        }
+        if (drained) {
+            drained = ipfix_fwd_idle(&w->fwd);
+        }
+        ovs_mutex_unlock(&w->mutex);
+    }
+    return drained;
+}
+
+static void
+ipfix_records_wait_add(struct unixctl_conn *conn, bool drain,
+                       int n_records, int timeout)
+{
+    struct ipfix_records_wait *wait;
+
+    if (n_records_waits >= allocated_records_waits) {
+        records_waits = x2nrealloc(records_waits, &allocated_records_waits,
+                                   sizeof *records_waits);
+    }
+    wait = &records_waits[n_records_waits++];
+    wait->conn = conn;
+    wait->drain = drain;
+    wait->n_records = n_records;
+    wait->deadline = time_msec() + timeout;
+    atomic_store_relaxed(&records_waiting, true);
+}
+
+static void
+test_ipfix_wait_records(struct unixctl_conn *conn, int argc,
+                        const char *argv[], void *aux OVS_UNUSED)
+{
+    int n_records, timeout = IPFIX_WAIT_RECORDS_TIMEOUT;
+
+    if (!str_to_int(argv[1], 10, &n_records) || n_records < 0) {
+        unixctl_command_reply_error(conn, "bad record count");
+        return;
+    }
+    if (argc > 2 && (!str_to_int(argv[2], 10, &timeout) || timeout < 0)) {
+        unixctl_command_reply_error(conn, "bad timeout");
+        return;
+    }
+    ipfix_records_wait_add(conn, false, n_records, timeout);
+}
+
+/* Waits until everything that reached the collector before the command
+ * has been decoded.  Once the exporters are quiet, e.g. after a test has
+ * flushed them, the record counts are final, even when the test cannot
+ * know in advance how many records to wait for. */
+static void
+test_ipfix_wait_drained(struct unixctl_conn *conn, int argc,
+                        const char *argv[], void *aux OVS_UNUSED)
+{
+    int timeout = IPFIX_WAIT_RECORDS_TIMEOUT;
+
+    if (argc > 1 && (!str_to_int(argv[1], 10, &timeout) || timeout < 0)) {
+        unixctl_command_reply_error(conn, "bad timeout");
+        return;
+    }
+    ipfix_records_wait_add(conn, true, 0, timeout);
+}
+
+/* Replies to the ipfix/wait-records commands whose records have arrived or
+ * whose time is up.  Returns the 'records_seq' value to wait on. */
+static uint64_t
+ipfix_records_wait_run(void)
+{
+    uint64_t seqno = seq_read(records_seq);
+    unsigned long long int total;
+    long long int now;
+    bool drained;
+
+    if (!n_records_waits) {
+        return seqno;
+    }
+    total = ipfix_records_total();
+    drained = ipfix_workers_drained();
+    now = time_msec();
+    for (size_t i = 0; i < n_records_waits; ) {
+        struct ipfix_records_wait *wait = &records_waits[i];
+
+        if (wait->drain ? drained : total >= wait->n_records) {
+            unixctl_command_reply(wait->conn, NULL);
+        } else if (now >= wait->deadline) {
+            char *error = (wait->drain
+                           ? xstrdup("timeout with data still queued")
+                           : xasprintf("timeout with %llu of %llu records",
+                                       total, wait->n_records));
+            unixctl_command_reply_error(wait->conn, error);
+            free(error);
+        } else {
+            i++;
+            continue;
+        }
+        *wait = records_waits[--n_records_waits];
+    }
+    if (!n_records_waits) {
+        atomic_store_relaxed(&records_waiting, false);
+    }
+    return seqno;
+}
+
+static void
+ipfix_records_wait_wait(uint64_t seqno)
+{
+    for (size_t i = 0; i < n_records_waits; i++) {
+        poll_timer_wait_until(records_waits[i].deadline);
+    }
+    if (n_records_waits) {
+        seq_wait(records_seq, seqno);
+    }
+}
+
+static int
+compare_agg_flow_keys(const void *a_, const void *b_)
+{
+    const struct ipfix_agg_flow *a = a_;
+    const struct ipfix_agg_flow *b = b_;
+
+    return memcmp(&a->key, &b->key, sizeof a->key);
+}
+
+static int
+compare_agg_flows(const void *a_, const void *b_)
+{
+    const struct ipfix_agg_flow *a = a_;
+    const struct ipfix_agg_flow *b = b_;
+
+    if (a->packets != b->packets) {
+        return a->packets > b->packets ? -1 : 1;
+    }
+    return compare_agg_flow_keys(a, b);
+}
+
+static void
+format_agg_mac(struct ds *s, const uint8_t mac[6])
+{
+    ds_put_format(s, "%02x:%02x:%02x:%02x:%02x:%02x",
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static void
+format_agg_flow(struct ds *s, const struct ipfix_agg_flow *flow)
+{
+    const struct ipfix_agg_key *key = &flow->key;
+
+    ds_put_cstr(s, "src mac ");
+    format_agg_mac(s, key->src_mac);
+    ds_put_cstr(s, ", dst mac ");
+    format_agg_mac(s, key->dst_mac);
+    ds_put_format(s, ", eth type 0x%04"PRIx16, key->eth_type);
+    if (!IN6_IS_ADDR_UNSPECIFIED(&key->src_ip)
+        || !IN6_IS_ADDR_UNSPECIFIED(&key->dst_ip)) {
+        ds_put_cstr(s, ", src ip ");
+        format_capture_addr(s, &key->src_ip);
+        ds_put_cstr(s, ", dst ip ");
+        format_capture_addr(s, &key->dst_ip);
+        ds_put_format(s, ", protocol %"PRIu8, key->ip_pro);
+    }
+    if (key->src_port || key->dst_port) {
+        ds_put_format(s, ", src port %"PRIu16", dst port %"PRIu16,
+                      key->src_port, key->dst_port);
+    }
+    if (key->ip_pro == IPPROTO_ICMP || key->ip_pro == IPPROTO_ICMPV6) {
+        ds_put_format(s, ", icmp type %"PRIu8", icmp code %"PRIu8,
+                      key->icmp_type, key->icmp_code);
+    }
+    ds_put_format(s, ": records %llu, packets %llu, l2 octets %llu, "
+                  "octets %llu, first %lld.%03lld, last %lld.%03lld",
+                  flow->n_records, flow->packets, flow->l2_octets,
+                  flow->octets, flow->first / 1000, flow->first % 1000,
+                  flow->last / 1000, flow->last % 1000);
+    if (flow->n_sampled) {
+        ds_put_format(s, ", est packets %.0f +/- %.0f, est octets %.0f "
+                      "+/- %.0f", flow->packets + flow->unsampled_packets,
+                      IPFIX_Z95 * sqrt(flow->var_packets),
+                      flow->octets + flow->unsampled_octets,
+                      IPFIX_Z95 * sqrt(flow->var_octets));
+    }
+    ds_put_char(s, '\n');
+}
+
+/* Appends to 's' the 'limit' flows with the most packets, merged across
+ * the workers' flow tables. */
+static void
+ipfix_agg_dump(struct ds *s, size_t limit)
+{
+    unsigned long long int n_dropped = 0;
+    struct ipfix_agg_flow *flows = NULL;
+    size_t n = 0, n_merged = 0, allocated = 0;
+
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        const struct ipfix_agg_table *table;
+
+        ovs_mutex_lock(&w->mutex);
+        table = w->collector.agg;
+        if (n + table->n > allocated) {
+            allocated = n + table->n;
+            flows = xrealloc(flows, allocated * sizeof *flows);
+        }
+        memcpy(&flows[n], table->flows, table->n * sizeof *flows);
+        n += table->n;
+        n_dropped += table->n_dropped;
+        ovs_mutex_unlock(&w->mutex);
+    }
+
+    /* The same flow may have been reported through several workers. */
+    qsort(flows, n, sizeof *flows, compare_agg_flow_keys);
+    for (size_t i = 0; i < n; i++) {
+        const struct ipfix_agg_flow *src = &flows[i];
+
+        if (n_merged && !compare_agg_flow_keys(&flows[n_merged - 1], src)) {
+            struct ipfix_agg_flow *dst = &flows[n_merged - 1];
+
+            dst->n_records += src->n_records;
+            dst->packets += src->packets;
+            dst->l2_octets += src->l2_octets;
+            dst->octets += src->octets;
+            dst->n_sampled += src->n_sampled;
+            dst->unsampled_packets += src->unsampled_packets;
+            dst->var_packets += src->var_packets;
+            dst->unsampled_octets += src->unsampled_octets;
+            dst->var_octets += src->var_octets;
+            dst->first = MIN(dst->first, src->first);
+            dst->last = MAX(dst->last, src->last);
+        } else {
+            flows[n_merged++] = *src;
+        }
+    }
+    qsort(flows, n_merged, sizeof *flows, compare_agg_flows);
+
+    ds_put_format(s, "flows: %"PRIuSIZE", dropped records: %llu\n",
+                  n_merged, n_dropped);
+    for (size_t i = 0; i < MIN(n_merged, limit); i++) {
+        format_agg_flow(s, &flows[i]);
+    }
+    free(flows);
+}
+
+/* Prints the aggregated flows to stdout if the --dump-interval timer
+ * expired, and sets '*next_dump' to the next expiration. */
+static void
+ipfix_agg_dump_run(long long int *next_dump)
+{
+    long long int now = time_msec();
+
+    if (now >= *next_dump) {
+        struct ds s = DS_EMPTY_INITIALIZER;
+
+        ipfix_agg_dump(&s, SIZE_MAX);
+        ipfix_main_output(&s);
+        ds_destroy(&s);
+        *next_dump = now + agg_dump_interval;
+    }
+}
+
+static void
+test_ipfix_flows(struct unixctl_conn *conn, int argc, const char *argv[],
+                 void *aux OVS_UNUSED)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+    size_t limit = SIZE_MAX;
+
+    if (!agg_max_flows) {
+        unixctl_command_reply_error(conn, "flow aggregation is disabled "
+                                    "(use --aggregate)");
+        return;
+    }
+    if (argc > 1) {
+        int n;
+
+        if (!str_to_int(argv[1], 10, &n) || n < 0) {
+            unixctl_command_reply_error(conn, "invalid flow count");
+            return;
+        }
+        limit = n;
+    }
+    ipfix_agg_dump(&s, limit);
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_biflows(struct unixctl_conn *conn, int argc, const char *argv[],
+                   void *aux OVS_UNUSED)
+{
+    struct ipfix_biflow_table total;
+    struct ds s = DS_EMPTY_INITIALIZER;
+    struct ds entries = DS_EMPTY_INITIALIZER;
+    size_t limit = SIZE_MAX;
+
+    if (!biflow_window) {
+        unixctl_command_reply_error(conn, "biflow stitching is disabled "
+                                    "(use --biflow)");
+        return;
+    }
+    if (argc > 1) {
+        int n;
+
+        if (!str_to_int(argv[1], 10, &n) || n < 0) {
+            unixctl_command_reply_error(conn, "invalid biflow count");
+            return;
+        }
+        limit = n;
+    }
+
+    memset(&total, 0, sizeof total);
+    for (size_t i = 0; i < n_workers; i++) {
+        struct ipfix_worker *w = &workers[i];
+        const struct ipfix_biflow_table *table;
+
+        ovs_mutex_lock(&w->mutex);
+        table = w->collector.biflow;
+        total.n += table->n;
+        total.n_records += table->n_records;
+        total.n_skipped += table->n_skipped;
+        total.n_biflows += table->n_biflows;
+        total.n_uniflows += table->n_uniflows;
+        total.n_early += table->n_early;
+        total.n_asymmetric += table->n_asymmetric;
+        for (size_t j = 0; j < table->n && limit; j++, limit--) {
+            format_biflow(&entries,
+                          &table->entries[(table->head + j) % table->max]);
+        }
+        ovs_mutex_unlock(&w->mutex);
+    }
+
+    ds_put_format(&s, "active: %"PRIuSIZE" biflows, window %d ms\n",
+                  total.n, biflow_window);
+    ds_put_format(&s, "records: %llu stitched, %llu skipped\n",
+                  total.n_records, total.n_skipped);
+    ds_put_format(&s, "expired: %llu biflows, %llu uniflows (%llu early), "
+                  "%llu asymmetric\n", total.n_biflows, total.n_uniflows,
+                  total.n_early, total.n_asymmetric);
+    ds_put_buffer(&s, entries.string, entries.length);
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&entries);
+    ds_destroy(&s);
+}
+
+static const char *const hh_dim_names[IPFIX_HH_N_DIMS] = {
+    "src-ip", "dst-ip", "mac-pair"
+};
+
+static const char *const hh_metric_names[IPFIX_HH_N_METRICS] = {
+    "packets", "octets"
+};
+
+/*A heavy hitter candidate, merged across workers*/
+struct ipfix_hh_result{
+    struct ipfix_hh_key key;
+    uint64_t count;
+    uint64_t error;
+};
+
+static int
+compare_hh_keys(const void *a_, const void *b_)
+{
+    const struct ipfix_hh_result *a = a_;
+    const struct ipfix_hh_result *b = b_;
+
+    return memcmp(&a->key, &b->key, sizeof a->key);
+}
+
+static int
+compare_hh_results(const void *a_, const void *b_)
+{
+    const struct ipfix_hh_result *a = a_;
+    const struct ipfix_hh_result *b = b_;
+
+    if (a->count != b->count) {
+        return a->count > b->count ? -1 : 1;
+    }
+    return compare_hh_keys(a_, b_);
+}
+
+static int
+compare_obs_domains(const void *a_, const void *b_)
+{
+    uint32_t a = *(const uint32_t *) a_;
+    uint32_t b = *(const uint32_t *) b_;
+
+    return a < b ? -1 : a > b;
+}
+
+static void
+format_hh_key(struct ds *s, enum ipfix_hh_dim dim,
+              const struct ipfix_hh_key *key)
+{
+    if (dim == IPFIX_HH_MAC_PAIR) {
+        format_agg_mac(s, &key->b[0]);
+        ds_put_cstr(s, "->");
+        format_agg_mac(s, &key->b[6]);
+    } else {
+        format_capture_addr(s, (const struct in6_addr *) key->b);
+    }
+}
+
+/* Appends to 's' the heaviest keys of 'obs_domain' for 'dim' and 'metric'.
+ * A worker that tracks a candidate contributes its count; one that does
+ * not contributes its sketch estimate, which is also added to the error
+ * because the key may never have reached that worker.  The caller must
+ * hold every worker's mutex. */
+static void
+ipfix_hh_dump_domain(struct ds *s, uint32_t obs_domain, enum ipfix_hh_dim dim,
+                     enum ipfix_hh_metric metric)
+{
+    struct ipfix_hh_result *results = NULL;
+    size_t n = 0, n_merged = 0, allocated = 0;
+
+    for (size_t i = 0; i < n_workers; i++) {
+        const struct ipfix_hh_domain *d;
+        const struct ipfix_hh_topk *topk;
+
+        d = ipfix_hh_find_domain(workers[i].collector.hh, obs_domain);
+        if (!d) {
+            continue;
+        }
+        topk = &d->topk[dim][metric];
+        if (n + topk->n > allocated) {
+            allocated = n + topk->n;
+            results = xrealloc(results, allocated * sizeof *results);
+        }
+        for (size_t j = 0; j < topk->n; j++) {
+            results[n].key = topk->entries[j].key;
+            results[n].count = results[n].error = 0;
+            n++;
+        }
+    }
+
+    /* Dedup the candidates, then total them across workers. */
+    qsort(results, n, sizeof *results, compare_hh_keys);
+    for (size_t i = 0; i < n; i++) {
+        if (!n_merged || memcmp(&results[n_merged - 1].key, &results[i].key,
+                                sizeof results[i].key)) {
+            results[n_merged++] = results[i];
+        }
+    }
+    for (size_t i = 0; i < n_merged; i++) {
+        struct ipfix_hh_result *r = &results[i];
+        uint32_t hash = hash_bytes(&r->key, sizeof r->key, 0);
+
+        r->count = r->error = 0;
+        for (size_t j = 0; j < n_workers; j++) {
+            const struct ipfix_hh_domain *d;
+            const struct ipfix_hh_entry *e;
+
+            d = ipfix_hh_find_domain(workers[j].collector.hh, obs_domain);
+            if (!d) {
+                continue;
+            }
+            e = ipfix_hh_topk_find(&d->topk[dim][metric], &r->key, hash);
+            if (e) {
+                r->count += e->count;
+                r->error += e->error;
+            } else {
+                uint64_t estimate = ipfix_hh_estimate(d, dim, metric, hash);
+
+                r->count += estimate;
+                r->error += estimate;
+            }
+        }
+    }
+    qsort(results, n_merged, sizeof *results, compare_hh_results);
+
+    ds_put_format(s, "domain %"PRIu32", %s by %s:\n",
+                  obs_domain, hh_dim_names[dim], hh_metric_names[metric]);
+    for (size_t i = 0; i < MIN(n_merged, (size_t) hh_top_k); i++) {
+        ds_put_cstr(s, "  ");
+        format_hh_key(s, dim, &results[i].key);
+        ds_put_format(s, ": %"PRIu64" (error %"PRIu64")\n",
+                      results[i].count, results[i].error);
+    }
+    free(results);
+}
+
+/* Appends to 's' the heavy hitters of every tracked observation domain for
+ * the dimensions in 'dims' and metrics in 'metrics' (bitmaps). */
+static void
+ipfix_hh_dump(struct ds *s, unsigned int dims, unsigned int metrics)
+{
+    unsigned long long int n_untracked = 0;
+    uint32_t *domains = NULL;
+    size_t n_domains = 0;
+
+    for (size_t i = 0; i < n_workers; i++) {
+        ovs_mutex_lock(&workers[i].mutex);
+    }
+    for (size_t i = 0; i < n_workers; i++) {
+        const struct ipfix_hh *hh = workers[i].collector.hh;
+
+        domains = xrealloc(domains,
+                           (n_domains + hh->n_domains) * sizeof *domains);
+        for (size_t j = 0; j < hh->n_domains; j++) {
+            domains[n_domains++] = hh->domains[j].obs_domain;
+        }
+        n_untracked += hh->n_untracked;
+    }
+    qsort(domains, n_domains, sizeof *domains, compare_obs_domains);
+
+    ds_put_format(s, "untracked records: %llu\n", n_untracked);
+    for (size_t i = 0; i < n_domains; i++) {
+        if (i && domains[i] == domains[i - 1]) {
+            continue;
+        }
+        for (size_t dim = 0; dim < IPFIX_HH_N_DIMS; dim++) {
+            for (size_t m = 0; m < IPFIX_HH_N_METRICS; m++) {
+                if (dims & (1u << dim) && metrics & (1u << m)) {
+                    ipfix_hh_dump_domain(s, domains[i], dim, m);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < n_workers; i++) {
+        ovs_mutex_unlock(&workers[i].mutex);
+    }
+    free(domains);
+}
+
+static bool
+parse_hh_name(const char *name, const char *const names[], size_t n,
+              unsigned int *bits)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!strcmp(name, names[i])) {
+            *bits = 1u << i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+test_ipfix_top(struct unixctl_conn *conn, int argc, const char *argv[],
+               void *aux OVS_UNUSED)
+{
+    unsigned int dims = (1u << IPFIX_HH_N_DIMS) - 1;
+    unsigned int metrics = (1u << IPFIX_HH_N_METRICS) - 1;
+    struct ds s = DS_EMPTY_INITIALIZER;
+
+    if (!hh_top_k) {
+        unixctl_command_reply_error(conn, "heavy hitter tracking is "
+                                    "disabled (use --top-k)");
+        return;
+    }
+    if (argc > 1 && !parse_hh_name(argv[1], hh_dim_names, IPFIX_HH_N_DIMS,
+                                   &dims)) {
+        unixctl_command_reply_error(conn, "unknown dimension (use src-ip, "
+                                    "dst-ip or mac-pair)");
+        return;
+    }
+    if (argc > 2 && !parse_hh_name(argv[2], hh_metric_names,
+                                   IPFIX_HH_N_METRICS, &metrics)) {
+        unixctl_command_reply_error(conn, "unknown metric (use packets or "
+                                    "octets)");
+        return;
+    }
+    ipfix_hh_dump(&s, dims, metrics);
+    unixctl_command_reply(conn, ds_cstr(&s));
+    ds_destroy(&s);
+}
+
+static void
+test_ipfix_main(int argc, char *argv[])
+{
+    struct unixctl_server *server;
+    const char *target;
+    long long int next_dump = LLONG_MAX;
+    bool exiting = false;
+    int *socks;
+    int error;
+    ovs_cmdl_proctitle_init(argc, argv);
+    set_program_name(argv[0]);
+    service_start(&argc, &argv);
+    parse_options(argc, argv);
+    if (argc - optind != 1) {
+        ovs_fatal(0, "exactly one non-option argument required "
+                "(use --help for help)");
+    }
+    if (!ipfix_column_kernels_select(columns_isa)) {
+        ovs_fatal(0, "--columns: %s is unknown or unsupported by this CPU",
+                  columns_isa);
+    }
+    if (rotate_bytes && !output_file) {
+        ovs_fatal(0, "--rotate-bytes requires --output");
+    }
+    if (use_io_uring && tcp_mode) {
+        ovs_fatal(0, "--io-uring does not support --tcp");
+    }
+    if (forward_filtered && (!filter || !n_forward_targets)) {
+        ovs_fatal(0, "--forward-filtered requires --forward and --filter");
+    }
+    target = argv[optind];
+    socks = xmalloc(n_threads * sizeof *socks);
+    if (n_threads == 1) {
+        socks[0] = inet_open_passive(tcp_mode ? SOCK_STREAM : SOCK_DGRAM,
+                                     target, 0, NULL, 0, true);
+        if (socks[0] < 0) {
+            printf("sock<0\n");
+            ovs_fatal(0, "%s: failed to open (%s)", argv[1],
+                      ovs_strerror(-socks[0]));
+        }
+    } else {
+        open_reuseport_sockets(target, tcp_mode ? SOCK_STREAM : SOCK_DGRAM,
+                               socks, n_threads);
+    }
+    daemon_save_fd(STDOUT_FILENO);
+    daemonize_start(false);
+
+    error = unixctl_server_create(NULL, &server);
+    if (error) {
+        ovs_fatal(error, "failed to create unixctl server");
+    }
+    ipfix_builtin_templates_init();
+    if (capture_file) {
+        capture = ipfix_capture_open(capture_file);
+    }
+    if (output_file) {
+        error = ipfix_output_open();
+        if (error) {
+            ovs_fatal(error, "%s: open failed", output_file);
+        }
+    }
+    latch_init(&exit_latch);
+    records_seq = seq_create();
+    n_workers = n_threads;
+    if (writer_queue) {
+        ipfix_writer_start(n_workers + 1);
+    }
+    workers = xcalloc(n_workers, sizeof *workers);
+    for (size_t i = 0; i < n_workers; i++) {
+        ipfix_worker_init(&workers[i], socks[i]);
+        workers[i].collector.out_ring = out_rings ? out_rings[i] : NULL;
+    }
+    free(socks);
+    unixctl_command_register("exit", "", 0, 0, test_ipfix_exit, &exiting);
+    unixctl_command_register("ipfix/batch-stats", "", 0, 0,
+                             test_ipfix_batch_stats, NULL);
+    unixctl_command_register("ipfix/show", "", 0, 0, test_ipfix_show, NULL);
+    unixctl_command_register("ipfix/reset-counters", "", 0, 0,
+                             test_ipfix_reset_counters, NULL);
+    unixctl_command_register("ipfix/writer-stats", "", 0, 0,
+                             test_ipfix_writer_stats, NULL);
+    unixctl_command_register("ipfix/forward-stats", "", 0, 0,
+                             test_ipfix_forward_stats, NULL);
+    unixctl_command_register("ipfix/wait-records", "N [TIMEOUT_MS]", 1, 2,
+                             test_ipfix_wait_records, NULL);
+    unixctl_command_register("ipfix/wait-drained", "[TIMEOUT_MS]", 0, 1,
+                             test_ipfix_wait_drained, NULL);
+    unixctl_command_register("ipfix/stats", "", 0, 0, test_ipfix_stats, NULL);
+    unixctl_command_register("ipfix/latency", "", 0, 0, test_ipfix_latency,
+                             NULL);
+    unixctl_command_register("ipfix/latency-clear", "", 0, 0,
+                             test_ipfix_latency_clear, NULL);
+    unixctl_command_register("ipfix/sampling", "", 0, 0,
+                             test_ipfix_sampling, NULL);
+    unixctl_command_register("ipfix/biflows", "[N]", 0, 1,
+                             test_ipfix_biflows, NULL);
+    unixctl_command_register("ipfix/flows", "[N]", 0, 1, test_ipfix_flows,
+                             NULL);
+    unixctl_command_register("ipfix/top", "[DIMENSION [METRIC]]", 0, 2,
+                             test_ipfix_top, NULL);
+    daemonize_complete();
+
+    if (n_workers > 1) {
+        for (size_t i = 0; i < n_workers; i++) {
+            workers[i].thread = ovs_thread_create("ipfix_worker",
+                                                  ipfix_worker_main,
+                                                  &workers[i]);
+        }
+    } else {
+        ipfix_worker_use_uring(&workers[0]);
+    }
+
+    if (agg_max_flows && agg_dump_interval) {
+        next_dump = time_msec() + agg_dump_interval;
+    }
+    for (;;) {
+        uint64_t records_seqno;
+        size_t n = 0;
+        unixctl_server_run(server);
+        if (n_workers == 1) {
+            /* Receive on the main thread. */
+            n = ipfix_worker_run(&workers[0]);
+        }
+        records_seqno = ipfix_records_wait_run();
+        if (next_dump != LLONG_MAX) {
+            ipfix_agg_dump_run(&next_dump);
+        }
+        if (exiting) {
+            break;
+        }
+        if (n_workers == 1) {
+            ipfix_worker_wait(&workers[0], n);
+        }
+        poll_timer_wait_until(next_dump);
+        ipfix_records_wait_wait(records_seqno);
+        unixctl_server_wait(server);
+        poll_block();
+    }
+
+    latch_set(&exit_latch);
+    for (size_t i = 0; n_workers > 1 && i < n_workers; i++) {
+        xpthread_join(workers[i].thread, NULL);
+    }
+    for (size_t i = 0; i < n_workers; i++) {
+        ipfix_worker_destroy(&workers[i]);
+    }
+    free(workers);
+    ipfix_writer_stop();
+    if (output_fd != STDOUT_FILENO) {
+        close(output_fd);
+    }
+    ipfix_capture_close(capture);
+    latch_destroy(&exit_latch);
+    unixctl_server_destroy(server);
+    free(records_waits);
+    seq_destroy(records_seq);
+    ipfix_filter_destroy(filter);
+    free(forward_targets);
+}
+OVSTEST_REGISTER("test-ipfix", test_ipfix_main);
+
+/* Offline capture reader: "ovstest test-ipfix-read [OPTIONS] FILE". */
+
+struct capture_filter{
+    long long int from;         /* Minimum export time, -1 for none. */
+    long long int to;           /* Maximum export time, -1 for none. */
+    bool has_exporter;
+    struct in6_addr exporter;
+    bool has_ip;
+    struct in6_addr ip;         /* Matches source or destination. */
+    long long int obs_point;    /* Observation point ID, -1 for any. */
+};
+
+enum capture_group {
+    CAPTURE_GROUP_NONE,
+    CAPTURE_GROUP_SRC_IP,
+    CAPTURE_GROUP_DST_IP,
+    CAPTURE_GROUP_EXPORTER,
+    CAPTURE_GROUP_OBS_POINT,
+};
+
+/*Totals for one group of capture records*/
+struct capture_agg{
+    struct hmap_node hmap_node; /* In the 'groups' hmap. */
+    struct in6_addr key;        /* Address, or observation point ID. */
+    unsigned long long int n_records;
+    unsigned long long int packets;
+    unsigned long long int l2_octets;
+};
+
+static struct capture_filter read_filter = { -1, -1, false, IN6ADDR_ANY_INIT,
+                                             false, IN6ADDR_ANY_INIT, -1 };
+static enum capture_group read_group = CAPTURE_GROUP_NONE;
+static bool read_dump = false;
+
+static bool
+parse_capture_addr(const char *s, struct in6_addr *addr)
+{
+    ovs_be32 ip;
+
+    if (ip_parse(s, &ip)) {
+        ipfix_ipv4_mapped(addr, (const uint8_t *) &ip);
+        return true;
+    }
+    return ipv6_parse(s, addr);
+}
+
+static void
+parse_read_options(int argc, char *argv[])
+{
+    enum {
+        OPT_FROM = UCHAR_MAX + 1,
+        OPT_TO,
+        OPT_EXPORTER,
+        OPT_IP,
+        OPT_OBS_POINT,
+        OPT_GROUP_BY,
+        OPT_DUMP,
+    };
+    static const struct option long_options[] = {
+            {"from", required_argument, NULL, OPT_FROM},
+            {"to", required_argument, NULL, OPT_TO},
+            {"exporter", required_argument, NULL, OPT_EXPORTER},
+            {"ip", required_argument, NULL, OPT_IP},
+            {"obs-point", required_argument, NULL, OPT_OBS_POINT},
+            {"group-by", required_argument, NULL, OPT_GROUP_BY},
+            {"dump", no_argument, NULL, OPT_DUMP},
+            {NULL, 0, NULL, 0},
+    };
+    char *short_options = ovs_cmdl_long_options_to_short_options(long_options);
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case OPT_FROM:
+                if (!str_to_llong(optarg, 10, &read_filter.from)) {
+                    ovs_fatal(0, "--from: bad time %s", optarg);
+                }
+                break;
+            case OPT_TO:
+                if (!str_to_llong(optarg, 10, &read_filter.to)) {
+                    ovs_fatal(0, "--to: bad time %s", optarg);
+                }
+                break;
+            case OPT_EXPORTER:
+                if (!parse_capture_addr(optarg, &read_filter.exporter)) {
+                    ovs_fatal(0, "--exporter: bad address %s", optarg);
+                }
+                read_filter.has_exporter = true;
+                break;
+            case OPT_IP:
+                if (!parse_capture_addr(optarg, &read_filter.ip)) {
+                    ovs_fatal(0, "--ip: bad address %s", optarg);
+                }
+                read_filter.has_ip = true;
+                break;
+            case OPT_OBS_POINT:
+                if (!str_to_llong(optarg, 10, &read_filter.obs_point)) {
+                    ovs_fatal(0, "--obs-point: bad ID %s", optarg);
+                }
+                break;
+            case OPT_GROUP_BY:
+                if (!strcmp(optarg, "src-ip")) {
+                    read_group = CAPTURE_GROUP_SRC_IP;
+                } else if (!strcmp(optarg, "dst-ip")) {
+                    read_group = CAPTURE_GROUP_DST_IP;
+                } else if (!strcmp(optarg, "exporter")) {
+                    read_group = CAPTURE_GROUP_EXPORTER;
+                } else if (!strcmp(optarg, "obs-point")) {
+                    read_group = CAPTURE_GROUP_OBS_POINT;
+                } else {
+                    ovs_fatal(0, "--group-by must be src-ip, dst-ip, "
+                              "exporter or obs-point");
+                }
+                break;
+            case OPT_DUMP:
+                read_dump = true;
+                break;
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+    free(short_options);
+}
+
+/* Maps 'file_name' read-only.  Returns the mapping, or NULL if the file
+ * cannot be opened and 'optional' is true. */
+static const void *
+map_capture_file(const char *file_name, bool optional, size_t *sizep)
+{
+    struct stat s;
+    void *p;
+    int fd;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        if (optional) {
+            return NULL;
+        }
+        ovs_fatal(errno, "%s: open failed", file_name);
+    }
+    if (fstat(fd, &s)) {
+        ovs_fatal(errno, "%s: stat failed", file_name);
+    }
+    *sizep = s.st_size;
+    p = s.st_size ? mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+    if (p == MAP_FAILED) {
+        ovs_fatal(errno, "%s: mmap failed", file_name);
+    }
+    close(fd);
+    return p;
+}
+
+/* Returns the entries of the capture file mapped at 'p', or NULL if the
+ * header does not match. */
+static const void *
+capture_entries(const void *p, size_t size, const char *magic,
+                size_t entry_size, size_t *n)
+{
+    struct ipfix_capture_header expected;
+
+    ipfix_capture_header_init(&expected, magic, entry_size);
+    if (size < sizeof expected || memcmp(p, &expected, sizeof expected)) {
+        return NULL;
+    }
+    *n = (size - sizeof expected) / entry_size;
+    return (const char *) p + sizeof expected;
+}
+
+static bool
+capture_block_matches(const struct ipfix_capture_block *b)
+{
+    return ((read_filter.from < 0 || b->max_time >= read_filter.from)
+            && (read_filter.to < 0 || b->min_time <= read_filter.to)
+            && (!read_filter.has_exporter
+                || !(ipfix_capture_bloom(&read_filter.exporter)
+                     & ~b->exporters)));
+}
+
+static bool
+capture_rec_matches(const struct ipfix_capture_rec *rec)
+{
+    const struct capture_filter *f = &read_filter;
+
+    return ((f->from < 0 || rec->export_time >= f->from)
+            && (f->to < 0 || rec->export_time <= f->to)
+            && (!f->has_exporter
+                || !memcmp(&rec->exporter, &f->exporter, sizeof f->exporter))
+            && (!f->has_ip
+                || !memcmp(&rec->src_ip, &f->ip, sizeof f->ip)
+                || !memcmp(&rec->dst_ip, &f->ip, sizeof f->ip))
+            && (f->obs_point < 0 || rec->obs_point_id == f->obs_point));
+}
+
+static void
+dump_capture_rec(struct ds *s, const struct ipfix_capture_rec *rec)
+{
+    ds_put_format(s, "time %"PRIu32", exporter ", rec->export_time);
+    format_capture_addr(s, &rec->exporter);
+    ds_put_format(s, ", domain %"PRIu32", seq %"PRIu32", template %"PRIu16
+                  ", observation_point_id %"PRIu32", packets %"PRIu64
+                  ", l2 octets %"PRIu64,
+                  rec->obs_domain, rec->seq, rec->template_id,
+                  rec->obs_point_id, rec->packets, rec->l2_octets);
+    if (rec->ip_ver) {
+        ds_put_cstr(s, ", src ip ");
+        format_capture_addr(s, &rec->src_ip);
+        ds_put_cstr(s, ", dst ip ");
+        format_capture_addr(s, &rec->dst_ip);
+        ds_put_format(s, ", protocol %"PRIu8, rec->ip_pro);
+    }
+    ds_put_char(s, '\n');
+}
+
+static void
+aggregate_capture_rec(struct hmap *groups,
+                      const struct ipfix_capture_rec *rec)
+{
+    struct capture_agg *agg;
+    struct in6_addr key;
+    uint32_t hash;
+
+    memset(&key, 0, sizeof key);
+    switch (read_group) {
+    case CAPTURE_GROUP_NONE:
+        break;
+    case CAPTURE_GROUP_SRC_IP:
+        key = rec->src_ip;
+        break;
+    case CAPTURE_GROUP_DST_IP:
+        key = rec->dst_ip;
+        break;
+    case CAPTURE_GROUP_EXPORTER:
+        key = rec->exporter;
+        break;
+    case CAPTURE_GROUP_OBS_POINT:
+        memcpy(&key, &rec->obs_point_id, sizeof rec->obs_point_id);
+        break;
+    }
+
+    hash = hash_bytes(&key, sizeof key, 0);
+    HMAP_FOR_EACH_WITH_HASH (agg, hmap_node, hash, groups) {
+        if (!memcmp(&agg->key, &key, sizeof key)) {
+            goto found;
+        }
+    }
+    agg = xzalloc(sizeof *agg);
+    agg->key = key;
+    hmap_insert(groups, &agg->hmap_node, hash);
+
+found:
+    agg->n_records++;
+    agg->packets += rec->packets;
+    agg->l2_octets += rec->l2_octets;
+}
+
+/* Scans the 'n' records starting at index 'first' of the 'n_recs' in
+ * 'recs', dumping those that match into 's' and aggregating them into
+ * 'groups'.  Returns the number of records scanned, 0 if the range does
+ * not fit in 'recs'. */
+static uint64_t
+scan_capture_recs(const struct ipfix_capture_rec *recs, size_t n_recs,
+                  uint64_t first, uint64_t n, struct ds *s,
+                  struct hmap *groups)
+{
+    if (first > n_recs || n > n_recs - first) {
+        return 0;
+    }
+    for (const struct ipfix_capture_rec *rec = &recs[first];
+         rec < &recs[first + n]; rec++) {
+        if (capture_rec_matches(rec)) {
+            if (read_dump) {
+                dump_capture_rec(s, rec);
+            }
+            aggregate_capture_rec(groups, rec);
+        }
+    }
+    return n;
+}
+
+static int
+compare_capture_aggs(const void *a_, const void *b_)
+{
+    const struct capture_agg *const *a = a_;
+    const struct capture_agg *const *b = b_;
+
+    return memcmp(&(*a)->key, &(*b)->key, sizeof (*a)->key);
+}
+
+static void
+test_ipfix_read_main(int argc, char *argv[])
+{
+    const struct ipfix_capture_block *blocks = NULL;
+    const struct ipfix_capture_rec *recs;
+    struct capture_agg **aggs, *agg;
+    size_t n_recs, n_blocks = 0;
+    size_t size, index_size = 0;
+    struct hmap groups;
+    const void *file, *index;
+    uint64_t scanned = 0, covered = 0;
+    char *index_name;
+    size_t n_aggs;
+    struct ds s;
+
+    set_program_name(argv[0]);
+    parse_read_options(argc, argv);
+    if (argc - optind != 1) {
+        ovs_fatal(0, "usage: %s [--from=TIME] [--to=TIME] [--exporter=IP] "
+                  "[--ip=IP] [--obs-point=ID] [--group-by=src-ip|dst-ip|"
+                  "exporter|obs-point] [--dump] FILE", program_name);
+    }
+
+    file = map_capture_file(argv[optind], false, &size);
+    recs = capture_entries(file, size, IPFIX_CAPTURE_MAGIC, sizeof *recs,
+                           &n_recs);
+    if (!recs) {
+        ovs_fatal(0, "%s: not a capture file of this version and byte order",
+                  argv[optind]);
+    }
+    index_name = xasprintf("%s.idx", argv[optind]);
+    index = map_capture_file(index_name, true, &index_size);
+    if (index) {
+        blocks = capture_entries(index, index_size, IPFIX_CAPTURE_INDEX_MAGIC,
+                                 sizeof *blocks, &n_blocks);
+    }
+    free(index_name);
+
+    ds_init(&s);
+    hmap_init(&groups);
+
+    /* Indexed blocks, each preceded by the records that no block covers
+     * between it and the previous one, then the records past the last. */
+    for (size_t i = 0; i <= n_blocks; i++) {
+        const struct ipfix_capture_block *b = i < n_blocks ? &blocks[i] : NULL;
+        uint64_t next = MIN(b ? b->first : n_recs, n_recs);
+
+        if (next > covered) {
+            scanned += scan_capture_recs(recs, n_recs, covered,
+                                         next - covered, &s, &groups);
+        }
+        if (b) {
+            if (capture_block_matches(b)) {
+                scanned += scan_capture_recs(recs, n_recs, b->first, b->n,
+                                             &s, &groups);
+            }
+            covered = MAX(covered, b->first + b->n);
+        }
+    }
+
+    n_aggs = hmap_count(&groups);
+    aggs = xmalloc(MAX(n_aggs, 1) * sizeof *aggs);
+    n_aggs = 0;
+    HMAP_FOR_EACH (agg, hmap_node, &groups) {
+        aggs[n_aggs++] = agg;
+    }
+    qsort(aggs, n_aggs, sizeof *aggs, compare_capture_aggs);
+    if (!n_aggs && read_group == CAPTURE_GROUP_NONE) {
+        ds_put_cstr(&s, "records 0, packets 0, l2 octets 0\n");
+    }
+    for (size_t i = 0; i < n_aggs; i++) {
+        agg = aggs[i];
+        switch (read_group) {
+        case CAPTURE_GROUP_NONE:
+            break;
+        case CAPTURE_GROUP_SRC_IP:
+        case CAPTURE_GROUP_DST_IP:
+        case CAPTURE_GROUP_EXPORTER:
+            format_capture_addr(&s, &agg->key);
+            ds_put_cstr(&s, ": ");
+            break;
+        case CAPTURE_GROUP_OBS_POINT: {
+            uint32_t obs_point_id;
+            memcpy(&obs_point_id, &agg->key, sizeof obs_point_id);
+            ds_put_format(&s, "%"PRIu32": ", obs_point_id);
+            break;
+        }
+        }
+        ds_put_format(&s, "records %llu, packets %llu, l2 octets %llu\n",
+                      agg->n_records, agg->packets, agg->l2_octets);
+        free(agg);
+    }
+    free(aggs);
+    hmap_destroy(&groups);
+
+    VLOG_DBG("scanned %"PRIu64" of %"PRIuSIZE" records", scanned, n_recs);
+    fputs(ds_cstr(&s), stdout);
+    ds_destroy(&s);
+}
+OVSTEST_REGISTER("test-ipfix-read", test_ipfix_read_main);
+
+/* Synthetic exporter: "ovstest test-ipfix-gen [OPTIONS] TARGET".
+ *
+ * Each exporter is a socket of its own, so the collector sees it as a
+ * separate transport session, and exports one or more observation
+ * domains.  Every domain sends its templates first and then data
+ * messages that cycle through the selected templates, each message
+ * carrying one data set of --records records.  Records are encoded once
+ * per flow up front, so building a message is a header plus a copy.
+ * --templates picks among the data templates that OVS exports, including
+ * the VLAN and tunnel variants, by template ID.
+ *
+ * With --sampling=N, each domain announces 1-in-N systematic sampling in
+ * an options data record that it sends with its templates.  With --stats,
+ * each domain sends its exporting totals in an options data record after
+ * its last data message, and the first domain of each exporter then sends
+ * the totals of the whole exporter; messages that --gap-every skips count
+ * as sent.  Over TCP, each domain finally withdraws all of its templates,
+ * as an exporter does before it closes the connection. */
+
+/*A template that the generator exports*/
+struct gen_template{
+    uint16_t template_id;
+    const struct ipfix_field *fields;
+    size_t n_fields;
+    size_t record_len;
+    uint8_t *records;           /* 'gen_n_flows' pre-encoded records. */
+};
+
+/*Export state of one observation domain*/
+struct gen_domain{
+    uint32_t obs_domain;
+    uint32_t seq;               /* Data records sent, modulo 2**32. */
+    unsigned long long int n_messages;  /* Data messages sent. */
+    size_t next_flow;
+
+    /* Everything sent, data or not, for --stats. */
+    unsigned long long int n_sent_messages;
+    unsigned long long int n_sent_records;
+    unsigned long long int n_sent_bytes;
+};
+
+/*One exporter, i.e. one transport session to the collector*/
+struct gen_exporter{
+    int fd;
+    bool connecting;            /* TCP connection still in progress. */
+    struct ofpbuf out;          /* Bytes not yet sent. */
+    struct gen_domain *domains;
+    size_t next_domain;
+};
+
+/* The OVS data templates, indexed like 'ipfix_ovs_layouts'.  Unused IDs
+ * have no fields. */
+static struct gen_template gen_templates[IPFIX_N_OVS_TEMPLATE_IDS];
+#define GEN_DEFAULT_TEMPLATES "256,262,266"
+
+/* The options templates, each with one scope field, that the generator
+ * exports with --sampling or --stats, in the order of their IDs. */
+#define GEN_OPTIONS_SAMPLING 1024
+#define GEN_OPTIONS_DOMAIN_STATS 1025
+#define GEN_OPTIONS_PROCESS_STATS 1026
+
+static const struct ipfix_field gen_sampling_fields[] = {
+    { 0, 149, 4 },              /* observationDomainId. */
+    { 0, 305, 4 },              /* samplingPacketInterval. */
+    { 0, 306, 4 },              /* samplingPacketSpace. */
+};
+
+static const struct ipfix_field gen_domain_stats_fields[] = {
+    { 0, 149, 4 },              /* observationDomainId. */
+    { 0, 41, 8 },               /* exportedMessageTotalCount. */
+    { 0, 42, 8 },               /* exportedFlowRecordTotalCount. */
+    { 0, 40, 8 },               /* exportedOctetTotalCount. */
+};
+
+static const struct ipfix_field gen_process_stats_fields[] = {
+    { 0, 144, 4 },              /* exportingProcessId. */
+    { 0, 41, 8 },               /* exportedMessageTotalCount. */
+    { 0, 42, 8 },               /* exportedFlowRecordTotalCount. */
+    { 0, 40, 8 },               /* exportedOctetTotalCount. */
+};
+
+static const struct gen_template gen_options_templates[] = {
+    { GEN_OPTIONS_SAMPLING, gen_sampling_fields,
+      ARRAY_SIZE(gen_sampling_fields), 12, NULL },
+    { GEN_OPTIONS_DOMAIN_STATS, gen_domain_stats_fields,
+      ARRAY_SIZE(gen_domain_stats_fields), 28, NULL },
+    { GEN_OPTIONS_PROCESS_STATS, gen_process_stats_fields,
+      ARRAY_SIZE(gen_process_stats_fields), 28, NULL },
+};
+
+/* Options. */
+static bool gen_tcp = false;
+static int gen_rate = 0;                /* Data messages/s, 0: no limit. */
+static int gen_count = 1000;            /* Data messages in total. */
+static int gen_records = 1;             /* Records per data message. */
+static int gen_n_exporters = 1;
+static int gen_n_domains = 1;
+static int gen_n_flows = 1024;
+static int gen_gap_every = 0;           /* Skip a message every N, or 0. */
+static int gen_template_every = 1000;   /* UDP template refresh, or 0. */
+static int gen_sampling = 0;            /* Announced 1 in N, or 0. */
+static bool gen_stats = false;
+static struct gen_template *gen_selected[IPFIX_N_OVS_TEMPLATE_IDS];
+static size_t gen_n_selected;
+
+/* Totals. */
+static unsigned long long int gen_n_data, gen_n_template, gen_n_records;
+static unsigned long long int gen_n_bytes, gen_n_gaps, gen_n_errors;
+
+static inline uint64_t
+ipfix_load_uint(const uint8_t *src, uint8_t len)
+{
+    switch (len) {
+    case 1: return *src;
+    case 2: { uint16_t x; memcpy(&x, src, 2); return x; }
+    case 4: { uint32_t x; memcpy(&x, src, 4); return x; }
+    case 8: { uint64_t x; memcpy(&x, src, 8); return x; }
+    default: return 0;
+    }
+}
+
+/* Appends 'flow' to 'b' as a record of the template 'fields'.  This is
+ * the inverse of ipfix_decode_record(): fields that 'flow' does not
+ * provide are zero-filled, and variable-length fields take the width of
+ * their struct ipfix_flow member (or 0 bytes if unknown). */
+static void
+ipfix_encode_record(const struct ipfix_field *fields, size_t n_fields,
+                    const struct ipfix_flow *flow, struct ofpbuf *b)
+{
+    for (size_t i = 0; i < n_fields; i++) {
+        const struct ipfix_field *f = &fields[i];
+        const struct ipfix_ie_map *m = ipfix_ie_map_find(f->enterprise,
+                                                         f->ie_id);
+        size_t len = f->length;
+        const uint8_t *src;
+        uint8_t *dst;
+
+        if (len == IPFIX_VARLEN) {
+            len = m ? m->dst_len : 0;
+            *(uint8_t *) ofpbuf_put_uninit(b, 1) = len;
+        }
+        dst = ofpbuf_put_zeros(b, len);
+        if (!m || !(flow->present & IPFIX_F_BIT(m->field))) {
+            continue;
+        }
+        src = (const uint8_t *) flow + m->dst_ofs;
+        if (m->kind == IPFIX_KIND_BYTES) {
+            memcpy(dst, src, MIN(len, m->dst_len));
+        } else {
+            uint64_t value = ipfix_load_uint(src, m->dst_len);
+            for (size_t j = len; j-- > 0; value >>= 8) {
+                dst[j] = value;
+            }
+        }
+    }
+}
+
+/* Fills 'flow' with synthetic flow number 'i' as exported through
+ * template 't'. */
+static void
+gen_make_flow(const struct gen_template *t, uint32_t i,
+              struct ipfix_flow *flow)
+{
+    enum ipfix_proto_tunnel tunnel;
+    uint64_t packets = 1 + i % 7;
+    enum ipfix_proto_l2 l2;
+    enum ipfix_proto_l3 l3;
+    enum ipfix_proto_l4 l4;
+
+    ipfix_ovs_template_classify(t->template_id, &l2, &l3, &l4, &tunnel);
+    memset(flow, 0, sizeof *flow);
+    flow->present = UINT64_MAX;
+    flow->obs_point_id = i % 4;
+    for (size_t j = 0; j < 4; j++) {
+        flow->src_mac[5 - j] = i >> (8 * j);
+        flow->dst_mac[5 - j] = (i + 1) >> (8 * j);
+    }
+    flow->src_mac[0] = flow->dst_mac[0] = 0x50;
+    flow->src_mac[1] = flow->dst_mac[1] = 0x54;
+    flow->eth_hdlen = 14;
+    flow->packets = packets;
+    flow->l2_octor_delta_count = packets * 60;
+    flow->flow_end_reason = 3;
+
+    if (l2 == IPFIX_PROTO_L2_VLAN) {
+        flow->vlan_id = flow->dot1q_vlan_id = 1 + i % 4094;
+    }
+    if (tunnel == IPFIX_PROTO_TUNNELED) {
+        flow->tun_src_ip[0] = flow->tun_dst_ip[0] = 172;
+        flow->tun_src_ip[1] = flow->tun_dst_ip[1] = 16;
+        flow->tun_src_ip[3] = 1;
+        flow->tun_dst_ip[3] = 2;
+        flow->tun_proto = IPPROTO_UDP;
+        flow->tun_src_port = 32768 + i % 16384;
+        flow->tun_dst_port = 4789;
+        flow->tun_type = 4;     /* VXLAN. */
+        flow->tun_key = i % 1024;
+    }
+
+    if (l3 == IPFIX_PROTO_L3_UNKNOWN) {
+        flow->eth_type = ETH_TYPE_ARP;
+        return;
+    }
+    flow->ip_ttl = 64;
+    flow->ip_pro = (l4 == IPFIX_PROTO_L4_ICMP
+                    ? (l3 == IPFIX_PROTO_L3_IPV4 ? IPPROTO_ICMP
+                       : IPPROTO_ICMPV6)
+                    : l4 == IPFIX_PROTO_L4_TCP_UDP_SCTP ? IPPROTO_UDP
+                    : IPPROTO_GRE);
+    if (l3 == IPFIX_PROTO_L3_IPV4) {
+        flow->eth_type = ETH_TYPE_IP;
+        flow->ip_ver = 4;
+        flow->src_ip[0] = 10;
+        flow->src_ip[1] = i >> 16;
+        flow->src_ip[2] = i >> 8;
+        flow->src_ip[3] = i;
+        flow->dst_ip[0] = 192;
+        flow->dst_ip[1] = 168;
+        flow->dst_ip[2] = i >> 8;
+        flow->dst_ip[3] = i;
+    } else {
+        flow->eth_type = ETH_TYPE_IPV6;
+        flow->ip_ver = 6;
+        flow->src_ipv6[0] = flow->dst_ipv6[0] = 0xfd;
+        for (size_t j = 0; j < 4; j++) {
+            flow->src_ipv6[15 - j] = i >> (8 * j);
+            flow->dst_ipv6[15 - j] = (i + 1) >> (8 * j);
+        }
+        flow->flow_label = i & 0xfffff;
+    }
+    if (l4 == IPFIX_PROTO_L4_TCP_UDP_SCTP) {
+        flow->src_port = 1024 + i % 64512;
+        flow->dst_port = 53;
+    }
+    flow->icmp_type = l3 == IPFIX_PROTO_L3_IPV4 ? 8 : 128;
+    flow->octets = packets * 46;
+    flow->delta_oc_sq = packets * 46 * 46;
+    flow->min_len = 46;
+    flow->max_len = 46;
+}
+
+/* Encodes the records of the selected templates.  Every record of a
+ * template has the same length, since variable-length fields are always
+ * encoded at the same width. */
+static void
+gen_templates_init(void)
+{
+    for (size_t i = 0; i < gen_n_selected; i++) {
+        struct gen_template *t = gen_selected[i];
+        struct ofpbuf b;
+
+        ofpbuf_init(&b, 0);
+        for (uint32_t j = 0; j < gen_n_flows; j++) {
+            struct ipfix_flow flow;
+
+            gen_make_flow(t, j, &flow);
+            ipfix_encode_record(t->fields, t->n_fields, &flow, &b);
+        }
+        t->record_len = b.size / gen_n_flows;
+        t->records = b.data;
+    }
+}
+
+static void
+gen_put_message_header(struct ofpbuf *b, const struct gen_domain *d)
+{
+    struct ipfix_message_header *msg_hd;
+
+    msg_hd = ofpbuf_put_zeros(b, sizeof *msg_hd);
+    msg_hd->version = htons(10);
+    msg_hd->export_time = htonl(time_wall());
+    msg_hd->seq_number = htonl(d->seq);
+    msg_hd->obs_dmID = htonl(d->obs_domain);
+}
+
+/* Sets the length of the message of 'd' starting at offset 'start' in
+ * 'b'. */
+static void
+gen_finish_message(struct ofpbuf *b, size_t start, struct gen_domain *d)
+{
+    struct ipfix_message_header *msg_hd = ofpbuf_at(b, start,
+                                                    sizeof *msg_hd);
+
+    msg_hd->length = htons(b->size - start);
+    gen_n_bytes += b->size - start;
+    d->n_sent_messages++;
+    d->n_sent_bytes += b->size - start;
+}
+
+/* Starts a set with 'set_id' in 'b' and returns its offset, for
+ * gen_finish_set(). */
+static size_t
+gen_start_set(struct ofpbuf *b, uint16_t set_id)
+{
+    size_t start = b->size;
+    struct ipfix_set_header *set_hd = ofpbuf_put_zeros(b, sizeof *set_hd);
+
+    set_hd->set_id = htons(set_id);
+    return start;
+}
+
+static void
+gen_finish_set(struct ofpbuf *b, size_t start)
+{
+    struct ipfix_set_header *set_hd = ofpbuf_at(b, start, sizeof *set_hd);
+
+    set_hd->length = htons(b->size - start);
+}
+
+/* Appends to 'b' the 'len'-byte unsigned integer 'value' in network byte
+ * order. */
+static void
+gen_put_uint(struct ofpbuf *b, uint64_t value, size_t len)
+{
+    uint8_t *dst = ofpbuf_put_uninit(b, len);
+
+    for (size_t i = len; i-- > 0; value >>= 8) {
+        dst[i] = value;
+    }
+}
+
+/* Appends to 'b' the template record of 't', an options template record
+ * with 'n_scope_fields' scope fields if that is nonzero. */
+static void
+gen_put_template_record(struct ofpbuf *b, const struct gen_template *t,
+                        uint16_t n_scope_fields)
+{
+    struct ipfix_template_record_header *rec_hd;
+
+    rec_hd = ofpbuf_put_zeros(b, sizeof *rec_hd);
+    rec_hd->template_id = htons(t->template_id);
+    rec_hd->field_count = htons(t->n_fields);
+    if (n_scope_fields) {
+        gen_put_uint(b, n_scope_fields, 2);
+    }
+    for (size_t j = 0; j < t->n_fields; j++) {
+        struct ipfix_field_specifier *spec;
+
+        spec = ofpbuf_put_zeros(b, sizeof *spec);
+        spec->ie_id = htons(t->fields[j].ie_id
+                            | (t->fields[j].enterprise
+                               ? IPFIX_ENTERPRISE_BIT : 0));
+        spec->length = htons(t->fields[j].length);
+        if (t->fields[j].enterprise) {
+            ovs_be32 enterprise = htonl(t->fields[j].enterprise);
+
+            ofpbuf_put(b, &enterprise, sizeof enterprise);
+        }
+    }
+}
+
+/* Queues a message holding the template set for 'd' and, with --sampling
+ * or --stats, its options template set, followed with --sampling by the
+ * options data record that announces the sampling. */
+static void
+gen_queue_templates(struct gen_exporter *e, struct gen_domain *d)
+{
+    size_t start = e->out.size;
+    size_t set_start;
+
+    gen_put_message_header(&e->out, d);
+    set_start = gen_start_set(&e->out, IPFIX_SET_ID_TEMPLATE);
+    for (size_t i = 0; i < gen_n_selected; i++) {
+        gen_put_template_record(&e->out, gen_selected[i], 0);
+    }
+    gen_finish_set(&e->out, set_start);
+
+    if (gen_sampling || gen_stats) {
+        set_start = gen_start_set(&e->out, IPFIX_SET_ID_OPTIONS_TEMPLATE);
+        for (size_t i = 0; i < ARRAY_SIZE(gen_options_templates); i++) {
+            gen_put_template_record(&e->out, &gen_options_templates[i], 1);
+        }
+        gen_finish_set(&e->out, set_start);
+    }
+    if (gen_sampling) {
+        set_start = gen_start_set(&e->out, GEN_OPTIONS_SAMPLING);
+        gen_put_uint(&e->out, d->obs_domain, 4);
+        gen_put_uint(&e->out, 1, 4);
+        gen_put_uint(&e->out, gen_sampling - 1, 4);
+        gen_finish_set(&e->out, set_start);
+        d->seq++;
+        d->n_sent_records++;
+    }
+    gen_finish_message(&e->out, start, d);
+    gen_n_template++;
+}
+
+/* Queues a message of 'd' with an options data record that holds the
+ * totals of 'd' or, if 'process' is true, of every domain of 'e', in
+ * both cases counting the message itself. */
+static void
+gen_queue_stats(struct gen_exporter *e, struct gen_domain *d, bool process)
+{
+    uint16_t id = (process ? GEN_OPTIONS_PROCESS_STATS
+                   : GEN_OPTIONS_DOMAIN_STATS);
+    const struct gen_template *t;
+    unsigned long long int n_messages = 1, n_records = 1, n_bytes;
+    size_t start = e->out.size;
+    size_t set_start;
+
+    t = &gen_options_templates[id - GEN_OPTIONS_SAMPLING];
+    n_bytes = IPFIX_MES_HEADER_LEN + IPFIX_SET_HEADER_LEN + t->record_len;
+
+    for (size_t i = 0; i < gen_n_domains; i++) {
+        const struct gen_domain *sum = &e->domains[i];
+
+        if (process || sum == d) {
+            n_messages += sum->n_sent_messages;
+            n_records += sum->n_sent_records;
+            n_bytes += sum->n_sent_bytes;
+        }
+    }
+
+    gen_put_message_header(&e->out, d);
+    set_start = gen_start_set(&e->out, t->template_id);
+    gen_put_uint(&e->out, process ? 0 : d->obs_domain, 4);
+    gen_put_uint(&e->out, n_messages, 8);
+    gen_put_uint(&e->out, n_records, 8);
+    gen_put_uint(&e->out, n_bytes, 8);
+    gen_finish_set(&e->out, set_start);
+    gen_finish_message(&e->out, start, d);
+    d->seq++;
+    d->n_sent_records++;
+}
+
+/* Queues a message that withdraws every template and options template of
+ * 'd' (RFC 7011 section 8.1). */
+static void
+gen_queue_withdrawals(struct gen_exporter *e, struct gen_domain *d)
+{
+    static const uint16_t set_ids[] = {
+        IPFIX_SET_ID_TEMPLATE, IPFIX_SET_ID_OPTIONS_TEMPLATE
+    };
+    size_t start = e->out.size;
+
+    gen_put_message_header(&e->out, d);
+    for (size_t i = 0; i < ARRAY_SIZE(set_ids); i++) {
+        size_t set_start = gen_start_set(&e->out, set_ids[i]);
+
+        gen_put_uint(&e->out, set_ids[i], 2);
+        gen_put_uint(&e->out, 0, 2);
+        gen_finish_set(&e->out, set_start);
+    }
+    gen_finish_message(&e->out, start, d);
+    gen_n_template++;
+}
+
+/* Queues what 'e' sends after its last data message: with --stats, the
+ * totals of each domain and then those of the whole exporter, and over
+ * TCP the withdrawals of the templates of each domain.  Domains that sent
+ * nothing, and so no templates, are left out. */
+static void
+gen_queue_final(struct gen_exporter *e)
+{
+    if (gen_stats) {
+        for (size_t i = 0; i < gen_n_domains; i++) {
+            if (e->domains[i].n_sent_messages) {
+                gen_queue_stats(e, &e->domains[i], false);
+            }
+        }
+        if (e->domains[0].n_sent_messages) {
+            gen_queue_stats(e, &e->domains[0], true);
+        }
+    }
+    if (gen_tcp) {
+        for (size_t i = 0; i < gen_n_domains; i++) {
+            if (e->domains[i].n_sent_messages) {
+                gen_queue_withdrawals(e, &e->domains[i]);
+            }
+        }
+    }
+}
+
+/* Queues the next data message for 'd', preceded by the templates when
+ * they are due. */
+static void
+gen_queue_data(struct gen_exporter *e, struct gen_domain *d)
+{
+    const struct gen_template *t;
+    struct ipfix_set_header *set_hd;
+    size_t start;
+
+    if (!d->n_messages
+        || (!gen_tcp && gen_template_every
+            && !(d->n_messages % gen_template_every))) {
+        gen_queue_templates(e, d);
+    }
+    t = gen_selected[d->n_messages % gen_n_selected];
+    if (gen_gap_every && d->n_messages
+        && !(d->n_messages % gen_gap_every)) {
+        /* Pretend that a message was lost on the way. */
+        d->seq += gen_records;
+        d->n_sent_messages++;
+        d->n_sent_records += gen_records;
+        d->n_sent_bytes += (IPFIX_MES_HEADER_LEN + IPFIX_SET_HEADER_LEN
+                            + gen_records * t->record_len);
+        gen_n_gaps++;
+    }
+
+    start = e->out.size;
+    gen_put_message_header(&e->out, d);
+    set_hd = ofpbuf_put_uninit(&e->out, sizeof *set_hd);
+    set_hd->set_id = htons(t->template_id);
+    set_hd->length = htons(sizeof *set_hd + gen_records * t->record_len);
+    for (size_t i = 0; i < gen_records; i++) {
+        ofpbuf_put(&e->out, &t->records[d->next_flow * t->record_len],
+                   t->record_len);
+        d->next_flow = (d->next_flow + 1) % gen_n_flows;
+    }
+    gen_finish_message(&e->out, start, d);
+
+    d->seq += gen_records;
+    d->n_messages++;
+    d->n_sent_records += gen_records;
+    gen_n_data++;
+    gen_n_records += gen_records;
+}
+
+/* Sends as much of 'e''s queued output as possible.  Returns true if
+ * nothing is left queued. */
+static bool
+gen_exporter_send(struct gen_exporter *e)
+{
+    if (e->connecting) {
+        int error = check_connection_completion(e->fd);
+        if (error == EAGAIN) {
+            return false;
+        } else if (error) {
+            ovs_fatal(error, "connection failed");
+        }
+        e->connecting = false;
+    }
+
+    while (e->out.size) {
+        const struct ipfix_message_header *msg_hd = e->out.data;
+        size_t len = gen_tcp ? e->out.size : ntohs(msg_hd->length);
+        ssize_t retval;
+
+        retval = send(e->fd, e->out.data, len, MSG_NOSIGNAL);
+        if (retval > 0) {
+            ofpbuf_pull(&e->out, retval);
+        } else if (retval < 0 && (errno == EAGAIN || errno == ENOBUFS)) {
+            return false;
+        } else if (gen_tcp) {
+            ovs_fatal(retval ? errno : 0, "connection closed");
+        } else {
+            /* E.g. ECONNREFUSED while no collector is listening. */
+            ofpbuf_pull(&e->out, len);
+            gen_n_errors++;
+        }
+    }
+    ofpbuf_clear(&e->out);
+    return true;
+}
+
+static void
+gen_exporter_init(struct gen_exporter *e, const char *target, size_t idx)
+{
+    int error;
+
+    error = inet_open_active(gen_tcp ? SOCK_STREAM : SOCK_DGRAM, target,
+                             4739, NULL, &e->fd, 0);
+    if (error && error != EAGAIN) {
+        ovs_fatal(error, "%s: failed to connect", target);
+    }
+    e->connecting = error == EAGAIN;
+    ofpbuf_init(&e->out, 0);
+    e->domains = xcalloc(gen_n_domains, sizeof *e->domains);
+    for (size_t i = 0; i < gen_n_domains; i++) {
+        e->domains[i].obs_domain = idx * gen_n_domains + i;
+    }
+    e->next_domain = 0;
+}
+
+static void
+gen_exporter_destroy(struct gen_exporter *e)
+{
+    close(e->fd);
+    ofpbuf_uninit(&e->out);
+    free(e->domains);
+}
+
+static void
+gen_select_templates(const char *list)
+{
+    char *copy = xstrdup(list);
+    char *save_ptr = NULL;
+
+    ipfix_builtin_templates_init();
+    for (size_t i = 0; i < IPFIX_N_OVS_TEMPLATE_IDS; i++) {
+        const struct ipfix_ovs_layout *l = &ipfix_ovs_layouts[i];
+
+        gen_templates[i].template_id = IPFIX_SET_ID_DATA_MIN + i;
+        gen_templates[i].fields = l->fields;
+        gen_templates[i].n_fields = l->n_fields;
+    }
+
+    gen_n_selected = 0;
+    for (char *name = strtok_r(copy, ",", &save_ptr); name;
+         name = strtok_r(NULL, ",", &save_ptr)) {
+        struct gen_template *t = NULL;
+        int id;
+
+        if (!str_to_int(name, 10, &id)) {
+            ovs_fatal(0, "--templates: bad template ID %s", name);
+        }
+        if (id >= 0 && id <= UINT16_MAX && ipfix_ovs_layout_find(id)) {
+            t = &gen_templates[id - IPFIX_SET_ID_DATA_MIN];
+        }
+        if (!t) {
+            ovs_fatal(0, "--templates: unsupported template %d", id);
+        }
+        if (gen_n_selected >= ARRAY_SIZE(gen_selected)) {
+            ovs_fatal(0, "--templates: too many templates");
+        }
+        gen_selected[gen_n_selected++] = t;
+    }
+    free(copy);
+    if (!gen_n_selected) {
+        ovs_fatal(0, "--templates: no template selected");
+    }
+}
+
+static int
+gen_parse_count(const char *option, const char *arg, int min)
+{
+    int value;
+
+    if (!str_to_int(arg, 10, &value) || value < min) {
+        ovs_fatal(0, "--%s argument must be an integer of at least %d",
+                  option, min);
+    }
+    return value;
+}
+
+static void
+parse_gen_options(int argc, char *argv[])
+{
+    enum {
+        OPT_TCP = UCHAR_MAX + 1,
+        OPT_RATE,
+        OPT_COUNT,
+        OPT_RECORDS,
+        OPT_EXPORTERS,
+        OPT_DOMAINS,
+        OPT_FLOWS,
+        OPT_GAP_EVERY,
+        OPT_TEMPLATE_EVERY,
+        OPT_TEMPLATES,
+        OPT_SAMPLING,
+        OPT_STATS,
+    };
+    static const struct option long_options[] = {
+            {"tcp", no_argument, NULL, OPT_TCP},
+            {"rate", required_argument, NULL, OPT_RATE},
+            {"count", required_argument, NULL, OPT_COUNT},
+            {"records", required_argument, NULL, OPT_RECORDS},
+            {"exporters", required_argument, NULL, OPT_EXPORTERS},
+            {"domains", required_argument, NULL, OPT_DOMAINS},
+            {"flows", required_argument, NULL, OPT_FLOWS},
+            {"gap-every", required_argument, NULL, OPT_GAP_EVERY},
+            {"template-every", required_argument, NULL, OPT_TEMPLATE_EVERY},
+            {"templates", required_argument, NULL, OPT_TEMPLATES},
+            {"sampling", required_argument, NULL, OPT_SAMPLING},
+            {"stats", no_argument, NULL, OPT_STATS},
+            {NULL, 0, NULL, 0},
+    };
+    char *short_options = ovs_cmdl_long_options_to_short_options(long_options);
+
+    gen_select_templates(GEN_DEFAULT_TEMPLATES);
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case OPT_TCP:
+                gen_tcp = true;
+                break;
+            case OPT_RATE:
+                gen_rate = gen_parse_count("rate", optarg, 0);
+                break;
+            case OPT_COUNT:
+                gen_count = gen_parse_count("count", optarg, 0);
+                break;
+            case OPT_RECORDS:
+                gen_records = gen_parse_count("records", optarg, 1);
+                break;
+            case OPT_EXPORTERS:
+                gen_n_exporters = gen_parse_count("exporters", optarg, 1);
+                break;
+            case OPT_DOMAINS:
+                gen_n_domains = gen_parse_count("domains", optarg, 1);
+                break;
+            case OPT_FLOWS:
+                gen_n_flows = gen_parse_count("flows", optarg, 1);
+                break;
+            case OPT_GAP_EVERY:
+                gen_gap_every = gen_parse_count("gap-every", optarg, 0);
+                break;
+            case OPT_TEMPLATE_EVERY:
+                gen_template_every = gen_parse_count("template-every",
+                                                     optarg, 0);
+                break;
+            case OPT_TEMPLATES:
+                gen_select_templates(optarg);
+                break;
+            case OPT_SAMPLING:
+                gen_sampling = gen_parse_count("sampling", optarg, 1);
+                break;
+            case OPT_STATS:
+                gen_stats = true;
+                break;
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+    free(short_options);
+}
+
+/* Pre-encodes the selected templates' records and checks that a data
+ * message fits in an IPFIX message. */
+static void
+gen_init(void)
+{
+    size_t max_record_len = 0;
+
+    gen_templates_init();
+    for (size_t i = 0; i < gen_n_selected; i++) {
+        max_record_len = MAX(max_record_len, gen_selected[i]->record_len);
+    }
+    if (IPFIX_MES_HEADER_LEN + IPFIX_SET_HEADER_LEN
+        + (size_t) gen_records * max_record_len > UINT16_MAX) {
+        ovs_fatal(0, "--records=%d exceeds the maximum IPFIX message size",
+                  gen_records);
+    }
+}
+
+static void
+gen_destroy(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(gen_templates); i++) {
+        free(gen_templates[i].records);
+        gen_templates[i].records = NULL;
+    }
+}
+
+/* Sends 'gen_count' data messages through 'exporters' at 'gen_rate' and
+ * returns the time it took, in milliseconds. */
+static long long int
+gen_run(struct gen_exporter *exporters, size_t n_exporters)
+{
+    long long int start = time_msec();
+    bool finished = false;
+    size_t next = 0;
+
+    for (;;) {
+        unsigned long long int quota;
+        bool blocked = false, done;
+        long long int now = time_msec();
+
+        quota = (gen_rate
+                 ? (unsigned long long int) (now - start) * gen_rate / 1000
+                   + 1
+                 : ULLONG_MAX);
+
+        /* Round-robin over the exporters until all are blocked or the
+         * quota or count is exhausted. */
+        for (size_t idle = 0; idle < n_exporters; ) {
+            struct gen_exporter *e = &exporters[next];
+
+            next = (next + 1) % n_exporters;
+            if (!gen_exporter_send(e) || gen_n_data >= gen_count
+                || gen_n_data >= quota) {
+                idle++;
+                continue;
+            }
+            idle = 0;
+            gen_queue_data(e, &e->domains[e->next_domain]);
+            e->next_domain = (e->next_domain + 1) % gen_n_domains;
+            gen_exporter_send(e);
+        }
+
+        done = gen_n_data >= gen_count;
+        if (done && !finished) {
+            for (size_t i = 0; i < n_exporters; i++) {
+                gen_queue_final(&exporters[i]);
+            }
+            finished = true;
+        }
+        for (size_t i = 0; i < n_exporters; i++) {
+            struct gen_exporter *e = &exporters[i];
+
+            if (e->connecting || e->out.size) {
+                poll_fd_wait(e->fd, POLLOUT);
+                blocked = true;
+            }
+        }
+        if (done && !blocked) {
+            break;
+        }
+        if (!done && gen_n_data >= quota) {
+            poll_timer_wait_until(start + gen_n_data * 1000 / gen_rate);
+        }
+        poll_block();
+    }
+    return time_msec() - start;
+}
+
+static void
+test_ipfix_gen_main(int argc, char *argv[])
+{
+    struct gen_exporter *exporters;
+    long long int elapsed;
+
+    set_program_name(argv[0]);
+    parse_gen_options(argc, argv);
+    if (argc - optind != 1) {
+        ovs_fatal(0, "usage: %s [--tcp] [--rate=MSGS/S] [--count=N] "
+                  "[--records=N] [--exporters=N] [--domains=N] [--flows=N] "
+                  "[--gap-every=N] [--template-every=N] "
+                  "[--templates=ID[,ID...]] [--sampling=N] [--stats] "
+                  "IP:PORT", program_name);
+    }
+    gen_init();
+
+    exporters = xcalloc(gen_n_exporters, sizeof *exporters);
+    for (size_t i = 0; i < gen_n_exporters; i++) {
+        gen_exporter_init(&exporters[i], argv[optind], i);
+    }
+    elapsed = gen_run(exporters, gen_n_exporters);
+
+    printf("sent %llu data messages, %llu template messages, "
+           "%llu records, %llu bytes in %lld ms",
+           gen_n_data, gen_n_template, gen_n_records, gen_n_bytes, elapsed);
+    if (elapsed > 0) {
+        printf(" (%.0f messages/s)", gen_n_data * 1000.0 / elapsed);
+    }
+    printf("\ninjected %llu sequence gaps, %llu send errors\n",
+           gen_n_gaps, gen_n_errors);
+
+    for (size_t i = 0; i < gen_n_exporters; i++) {
+        gen_exporter_destroy(&exporters[i]);
+    }
+    free(exporters);
+    gen_destroy();
+}
+OVSTEST_REGISTER("test-ipfix-gen", test_ipfix_gen_main);
+
+/* Benchmarks: "ovstest test-ipfix-bench [OPTIONS] [-- COLLECTOR-OPTIONS]".
+ *
+ * By default, replays a corpus of IPFIX messages, synthesized with the
+ * test-ipfix-gen options or read from --corpus, through print_ipfix() in
+ * process, once per decoder configuration.  With --e2e, instead forks a
+ * "test-ipfix" collector on a loopback UDP port, runs COLLECTOR-OPTIONS
+ * through its full main loop, and measures how fast it takes in what the
+ * generator sends.  Each result is printed as one line of JSON. */
+
+/*A message of the benchmark corpus*/
+struct bench_msg{
+    const uint8_t *data;
+    uint16_t len;
+};
+
+/*Decoder configuration that the in-process benchmark measures*/
+struct bench_case{
+    const char *name;
+    bool print_records;
+    int agg_max_flows;
+    int hh_top_k;
+    bool generic_decode;        /* Disable the specialized decoders. */
+    const char *columns;        /* Column kernels, as for --columns. */
+    const char *filter;         /* As for --filter, or NULL. */
+};
+
+static const struct bench_case bench_cases[] = {
+    /* Template lookup and decoding: into columns with the best kernels,
+     * with the portable kernels, record by record, and op by op. */
+    { "decode", false, 0, 0, false, "auto", NULL },
+    { "decode-scalar", false, 0, 0, false, "scalar", NULL },
+    { "decode-records", false, 0, 0, false, "off", NULL },
+    { "decode-generic", false, 0, 0, true, "off", NULL },
+    { "print", true, 0, 0, false, "auto", NULL },  /* Plus text rendering. */
+    { "aggregate", false, 1 << 20, 0, false, "auto", NULL },  /* Plus flows. */
+    { "top-k", false, 0, 10, false, "auto", NULL },  /* Plus heavy hitters. */
+    { "top-k-records", false, 0, 10, false, "off", NULL },
+
+    /* Dropping three records in four before decoding or printing them. */
+    { "filter", false, 0, 0, false, "auto", "obs_point_id=0" },
+    { "print-filter", true, 0, 0, false, "auto", "obs_point_id=0" },
+};
+
+static const char *bench_corpus_file;
+static int bench_iterations = 10;
+static bool bench_e2e = false;
+
+/* Returns the number of bytes of heap in use, or -1 if unknown. */
+static long long int
+bench_heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#else
+    return -1;
+#endif
+}
+
+/* Splits the concatenated IPFIX messages in 'corpus' into 'msgs'. */
+static size_t
+bench_split_corpus(const struct ofpbuf *corpus, struct bench_msg **msgs)
+{
+    const uint8_t *p = corpus->data;
+    size_t left = corpus->size;
+    size_t n = 0, allocated = 0;
+
+    *msgs = NULL;
+    while (left) {
+        struct ipfix_message_header msg_hd;
+        uint16_t len;
+
+        if (left < sizeof msg_hd) {
+            ovs_fatal(0, "corpus ends in a truncated message header");
+        }
+        memcpy(&msg_hd, p, sizeof msg_hd);
+        len = ntohs(msg_hd.length);
+        if (len < sizeof msg_hd || len > left) {
+            ovs_fatal(0, "corpus message %"PRIuSIZE" has bad length "
+                      "%"PRIu16, n, len);
+        }
+        if (n >= allocated) {
+            *msgs = x2nrealloc(*msgs, &allocated, sizeof **msgs);
+        }
+        (*msgs)[n].data = p;
+        (*msgs)[n].len = len;
+        n++;
+        p += len;
+        left -= len;
+    }
+    return n;
+}
+
+/* Fills 'corpus' with --corpus's contents, or with what test-ipfix-gen
+ * would send for the current options. */
+static void
+bench_load_corpus(struct ofpbuf *corpus)
+{
+    size_t max_record_len = 0;
+
+    for (size_t i = 0; i < gen_n_selected; i++) {
+        max_record_len = MAX(max_record_len, gen_selected[i]->record_len);
+    }
+    ofpbuf_init(corpus, bench_corpus_file ? 0
+                : (size_t) gen_count * (IPFIX_MES_HEADER_LEN
+                                        + IPFIX_SET_HEADER_LEN
+                                        + gen_records * max_record_len));
+    if (bench_corpus_file) {
+        FILE *stream = fopen(bench_corpus_file, "rb");
+        size_t n;
+
+        if (!stream) {
+            ovs_fatal(errno, "%s: open failed", bench_corpus_file);
+        }
+        do {
+            ofpbuf_prealloc_tailroom(corpus, 65536);
+            n = fread(ofpbuf_tail(corpus), 1, ofpbuf_tailroom(corpus),
+                      stream);
+            corpus->size += n;
+        } while (n);
+        if (ferror(stream)) {
+            ovs_fatal(errno, "%s: read failed", bench_corpus_file);
+        }
+        fclose(stream);
+    } else {
+        for (size_t i = 0; i < gen_n_exporters; i++) {
+            struct gen_exporter e;
+
+            memset(&e, 0, sizeof e);
+            e.out = *corpus;
+            e.domains = xcalloc(gen_n_domains, sizeof *e.domains);
+            for (size_t j = 0; j < gen_n_domains; j++) {
+                e.domains[j].obs_domain = i * gen_n_domains + j;
+            }
+            for (size_t j = 0; j < gen_count / gen_n_exporters; j++) {
+                gen_queue_data(&e, &e.domains[e.next_domain]);
+                e.next_domain = (e.next_domain + 1) % gen_n_domains;
+            }
+            *corpus = e.out;
+            free(e.domains);
+        }
+    }
+}
+
+static void
+bench_run_case(const struct bench_case *bc, const struct bench_msg *msgs,
+               size_t n_msgs)
+{
+    unsigned long long int n_records = 0;
+    long long int heap_before, heap_after, start, elapsed;
+    struct sockaddr_storage from;
+    struct sockaddr_in *sin = (struct sockaddr_in *) &from;
+    struct ipfix_collector c;
+    struct ds s;
+
+    memset(&from, 0, sizeof from);
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin->sin_port = htons(4739);
+
+    print_records = bc->print_records;
+    agg_max_flows = bc->agg_max_flows;
+    hh_top_k = bc->hh_top_k;
+    ipfix_fast_path = !bc->generic_decode;
+    ovs_assert(ipfix_column_kernels_select(bc->columns));
+    ipfix_filter_destroy(filter);
+    filter = NULL;
+    if (bc->filter) {
+        ovs_assert(!ipfix_filter_parse(bc->filter, &filter));
+    }
+    ipfix_collector_init(&c);
+    c.rx_usec = time_wall_usec();
+
+    /* One pass to learn the templates and size the buffers, then the
+     * measured passes. */
+    heap_before = 0;
+    start = 0;
+    for (int iter = -1; iter < bench_iterations; iter++) {
+        if (!iter) {
+            heap_before = bench_heap_in_use();
+            start = ipfix_now_ns();
+        }
+        for (size_t i = 0; i < n_msgs; i++) {
+            struct ofpbuf buf;
+
+            ofpbuf_use_const(&buf, msgs[i].data, msgs[i].len);
+            n_records += print_ipfix(&c, &from, &buf);
+            if (c.out.length >= 65536) {
+                ds_clear(&c.out);
+            }
+        }
+        if (iter < 0) {
+            n_records = 0;
+        }
+    }
+    elapsed = ipfix_now_ns() - start;
+    heap_after = bench_heap_in_use();
+    ipfix_collector_destroy(&c);
+
+    ds_init(&s);
+    ds_put_format(&s, "{\"benchmark\": \"%s\", \"messages\": %llu, "
+                  "\"records\": %llu, \"seconds\": %.6f, ",
+                  bc->name, (unsigned long long int) n_msgs
+                  * bench_iterations, n_records, elapsed / 1e9);
+    ds_put_format(&s, "\"records_per_sec\": %.0f, \"ns_per_record\": %.2f, ",
+                  elapsed ? n_records * 1e9 / elapsed : 0.0,
+                  n_records ? (double) elapsed / n_records : 0.0);
+    if (heap_before >= 0) {
+        ds_put_format(&s, "\"heap_delta_bytes\": %lld}\n",
+                      heap_after - heap_before);
+    } else {
+        ds_put_cstr(&s, "\"heap_delta_bytes\": null}\n");
+    }
+    fputs(ds_cstr(&s), stdout);
+    ds_destroy(&s);
+}
+
+/* Runs 'command' on the collector behind 'client' and returns the value
+ * of the "NAME: VALUE" line 'name' in its reply, or 0. */
+static unsigned long long int
+bench_collector_stat(struct jsonrpc *client, const char *command,
+                     const char *name)
+{
+    unsigned long long int value = 0;
+    char *result, *error;
+    int retval;
+
+    retval = unixctl_client_transact(client, command, 0, NULL,
+                                     &result, &error);
+    if (retval || error) {
+        ovs_fatal(retval, "%s: %s", command, error ? error : "failed");
+    }
+    for (char *line = result; line && *line; ) {
+        char *next = strchr(line, '\n');
+        size_t name_len = strlen(name);
+
+        if (!strncmp(line, name, name_len) && line[name_len] == ':') {
+            value = strtoull(line + name_len + 1, NULL, 10);
+        }
+        line = next ? next + 1 : NULL;
+    }
+    free(result);
+    return value;
+}
+
+/* Forks a collector listening on 'target', running it with the extra
+ * options 'argv', and connects to its unixctl server. */
+static pid_t
+bench_start_collector(const char *target, int argc, char *argv[],
+                      struct jsonrpc **client)
+{
+    char *ctl_path;
+    pid_t pid;
+
+    pid = fork();
+    if (pid < 0) {
+        ovs_fatal(errno, "fork failed");
+    } else if (!pid) {
+        char **child_argv = xcalloc(argc + 3, sizeof *child_argv);
+        int null_fd = open("/dev/null", O_WRONLY);
+
+        if (null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+            ovs_fatal(errno, "/dev/null: open failed");
+        }
+        child_argv[0] = "test-ipfix";
+        memcpy(&child_argv[1], argv, argc * sizeof *argv);
+        child_argv[argc + 1] = CONST_CAST(char *, target);
+        optind = 0;
+        test_ipfix_main(argc + 2, child_argv);
+        exit(EXIT_SUCCESS);
+    }
+
+    ctl_path = xasprintf("%s/test-ipfix.%ld.ctl", ovs_rundir(), (long) pid);
+    for (int i = 0; unixctl_client_create(ctl_path, client); i++) {
+        if (i >= 1000 || waitpid(pid, NULL, WNOHANG) == pid) {
+            ovs_fatal(0, "collector did not start");
+        }
+        poll_timer_wait(10);
+        poll_block();
+    }
+    free(ctl_path);
+    return pid;
+}
+
+static void
+bench_run_e2e(int argc, char *argv[])
+{
+    unsigned long long int n_datagrams = 0, n_records, n_sent;
+    long long int start, last_change;
+    struct sockaddr_storage ss;
+    struct gen_exporter *exporters;
+    struct jsonrpc *client;
+    char *target, *error;
+    char *result;
+    int fd, status;
+    pid_t pid;
+    struct ds s;
+
+    /* Pick a free port for the collector. */
+    fd = inet_open_passive(SOCK_DGRAM, "0:127.0.0.1", 0, &ss, 0, false);
+    if (fd < 0) {
+        ovs_fatal(-fd, "failed to pick a UDP port");
+    }
+    closesocket(fd);
+    target = xasprintf("%"PRIu16":127.0.0.1", ss_get_port(&ss));
+    pid = bench_start_collector(target, argc, argv, &client);
+    free(target);
+
+    target = xasprintf("127.0.0.1:%"PRIu16, ss_get_port(&ss));
+    exporters = xcalloc(gen_n_exporters, sizeof *exporters);
+    for (size_t i = 0; i < gen_n_exporters; i++) {
+        gen_exporter_init(&exporters[i], target, i);
+    }
+    free(target);
+
+    start = time_msec();
+    gen_run(exporters, gen_n_exporters);
+    n_sent = gen_n_data + gen_n_template;
+
+    /* Wait for the collector to take in everything or to stall. */
+    last_change = time_msec();
+    while (n_datagrams < n_sent && time_msec() - last_change < 500) {
+        unsigned long long int n = bench_collector_stat(
+            client, "ipfix/batch-stats", "datagrams");
+        if (n != n_datagrams) {
+            n_datagrams = n;
+            last_change = time_msec();
+        }
+        poll_timer_wait(1);
+        poll_block();
+    }
+    n_records = bench_collector_stat(client, "ipfix/batch-stats", "records");
+
+    unixctl_client_transact(client, "exit", 0, NULL, &result, &error);
+    free(result);
+    free(error);
+    jsonrpc_close(client);
+    waitpid(pid, &status, 0);
+    for (size_t i = 0; i < gen_n_exporters; i++) {
+        gen_exporter_destroy(&exporters[i]);
+    }
+    free(exporters);
+
+    last_change -= start;
+    ds_init(&s);
+    ds_put_format(&s, "{\"benchmark\": \"e2e-udp\", \"messages_sent\": %llu, "
+                  "\"messages_received\": %llu, \"records_sent\": %llu, "
+                  "\"records_received\": %llu, ",
+                  n_sent, n_datagrams, gen_n_records, n_records);
+    ds_put_format(&s, "\"loss\": %.6f, \"seconds\": %.3f, "
+                  "\"records_per_sec\": %.0f, \"ns_per_record\": %.2f}\n",
+                  n_sent ? 1.0 - (double) n_datagrams / n_sent : 0.0,
+                  last_change / 1e3,
+                  last_change > 0 ? n_records * 1e3 / last_change : 0.0,
+                  n_records ? last_change * 1e6 / n_records : 0.0);
+    fputs(ds_cstr(&s), stdout);
+    ds_destroy(&s);
+}
+
+static void
+parse_bench_options(int argc, char *argv[])
+{
+    enum {
+        OPT_COUNT = UCHAR_MAX + 1,
+        OPT_RECORDS,
+        OPT_EXPORTERS,
+        OPT_DOMAINS,
+        OPT_FLOWS,
+        OPT_TEMPLATES,
+        OPT_CORPUS,
+        OPT_ITERATIONS,
+        OPT_E2E,
+        OPT_RATE,
+    };
+    static const struct option long_options[] = {
+            {"count", required_argument, NULL, OPT_COUNT},
+            {"records", required_argument, NULL, OPT_RECORDS},
+            {"exporters", required_argument, NULL, OPT_EXPORTERS},
+            {"domains", required_argument, NULL, OPT_DOMAINS},
+            {"flows", required_argument, NULL, OPT_FLOWS},
+            {"templates", required_argument, NULL, OPT_TEMPLATES},
+            {"corpus", required_argument, NULL, OPT_CORPUS},
+            {"iterations", required_argument, NULL, OPT_ITERATIONS},
+            {"e2e", no_argument, NULL, OPT_E2E},
+            {"rate", required_argument, NULL, OPT_RATE},
+            {NULL, 0, NULL, 0},
+    };
+    char *short_options = ovs_cmdl_long_options_to_short_options(long_options);
+
+    gen_select_templates(GEN_DEFAULT_TEMPLATES);
+    gen_count = 10000;
+    gen_records = 10;
+
+    for (;;) {
+        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case OPT_COUNT:
+                gen_count = gen_parse_count("count", optarg, 1);
+                break;
+            case OPT_RECORDS:
+                gen_records = gen_parse_count("records", optarg, 1);
+                break;
+            case OPT_EXPORTERS:
+                gen_n_exporters = gen_parse_count("exporters", optarg, 1);
+                break;
+            case OPT_DOMAINS:
+                gen_n_domains = gen_parse_count("domains", optarg, 1);
+                break;
+            case OPT_FLOWS:
+                gen_n_flows = gen_parse_count("flows", optarg, 1);
+                break;
+            case OPT_TEMPLATES:
+                gen_select_templates(optarg);
+                break;
+            case OPT_CORPUS:
+                bench_corpus_file = optarg;
+                break;
+            case OPT_ITERATIONS:
+                bench_iterations = gen_parse_count("iterations", optarg, 1);
+                break;
+            case OPT_E2E:
+                bench_e2e = true;
+                break;
+            case OPT_RATE:
+                gen_rate = gen_parse_count("rate", optarg, 0);
+                break;
+            case '?':
+                exit(EXIT_FAILURE);
+            default:
+                abort();
+        }
+    }
+    free(short_options);
+}
+
+static void
+test_ipfix_bench_main(int argc, char *argv[])
+{
+    set_program_name(argv[0]);
+    parse_bench_options(argc, argv);
+    if (optind < argc && !bench_e2e) {
+        ovs_fatal(0, "usage: %s [--count=N] [--records=N] [--exporters=N] "
+                  "[--domains=N] [--flows=N] [--templates=ID[,ID...]] "
+                  "[--corpus=FILE] [--iterations=N] "
+                  "| --e2e [--rate=MSGS/S] [...] [-- COLLECTOR-OPTIONS]",
+                  program_name);
+    }
+    gen_init();
+
+    if (bench_e2e) {
+        bench_run_e2e(argc - optind, argv + optind);
+    } else {
+        struct bench_msg *msgs;
+        struct ofpbuf corpus;
+        size_t n_msgs;
+
+        ipfix_builtin_templates_init();
+        bench_load_corpus(&corpus);
+        n_msgs = bench_split_corpus(&corpus, &msgs);
+        for (size_t i = 0; i < ARRAY_SIZE(bench_cases); i++) {
+            bench_run_case(&bench_cases[i], msgs, n_msgs);
+        }
+        ipfix_filter_destroy(filter);
+        free(msgs);
+        ofpbuf_uninit(&corpus);
+    }
+    gen_destroy();
+}
+OVSTEST_REGISTER("test-ipfix-bench", test_ipfix_bench_main);